@@ -0,0 +1,28 @@
+// Planet-scene vertex animation shared by the geometry and shadow passes
+
+// Orbit a world position around 'center' in XZ, with a small vertical wobble
+vec4 moonOrbit(vec4 wpos, vec3 center, float speed, float phase, float time) {
+    float ang = time * speed + phase;
+
+    mat2 rot = mat2(
+        cos(ang), -sin(ang),
+        sin(ang),  cos(ang)
+    );
+
+    vec3 rel = wpos.xyz - center;
+    vec2 xz  = rot * rel.xz;
+    rel.x = xz.x;
+    rel.z = xz.y;
+
+    // tiny vertical wobble so it feels alive
+    rel.y += 0.1 * sin(ang * 2.0);
+
+    return vec4(rel + center, wpos.w);
+}
+
+// Bob a world position up and down
+vec4 floatBob(vec4 wpos, float speed, float amp, float phase, float time) {
+    float t = time * speed + phase;
+    wpos.y += sin(t) * amp;
+    return wpos;
+}
@@ -1,4 +1,6 @@
 #version 330 core
+// Permutation defines (injected by ShaderLoader, see Realtime::geometryProgram):
+//   PLANET, SAND, TEXTURE, TEXTURE_ARRAY, SHADOWS, SHADOW_FILTER n, DEFERRED
 in vec3 v_n;
 in vec3 v_wpos;
 in vec2 v_uv;
@@ -6,16 +8,17 @@ in vec2 v_velocity;
 in vec3 v_objPos;
 in vec4 v_lightSpacePos;
 
-const int MAX_LIGHTS = 8;
-
-uniform int  u_numLights;
-uniform int  u_lightType[MAX_LIGHTS];   // 0=directional, 1=point, 2=spot
-uniform vec3 u_lightColor[MAX_LIGHTS];
-uniform vec3 u_lightPos[MAX_LIGHTS];    // unused for directional
-uniform vec3 u_lightDir[MAX_LIGHTS];    // unused for point
-uniform vec3 u_lightFunc[MAX_LIGHTS];   // attenuation (c, l, q)
-uniform float u_lightAngle[MAX_LIGHTS]; // radians
-uniform float u_lightPenumbra[MAX_LIGHTS]; // radians
+// Clustered lights (see LightClusterer): 4 texels per light in scene order
+//   (pos.xyz, type) (color.rgb, range) (dir.xyz, angle) (function.xyz, penumbra)
+// type: 0=directional, 1=point, 2=spot
+uniform samplerBuffer  u_lightData;
+uniform usamplerBuffer u_clusterRanges;  // (offset, count) per froxel
+uniform usamplerBuffer u_lightIndices;   // global lights first, then froxel lists
+uniform int   u_numGlobalLights;
+uniform ivec3 u_clusterGrid;
+uniform vec2  u_clusterScreen;           // framebuffer size in pixels
+uniform vec2  u_clusterDepth;            // (near, far) used for the exponential slices
+uniform mat4  u_V;
 
 uniform vec3 u_global; // (ka, kd, ks)
 
@@ -30,64 +33,38 @@ uniform vec3 u_fogColor;
 uniform float u_fogDensity; // use exp2 fog: factor = 1 - exp(-(density * dist)^2)
 uniform int u_fogEnable;
 
-// Shadow mapping
-uniform sampler2D u_shadowMap;
-uniform int u_useShadows;
+// Shadow mapping (SHADOWS); samplers are declared in shadow_filter.glsl
+uniform int u_shadowLightIndex;         // light that owns the shadow map
 
 // Texture mapping
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray u_tex;
+uniform float u_texLayer;               // layer of the packed array this draw uses
+#else
 uniform sampler2D u_tex;
-uniform int  u_hasTexture;
+#endif
 uniform vec2 u_texRepeat;
 uniform float u_blend; // 0 = use pure u_kd; 1 = use pure texture
 
 // planet params
-uniform bool  u_isPlanet;       // per-draw flag
 uniform float u_time;           // global scene time
 uniform vec3  u_planetColorA;   // dark band color
 uniform vec3  u_planetColorB;   // light band color
-// terrain / sand params
-uniform bool  u_isSand;
-
 layout(location=0) out vec4 fragColor;
 layout(location=1) out vec2 outVelocity;
 layout(location=2) out vec4 outNormal;
+#ifdef DEFERRED
+// Deferred G-buffer: ambient + material only, lights are added by deferred_light.frag
+layout(location=3) out vec4 outAlbedo;   // rgb = diffuse albedo, a = light weight (1 - fog, 0 = unlit)
+layout(location=4) out vec4 outSpecular; // rgb = global ks * ks
+#endif
 
 const float PI      = 3.14159265358979;
 const float EPSILON = 0.01;
 const float PHI     = (1.0 + sqrt(5.0)) / 2.0;
 
-// Simple 4D hash -> [0,1]
-float hash41(vec4 p) {
-    float h = dot(p, vec4(127.1, 311.7, 74.7, 157.3));
-    return fract(sin(h) * 43758.5453123);
-}
-
-// Value noise -> [-1,1]
-float noise(vec3 p, int s) {
-    vec3 f = floor(p);
-    vec3 q = fract(p);
-
-    // smooth interpolation
-    q *= q * (3.0 - 2.0 * q);
-    q *= q * (3.0 - 2.0 * q);
-
-    float n000 = hash41(vec4(f + vec3(0,0,0), float(s)));
-    float n001 = hash41(vec4(f + vec3(0,0,1), float(s)));
-    float n010 = hash41(vec4(f + vec3(0,1,0), float(s)));
-    float n011 = hash41(vec4(f + vec3(0,1,1), float(s)));
-    float n100 = hash41(vec4(f + vec3(1,0,0), float(s)));
-    float n101 = hash41(vec4(f + vec3(1,0,1), float(s)));
-    float n110 = hash41(vec4(f + vec3(1,1,0), float(s)));
-    float n111 = hash41(vec4(f + vec3(1,1,1), float(s)));
-
-    float nz  = mix(mix(n000, n001, q.z),
-                    mix(n010, n011, q.z), q.y);
-    float nz2 = mix(mix(n100, n101, q.z),
-                    mix(n110, n111, q.z), q.y);
-    float n = mix(nz, nz2, q.x);
-
-    return n * 2.0 - 1.0;
-}
+#include "noise.glsl"
+#include "fog.glsl"
 
 float sandNoise2D(vec2 p) {
     // just reuse 3D noise with z=0 and a different seed
@@ -171,42 +148,80 @@ float dunePattern(vec3 objPos) {
     return clamp(v, 0.0, 1.0);
 }
 
-float computeShadow(vec4 lightSpacePos, vec3 normal, vec3 lightDir) {
-    // Perspective divide
-    vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
-
-    // Transform from NDC [-1,1] to [0,1]
-    projCoords = projCoords * 0.5 + 0.5;
+#include "shadow_filter.glsl"
+
+// Froxel of this fragment; must match LightClusterer's x-major, then y, then z layout
+int clusterIndex() {
+    ivec2 tile = ivec2(gl_FragCoord.xy / u_clusterScreen * vec2(u_clusterGrid.xy));
+    tile = clamp(tile, ivec2(0), u_clusterGrid.xy - 1);
+    float viewDepth = -(u_V * vec4(v_wpos, 1.0)).z;
+    float slice = log(max(viewDepth, u_clusterDepth.x) / u_clusterDepth.x)
+                / log(u_clusterDepth.y / u_clusterDepth.x) * float(u_clusterGrid.z);
+    int k = clamp(int(slice), 0, u_clusterGrid.z - 1);
+    return tile.x + u_clusterGrid.x * (tile.y + u_clusterGrid.y * k);
+}
 
-    // If outside light frustum, treat as unshadowed
-    if (projCoords.x < 0.0 || projCoords.x > 1.0 ||
-        projCoords.y < 0.0 || projCoords.y > 1.0 ||
-        projCoords.z < 0.0 || projCoords.z > 1.0) {
-        return 1.0;
+vec3 shadeLight(int li, vec3 n, vec3 V, vec3 baseKd) {
+    vec4 posType    = texelFetch(u_lightData, li * 4 + 0);
+    vec4 colorRange = texelFetch(u_lightData, li * 4 + 1);
+    vec4 dirAngle   = texelFetch(u_lightData, li * 4 + 2);
+    vec4 funcPen    = texelFetch(u_lightData, li * 4 + 3);
+    int type = int(posType.w);
+
+    vec3 L;
+    float attenuation = 1.0;
+    float spotFactor = 1.0;
+
+    if (type == 0) {
+        // Directional
+        L = -normalize(dirAngle.xyz);
+    } else {
+        // Point or Spot
+        vec3 toLight = posType.xyz - v_wpos;
+        float dist = length(toLight);
+        if (dist > 0.0) {
+            L = toLight / dist;
+        } else {
+            L = vec3(0.0, 1.0, 0.0);
+        }
+        vec3 f = funcPen.xyz;
+        attenuation = 1.0 / max(f.x + f.y * dist + f.z * dist * dist, 0.0001);
+
+        if (type == 2) {
+            // Spot: falloff following formula
+            vec3 spotDir = normalize(dirAngle.xyz);
+            // outer cone = angle, inner = angle - penumbra
+            float innerC = cos(max(dirAngle.w - funcPen.w, 0.0));
+            float outerC = cos(dirAngle.w);
+            float c = dot(-L, spotDir); // cos(angle between light dir and point)
+            float denom = max(innerC - outerC, 1e-4);
+            float u = clamp((innerC - c) / denom, 0.0, 1.0); // 0 at inner, 1 at outer
+            float falloff = -2.0 * u * u * u + 3.0 * u * u;
+            spotFactor = 1.0 - falloff;
+        }
     }
 
-    // Depth from this fragment in light space (0..1)
-    float currentDepth = projCoords.z;
-
-    // Bias to avoid shadow acne (angle-dependent)
-    float bias = max(0.002 * (1.0 - dot(normal, lightDir)), 0.0005);
-
-    // Simple 3x3 PCF
-    vec2 texelSize = 1.0 / vec2(textureSize(u_shadowMap, 0));
-    float result = 0.0;
-    int samples = 0;
-
-    for (int x = -1; x <= 1; x++) {
-        for (int y = -1; y <= 1; y++) {
-            vec2 offset = vec2(x, y) * texelSize;
-            float closestDepth = texture(u_shadowMap, projCoords.xy + offset).r;
-            // If current depth is farther than stored depth -> in shadow
-            result += (currentDepth - bias > closestDepth) ? 0.0 : 1.0;
-            samples++;
-        }
+    float NdotL = max(dot(n, L), 0.0);
+    vec3 diffuse = baseKd * NdotL;
+
+    // Phong specular
+    vec3 R = reflect(-L, n);
+    float RdotV = max(dot(R, V), 0.0);
+    float specPow = (u_shininess <= 0.0) ? 0.0 : pow(RdotV, u_shininess);
+    vec3 specular = u_global.z * u_ks * specPow;
+
+    // Only the directional light that owns the shadow map is shadowed
+    float shadow = 1.0;
+#ifdef SHADOWS
+    if (type == 0 && li == u_shadowLightIndex) {
+        // L is the light direction from fragment to light
+        shadow = computeShadow(v_lightSpacePos, n, L);
     }
+#endif
+    float minShadow = 0.3;
+    float shadowFactor = mix(minShadow, 1.0, shadow);
 
-    return result / float(samples);
+    return (diffuse + specular) * colorRange.rgb * attenuation * spotFactor * shadowFactor;
 }
 
 void main() {
@@ -219,21 +234,26 @@ void main() {
     vec3 baseKd;
     vec3 planetKd = vec3(0.0);
 
-    if (u_isPlanet) {
+#ifdef PLANET
           // ignore texture; full procedural color
           planetKd = planetBaseColor(v_objPos);
           baseKd   = planetKd;  // kd = planet colors
           // tweak n to bumpy planet normal
           n = planetNormal(v_objPos);
-      } else {
-          if (u_hasTexture == 1) {
+#else
+  #ifdef TEXTURE
+    #ifdef TEXTURE_ARRAY
+              vec3 texColor = texture(u_tex, vec3(v_uv * u_texRepeat, u_texLayer)).rgb;
+    #else
               vec3 texColor = texture(u_tex, v_uv * u_texRepeat).rgb;
+    #endif
               baseKd = u_global.y * u_kd * (1.0 - b) + texColor * b;
-          } else {
+  #else
               baseKd = u_global.y * u_kd;
-          }
+  #endif
           // --- extra stylization for dunes ---
-          if (u_isSand) {
+  #ifdef SAND
+            {
             // 1) Base sand palette
               vec3 colDark = baseKd * vec3(0.85, 0.65, 0.55);
               vec3 colLight = baseKd * vec3(1.05, 0.95, 0.85);
@@ -299,11 +319,12 @@ void main() {
 
               baseKd = mix(baseKd, contourColor, contourMask * contourStrength);
             }
-      }
+  #endif
+#endif
 
     // Ambient
     vec3 color;
-    if (u_isPlanet) {
+#ifdef PLANET
         // --- Fake hemisphere + rim lighting for planets ---
         // planetKd is the procedural color from planetBaseColor()
 
@@ -319,84 +340,42 @@ void main() {
         vec3 rimColor = planetKd * 0.25;      // subtle, same hue family
 
         color = hemiLit + rim * rimColor;
-        } else {
-
+#elif defined(DEFERRED)
+            color = u_global.x * u_ka;
+#else
             color = u_global.x * u_ka;
 
-            // Lighting loop
-            for (int i = 0; i < u_numLights; i++) {
-                vec3 L;
-                float attenuation = 1.0;
-                float spotFactor = 1.0;
-
-                if (u_lightType[i] == 0) {
-                    // Directional
-                    vec3 dir = normalize(u_lightDir[i]);
-                    L = -dir;
-                } else {
-                    // Point or Spot
-                    vec3 toLight = u_lightPos[i] - v_wpos;
-                    float dist = length(toLight);
-                    if (dist > 0.0) {
-                        L = toLight / dist;
-                    } else {
-                        L = vec3(0.0, 1.0, 0.0);
-                    }
-                    vec3 f = u_lightFunc[i];
-                    attenuation = 1.0 / max(f.x + f.y * dist + f.z * dist * dist, 0.0001);
-
-                    if (u_lightType[i] == 2) {
-                        // Spot: falloff following formula
-                        vec3 spotDir = normalize(u_lightDir[i]);
-                        // outer cone = angle, inner = angle - penumbra
-                        float innerC = cos(max(u_lightAngle[i] - u_lightPenumbra[i], 0.0));
-                        float outerC = cos(u_lightAngle[i]);
-                        float c = dot(-L, spotDir); // cos(angle between light dir and point)
-                        float denom = max(innerC - outerC, 1e-4);
-                        float u = clamp((innerC - c) / denom, 0.0, 1.0); // 0 at inner, 1 at outer
-                        float falloff = -2.0 * u * u * u + 3.0 * u * u;
-                        spotFactor = 1.0 - falloff;
-                    }
-                }
-
-                float NdotL = max(dot(n, L), 0.0);
-                vec3 diffuse = baseKd * NdotL;
-
-                // Phong specular
-                vec3 R = reflect(-L, n);
-                float RdotV = max(dot(R, V), 0.0);
-                float specPow = (u_shininess <= 0.0) ? 0.0 : pow(RdotV, u_shininess);
-                vec3 specular = u_global.z * u_ks * specPow;
-                // Shadow fogFactor
-                float shadow = 1.0;
-                if (u_useShadows == 1 && u_lightType[i] == 0) {
-                    // L is the light direction from fragment to light
-                    shadow = computeShadow(v_lightSpacePos, n, L);
-                }
-                float minShadow = 0.3;
-                float shadowFactor = mix(minShadow, 1.0, shadow);
-
-                vec3 lightContribution =
-                    (diffuse + specular) * u_lightColor[i] * attenuation * spotFactor * shadowFactor;
-
-                // vec3 lightContribution = (diffuse + specular) * u_lightColor[i] * attenuation * spotFactor;
-                color += lightContribution;
+            // Global lights, then the lights binned into this fragment's froxel
+            int froxel = clusterIndex();
+            uvec2 range = texelFetch(u_clusterRanges, froxel).xy;
+            for (int i = 0; i < u_numGlobalLights; i++) {
+                int li = int(texelFetch(u_lightIndices, i).r);
+                color += shadeLight(li, n, V, baseKd);
             }
-        }
+            for (uint i = range.x; i < range.x + range.y; i++) {
+                int li = int(texelFetch(u_lightIndices, int(i)).r);
+                color += shadeLight(li, n, V, baseKd);
+            }
+#endif
     // Apply distance-based atmospheric fog
     float fogFactor = 0.0;
     if (u_fogEnable == 1) {
-        float dist = length(u_camPos - v_wpos);
-        float d = u_fogDensity * dist;
-        // Exponential-squared fog (smooth falloff)
-        // Choose density so ~98% fog at far plane using exp2 model:
-        // 1 - exp(-(density*far)^2) ~= 0.98  => density ~= sqrt(-ln(0.02)) / far
-        fogFactor = 1.0 - exp(-d * d);
-        fogFactor = clamp(fogFactor, 0.0, 1.0);
+        fogFactor = fogFactorExp2(length(u_camPos - v_wpos), u_fogDensity);
     }
     vec3 finalColor = mix(color, u_fogColor, fogFactor);
     fragColor = vec4(finalColor, 1.0);
     outVelocity = v_velocity;
+#ifdef DEFERRED
+    // Fog is linear in the light sum, so lights are weighted by (1 - fog) when accumulated
+    outNormal   = vec4(normalize(n) * 0.5 + 0.5, u_shininess);
+  #ifdef PLANET
+    outAlbedo   = vec4(0.0);
+  #else
+    outAlbedo   = vec4(baseKd, 1.0 - fogFactor);
+  #endif
+    outSpecular = vec4(u_global.z * u_ks, 1.0);
+#else
     outNormal = vec4(normalize(n) * 0.5 + 0.5, 1.0);
+#endif
 
 }
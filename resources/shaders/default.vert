@@ -1,4 +1,5 @@
 #version 330 core
+// Permutation defines (injected by ShaderLoader): MOON, FLOATING_CUBE
 layout(location=0) in vec3 a_pos;
 layout(location=1) in vec3 a_nor;
 layout(location=2) in vec2 a_uv;
@@ -13,12 +14,10 @@ uniform mat4 u_prevP;
 
 uniform float u_time;
 
-uniform bool  u_isMoon;
 uniform vec3  u_moonCenter;
 uniform float u_orbitSpeed;
 uniform float u_orbitPhase;
 
-uniform bool  u_isFloatingCube;
 uniform float u_floatSpeed;
 uniform float u_floatAmp;
 uniform float u_floatPhase;
@@ -32,36 +31,21 @@ out vec2 v_velocity;
 out vec3 v_objPos;
 out vec4 v_lightSpacePos;
 
+#include "animation.glsl"
+
 void main() {
     // start in world space
     vec4 wpos = u_M * vec4(a_pos, 1.0);
 
     // Orbiting moons around a center
-    if (u_isMoon) {
-        float ang = u_time * u_orbitSpeed + u_orbitPhase;
-
-        mat2 rot = mat2(
-            cos(ang), -sin(ang),
-            sin(ang),  cos(ang)
-        );
-
-        vec3 rel = wpos.xyz - u_moonCenter;
-        vec2 xz  = rot * rel.xz;
-        rel.x = xz.x;
-        rel.z = xz.y;
-
-        // tiny vertical wobble so it feels alive
-        rel.y += 0.1 * sin(ang * 2.0);
-
-        wpos.xyz = rel + u_moonCenter;
-    }
+#ifdef MOON
+    wpos = moonOrbit(wpos, u_moonCenter, u_orbitSpeed, u_orbitPhase, u_time);
+#endif
 
     // Bobbing cubes up and down
-    if (u_isFloatingCube) {
-        float t   = u_time * u_floatSpeed + u_floatPhase;
-        float bob = sin(t) * u_floatAmp;
-        wpos.y += bob;
-    }
+#ifdef FLOATING_CUBE
+    wpos = floatBob(wpos, u_floatSpeed, u_floatAmp, u_floatPhase, u_time);
+#endif
 
     v_wpos   = wpos.xyz;
     v_n      = normalize(u_N * a_nor);
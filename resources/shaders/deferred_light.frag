@@ -0,0 +1,109 @@
+#version 330 core
+
+// Deferred light accumulation: one fullscreen pass for global lights, one
+// stencil-culled volume pass per bounded light. Output is added on top of the
+// ambient + fog color default.frag wrote in deferred mode.
+
+// G-buffer (see default.frag, u_deferred == 1)
+uniform sampler2D u_gDepth;
+uniform sampler2D u_gNormal;    // xyz = n * 0.5 + 0.5, w = shininess
+uniform sampler2D u_gAlbedo;    // rgb = diffuse albedo, a = light weight
+uniform sampler2D u_gSpecular;  // rgb = global ks * ks
+
+uniform mat4 u_invViewProj;
+uniform vec2 u_screen;          // G-buffer size: texel lookups
+uniform vec2 u_viewport;        // area the scene was drawn into: NDC
+uniform vec3 u_camPos;
+
+// Same light layout as the clustered forward path (LightClusterer)
+uniform samplerBuffer  u_lightData;
+uniform usamplerBuffer u_lightIndices;
+uniform int u_numGlobalLights;
+uniform int u_lightIndex;              // -1 = all global lights
+
+// Shadow mapping (samplers and filter in shadow_filter.glsl)
+uniform int u_useShadows;
+uniform int u_shadowLightIndex;
+uniform mat4 u_lightViewProj;
+
+out vec4 fragColor;
+
+#include "shadow_filter.glsl"
+
+vec3 shadeLight(int li, vec3 wpos, vec3 n, vec3 V, vec3 kd, vec3 ks, float shininess) {
+    vec4 posType    = texelFetch(u_lightData, li * 4 + 0);
+    vec4 colorRange = texelFetch(u_lightData, li * 4 + 1);
+    vec4 dirAngle   = texelFetch(u_lightData, li * 4 + 2);
+    vec4 funcPen    = texelFetch(u_lightData, li * 4 + 3);
+    int type = int(posType.w);
+
+    vec3 L;
+    float attenuation = 1.0;
+    float spotFactor = 1.0;
+
+    if (type == 0) {
+        L = -normalize(dirAngle.xyz);
+    } else {
+        vec3 toLight = posType.xyz - wpos;
+        float dist = length(toLight);
+        L = (dist > 0.0) ? toLight / dist : vec3(0.0, 1.0, 0.0);
+        vec3 f = funcPen.xyz;
+        attenuation = 1.0 / max(f.x + f.y * dist + f.z * dist * dist, 0.0001);
+
+        if (type == 2) {
+            vec3 spotDir = normalize(dirAngle.xyz);
+            float innerC = cos(max(dirAngle.w - funcPen.w, 0.0));
+            float outerC = cos(dirAngle.w);
+            float c = dot(-L, spotDir);
+            float denom = max(innerC - outerC, 1e-4);
+            float u = clamp((innerC - c) / denom, 0.0, 1.0);
+            spotFactor = 1.0 - (-2.0 * u * u * u + 3.0 * u * u);
+        }
+    }
+
+    float NdotL = max(dot(n, L), 0.0);
+    vec3 diffuse = kd * NdotL;
+
+    vec3 R = reflect(-L, n);
+    float RdotV = max(dot(R, V), 0.0);
+    float specPow = (shininess <= 0.0) ? 0.0 : pow(RdotV, shininess);
+    vec3 specular = ks * specPow;
+
+    float shadow = 1.0;
+    if (u_useShadows == 1 && type == 0 && li == u_shadowLightIndex) {
+        shadow = computeShadow(u_lightViewProj * vec4(wpos, 1.0), n, L);
+    }
+    float shadowFactor = mix(0.3, 1.0, shadow);
+
+    return (diffuse + specular) * colorRange.rgb * attenuation * spotFactor * shadowFactor;
+}
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / u_screen;
+    float depth = texture(u_gDepth, uv).r;
+    vec4 albedo = texture(u_gAlbedo, uv);
+    // Background, planets (lit in the geometry pass) and fully fogged pixels
+    if (depth >= 1.0 || albedo.a <= 0.0) discard;
+
+    vec4 ndc = vec4(vec3(gl_FragCoord.xy / u_viewport, depth) * 2.0 - 1.0, 1.0);
+    vec4 world = u_invViewProj * ndc;
+    vec3 wpos = world.xyz / world.w;
+
+    vec4 normalShin = texture(u_gNormal, uv);
+    vec3 n = normalize(normalShin.xyz * 2.0 - 1.0);
+    vec3 V = normalize(u_camPos - wpos);
+    vec3 ks = texture(u_gSpecular, uv).rgb;
+
+    vec3 color = vec3(0.0);
+    if (u_lightIndex < 0) {
+        for (int i = 0; i < u_numGlobalLights; ++i) {
+            int li = int(texelFetch(u_lightIndices, i).r);
+            color += shadeLight(li, wpos, n, V, albedo.rgb, ks, normalShin.w);
+        }
+    } else {
+        color = shadeLight(u_lightIndex, wpos, n, V, albedo.rgb, ks, normalShin.w);
+    }
+
+    // Lit contribution fades with the fog exactly as in the forward path
+    fragColor = vec4(color * albedo.a, 0.0);
+}
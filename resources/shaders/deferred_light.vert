@@ -0,0 +1,15 @@
+#version 330 core
+layout(location=0) in vec3 a_pos;
+
+// Light volume transform; ignored for fullscreen (global light) passes,
+// where a_pos comes from the 2D screen quad with z = 0
+uniform mat4 u_MVP;
+uniform int  u_fullscreen;
+
+void main() {
+    if (u_fullscreen == 1) {
+        gl_Position = vec4(a_pos.xy, 0.0, 1.0);
+    } else {
+        gl_Position = u_MVP * vec4(a_pos, 1.0);
+    }
+}
@@ -0,0 +1,7 @@
+// Reconstruct view-space distance from a [0,1] perspective depth-buffer value
+float linearizeDepth(float depth, float nearPlane, float farPlane) {
+    float z_ndc = depth * 2.0 - 1.0; // back to NDC (-1..1)
+    // standard inverse of OpenGL perspective depth mapping
+    return (2.0 * nearPlane * farPlane) /
+           (farPlane + nearPlane - z_ndc * (farPlane - nearPlane));
+}
@@ -0,0 +1,6 @@
+// Circle of confusion shared by the DoF passes: 0 inside the focus range,
+// ramping to 1 one focus range beyond it
+float dofCoc(float linearDepth, float focusDist, float focusRange) {
+    float distFromFocus = abs(linearDepth - focusDist);
+    return clamp((distFromFocus - focusRange) / max(focusRange, 1e-4), 0.0, 1.0);
+}
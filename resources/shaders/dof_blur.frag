@@ -0,0 +1,43 @@
+#version 330 core
+in vec2 v_uv;
+out vec4 fragColor;
+
+// One axis of the separable half-resolution DoF gather
+uniform sampler2D u_srcTex;    // rgb colour, a linear depth
+uniform vec2  u_stepUV;        // axis * (blur radius / TAPS), in UV
+uniform float u_focusDist;
+uniform float u_focusRange;
+
+#include "dof.glsl"
+
+// Taps per side. The stride scales with the radius, so the cost is the same
+// for any bokeh size.
+const int TAPS = 8;
+// Gaussian falloff across the radius (sigma = TAPS / 2), precomputed
+const float kWeights[TAPS + 1] = float[](
+    1.0, 0.9692, 0.8825, 0.7548, 0.6065, 0.4578, 0.3247, 0.2163, 0.1353
+);
+
+void main() {
+    vec4 center = texture(u_srcTex, v_uv);
+    float centerCoc = dofCoc(center.a, u_focusDist, u_focusRange);
+
+    vec3 accum = center.rgb * kWeights[0];
+    float wsum = kWeights[0];
+    for (int i = 1; i <= TAPS; ++i) {
+        for (int s = -1; s <= 1; s += 2) {
+            vec4 tap = texture(u_srcTex, v_uv + float(s * i) * u_stepUV);
+            float coc = dofCoc(tap.a, u_focusDist, u_focusRange);
+            // Taps behind this pixel cannot blur over it further than its own CoC
+            // allows (no background halo around sharp foreground)
+            if (tap.a > center.a) coc = min(coc, centerCoc);
+            // The tap contributes only if its blur disc reaches this pixel
+            float reach = clamp(coc * float(TAPS) - float(i) + 1.0, 0.0, 1.0);
+            float w = kWeights[i] * reach;
+            accum += tap.rgb * w;
+            wsum += w;
+        }
+    }
+
+    fragColor = vec4(accum / wsum, center.a);
+}
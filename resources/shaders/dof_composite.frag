@@ -0,0 +1,51 @@
+#version 330 core
+in vec2 v_uv;
+out vec4 fragColor;
+
+// Full-resolution DoF composite: depth-aware upsample of the half-res blur,
+// blended over the sharp scene by the per-pixel CoC
+uniform sampler2D u_colorTex;
+uniform sampler2D u_depthTex;
+uniform sampler2D u_blurTex;   // half res: rgb blurred colour, a linear depth
+
+uniform float u_near;
+uniform float u_far;
+uniform float u_focusDist;
+uniform float u_focusRange;
+
+#include "depth.glsl"
+#include "dof.glsl"
+
+void main() {
+    vec3 base = texture(u_colorTex, v_uv).rgb;
+    float z = linearizeDepth(texture(u_depthTex, v_uv).r, u_near, u_far);
+    float coc = dofCoc(z, u_focusDist, u_focusRange);
+    if (coc <= 0.0) {
+        fragColor = vec4(base, 1.0);
+        return;
+    }
+
+    // Bilateral upsample: bilinear weights of the 4 nearest half-res texels,
+    // scaled down where their depth differs from this pixel's
+    vec2 halfSize = vec2(textureSize(u_blurTex, 0));
+    vec2 pos = v_uv * halfSize - 0.5;
+    ivec2 p0 = ivec2(floor(pos));
+    vec2 f = fract(pos);
+    ivec2 maxP = ivec2(halfSize) - 1;
+
+    vec3 accum = vec3(0.0);
+    float wsum = 0.0;
+    for (int j = 0; j < 2; ++j) {
+        for (int i = 0; i < 2; ++i) {
+            vec4 t = texelFetch(u_blurTex, clamp(p0 + ivec2(i, j), ivec2(0), maxP), 0);
+            float bw = (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);
+            float dw = 1.0 / (1e-3 + abs(t.a - z) / max(z, 1e-3));
+            float w = bw * dw + 1e-5;
+            accum += t.rgb * w;
+            wsum += w;
+        }
+    }
+    vec3 blurred = accum / wsum;
+
+    fragColor = vec4(mix(base, blurred, coc), 1.0);
+}
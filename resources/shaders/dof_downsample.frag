@@ -0,0 +1,27 @@
+#version 330 core
+in vec2 v_uv;
+out vec4 fragColor;
+
+// Half-resolution DoF input: colour in rgb, linear depth in a
+uniform sampler2D u_colorTex;
+uniform sampler2D u_depthTex;
+
+uniform float u_near;
+uniform float u_far;
+
+#include "depth.glsl"
+
+void main() {
+    // One bilinear fetch at the half-res texel centre averages the 2x2 full-res footprint
+    vec3 color = texture(u_colorTex, v_uv).rgb;
+
+    // Keep the nearest of the four depths so foreground silhouettes survive the downsample
+    ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 maxP = textureSize(u_depthTex, 0) - 1;
+    float d = min(min(texelFetch(u_depthTex, min(p, maxP), 0).r,
+                      texelFetch(u_depthTex, min(p + ivec2(1, 0), maxP), 0).r),
+                  min(texelFetch(u_depthTex, min(p + ivec2(0, 1), maxP), 0).r,
+                      texelFetch(u_depthTex, min(p + ivec2(1, 1), maxP), 0).r));
+
+    fragColor = vec4(color, linearizeDepth(d, u_near, u_far));
+}
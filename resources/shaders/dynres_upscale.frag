@@ -0,0 +1,51 @@
+#version 330 core
+in vec2 v_uv;
+out vec4 fragColor;
+
+// Upscales the dynamic-resolution target (rendered into the lower-left
+// u_srcSize texels of a full-size texture) to the output. Catmull-Rom keeps
+// edges sharper than bilinear. Clamping to the 2x2 source neighbourhood removes
+// its ringing around high-contrast edges.
+uniform sampler2D u_srcTex;
+uniform vec2 u_srcSize;   // rendered texels
+
+vec3 fetchClamped(vec2 texelPos, vec2 texSize) {
+    vec2 p = clamp(texelPos, vec2(0.5), u_srcSize - 0.5);
+    return texture(u_srcTex, p / texSize).rgb;
+}
+
+void main() {
+    vec2 texSize = vec2(textureSize(u_srcTex, 0));
+    vec2 pos = v_uv * u_srcSize;
+
+    // Catmull-Rom in 5 bilinear taps (the 4 corner taps have negligible weight)
+    vec2 pos1 = floor(pos - 0.5) + 0.5;
+    vec2 f = pos - pos1;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+    vec2 pos0 = pos1 - 1.0;
+    vec2 pos3 = pos1 + 2.0;
+    vec2 pos12 = pos1 + w2 / w12;
+
+    vec3 color = fetchClamped(vec2(pos12.x, pos0.y), texSize) * (w12.x * w0.y)
+               + fetchClamped(vec2(pos0.x, pos12.y), texSize) * (w0.x * w12.y)
+               + fetchClamped(pos12, texSize)                 * (w12.x * w12.y)
+               + fetchClamped(vec2(pos3.x, pos12.y), texSize) * (w3.x * w12.y)
+               + fetchClamped(vec2(pos12.x, pos3.y), texSize) * (w12.x * w3.y);
+    float wsum = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+    color /= wsum;
+
+    // Anti-ringing: stay inside the range of the 4 nearest source texels
+    ivec2 p0 = ivec2(pos1 - 0.5);
+    ivec2 maxP = ivec2(u_srcSize) - 1;
+    vec3 a = texelFetch(u_srcTex, clamp(p0, ivec2(0), maxP), 0).rgb;
+    vec3 b = texelFetch(u_srcTex, clamp(p0 + ivec2(1, 0), ivec2(0), maxP), 0).rgb;
+    vec3 c = texelFetch(u_srcTex, clamp(p0 + ivec2(0, 1), ivec2(0), maxP), 0).rgb;
+    vec3 d = texelFetch(u_srcTex, clamp(p0 + ivec2(1, 1), ivec2(0), maxP), 0).rgb;
+    color = clamp(color, min(min(a, b), min(c, d)), max(max(a, b), max(c, d)));
+
+    fragColor = vec4(color, 1.0);
+}
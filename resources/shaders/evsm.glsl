@@ -0,0 +1,4 @@
+// EVSM warp exponents shared by evsm_moments.frag and the shadow lookups.
+// 40 is the largest positive exponent that stays inside fp32 range after squaring.
+const float EVSM_POS = 40.0;
+const float EVSM_NEG = 5.0;
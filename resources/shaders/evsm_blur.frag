@@ -0,0 +1,21 @@
+#version 330 core
+in vec2 v_uv;
+out vec4 fragColor;
+
+// One axis of a separable 9-tap gaussian over the EVSM moments.
+// Taps sit between texels so bilinear filtering folds two weights into one fetch.
+uniform sampler2D u_momentsTex;
+uniform vec2 u_direction; // (1/width, 0) or (0, 1/height)
+
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main() {
+    vec4 sum = textureLod(u_momentsTex, v_uv, 0.0) * weights[0];
+    for (int i = 1; i < 3; i++) {
+        vec2 off = u_direction * offsets[i];
+        sum += textureLod(u_momentsTex, v_uv + off, 0.0) * weights[i];
+        sum += textureLod(u_momentsTex, v_uv - off, 0.0) * weights[i];
+    }
+    fragColor = sum;
+}
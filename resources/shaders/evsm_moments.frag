@@ -0,0 +1,30 @@
+#version 330 core
+in vec2 v_uv;
+out vec4 fragColor;
+
+// Converts the light-space depth map into exponential variance moments.
+// Each output texel averages a u_downsample x u_downsample block of depths
+// in warped space, so the moments map can be smaller than the depth map.
+uniform sampler2D u_depthTex;
+uniform int u_downsample;
+
+#include "evsm.glsl"
+
+vec4 warpDepth(float depth) {
+    float d = depth * 2.0 - 1.0;
+    float pos = exp(EVSM_POS * d);
+    float neg = -exp(-EVSM_NEG * d);
+    return vec4(pos, pos * pos, neg, neg * neg);
+}
+
+void main() {
+    ivec2 base = ivec2(gl_FragCoord.xy) * u_downsample;
+    vec4 moments = vec4(0.0);
+    for (int y = 0; y < u_downsample; y++) {
+        for (int x = 0; x < u_downsample; x++) {
+            float depth = texelFetch(u_depthTex, base + ivec2(x, y), 0).r;
+            moments += warpDepth(depth);
+        }
+    }
+    fragColor = moments / float(u_downsample * u_downsample);
+}
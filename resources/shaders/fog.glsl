@@ -0,0 +1,7 @@
+// Exponential-squared fog (smooth falloff): factor = 1 - exp(-(density * dist)^2).
+// Realtime picks density so ~98% fog at the far plane:
+// 1 - exp(-(density*far)^2) ~= 0.98  => density ~= sqrt(-ln(0.02)) / far
+float fogFactorExp2(float dist, float density) {
+    float d = density * dist;
+    return clamp(1.0 - exp(-d * d), 0.0, 1.0);
+}
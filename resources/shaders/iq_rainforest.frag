@@ -8,7 +8,7 @@
 //
 // This shader raymarches the scene entirely in the fragment stage.
 
-out vec4 fragColor;
+layout(location = 0) out vec4 fragColor;
 in vec2 v_uv; // from post.vert (unused, we use gl_FragCoord for exact pixel coords)
 
 uniform vec3  iResolution; // (width, height, 1)
@@ -22,7 +22,57 @@ uniform vec3 u_sunDir;
 uniform float u_exposure;
 uniform float u_rainforestIntensity; // 0..1, 0: full grading; 1: stronger gray-blue fog
 
-#define LOWQUALITY
+// LOWQUALITY is injected as a permutation define by Realtime (see initializeGL)
+
+// Quality tier budgets; Realtime overrides them as permutation defines
+#ifndef TERRAIN_STEPS
+#define TERRAIN_STEPS 400
+#endif
+#ifndef TREE_STEPS
+#define TREE_STEPS 64
+#endif
+#ifndef CLOUD_STEPS
+#define CLOUD_STEPS 128
+#endif
+
+// TEMPORAL: render into a sparse target (checkerboard or interleaved, see
+// temporal_pattern.glsl) and write the hit distance to alpha for iq_temporal.frag
+#ifdef TEMPORAL
+uniform int u_pattern;
+uniform int u_phase;
+#include "temporal_pattern.glsl"
+#endif
+
+// Coarse depth prepass. COARSE_PREPASS renders one texel per kCoarseTile^2 pixel
+// tile: a cone march that encloses every ray of the tile, so the distance it
+// writes is safe for all of them. COARSE_START reads that texel and starts the
+// terrain march there instead of at tmin.
+const float kCoarseTile = 8.0;
+#ifdef COARSE_START
+uniform sampler2D u_coarseTex;
+#endif
+// Distance to the first opaque hit (2000 for sky) of the last mainImage call
+float g_hitT = 2000.0;
+
+// Portal cull: pixels well inside the portal disc end up under the far side (the
+// stencil mask or the opaque centre of the composite), so they skip the raymarch.
+// The disc is found by unprojecting the pixel onto the portal quad's plane.
+uniform int  u_portalCull;
+uniform mat4 u_portalInvMVP;         // inverse(P * V * portal model), same camera as the quad
+
+bool portalCovers(vec2 fragCoord) {
+    vec2 ndc = 2.0 * fragCoord / iResolution.xy - 1.0;
+    vec4 a = u_portalInvMVP * vec4(ndc, -1.0, 1.0);
+    vec4 b = u_portalInvMVP * vec4(ndc,  1.0, 1.0);
+    a.xyz /= a.w;
+    b.xyz /= b.w;
+    float t = a.z / (a.z - b.z);
+    // Quad is [-0.5, 0.5]^2 in local XY, portal.frag's disc radius is 1 in 2 * local units
+    float d = (t >= 0.0 && t <= 1.0) ? 2.0 * length(mix(a.xy, b.xy, t)) : 1e3;
+    // Wobbling rim never comes inside 0.885 (fully opaque there). Keep a few pixels
+    // of margin for the temporal neighbours and the dynamic-resolution upscale taps.
+    return d + 4.0 * fwidth(d) < 0.88;
+}
 
 //==========================================================================================
 // general utilities
@@ -413,7 +463,7 @@ vec4 renderClouds( in vec3 ro, in vec3 rd, float tmin, float tmax, inout float r
     float t = tmin;
     float lastT = -1.0;
     float thickness = 0.0;
-    for(int i=ZERO; i<128; i++)
+    for(int i=ZERO; i<CLOUD_STEPS; i++)
     { 
         vec3  pos = ro + t*rd; 
         float nnd;
@@ -467,6 +517,48 @@ vec4 renderClouds( in vec3 ro, in vec3 rd, float tmin, float tmax, inout float r
     return clamp( sum, 0.0, 1.0 );
 }
 
+// Cloud cache (CloudCache): the layer as seen from u_cloudCentre, over the upper
+// hemisphere in a hemi-octahedral map. Colour is (premultiplied rgb, alpha) and
+// depth is the distance to the first dense sample, 2000 when there is none. It
+// is re-rendered a band at a time, so each texel is a few frames old. Lookups
+// go through the y=900 mid-plane to correct the parallax of a camera that has
+// moved away from the centre.
+uniform sampler2D u_cloudColorTex;
+uniform sampler2D u_cloudDepthTex;
+uniform int  u_cloudCache;           // 1 when the cache covers this camera
+uniform vec3 u_cloudCentre;
+
+vec2 cloudsHemiOctEncode( in vec3 d )
+{
+    vec2 p = d.xz/(abs(d.x)+abs(d.y)+abs(d.z));
+    return vec2(p.x+p.y, p.x-p.y)*0.5+0.5;
+}
+
+vec3 cloudsHemiOctDecode( in vec2 uv )
+{
+    vec2 e = uv*2.0-1.0;
+    vec2 p = vec2(e.x+e.y, e.x-e.y)*0.5;
+    return normalize( vec3(p.x, 1.0-abs(p.x)-abs(p.y), p.y) );
+}
+
+// renderClouds() from the cache; same contract, including the resT update
+vec4 cachedClouds( in vec3 ro, in vec3 rd, inout float resT )
+{
+    if( rd.y<=0.0 ) return vec4(0.0);
+    vec3  pos = ro + rd*((900.0-ro.y)/rd.y);
+    vec3  dir = pos - u_cloudCentre;
+    float len = length(dir);
+    vec2  uv  = cloudsHemiOctEncode( dir/len );
+    vec4  sum = textureLod( u_cloudColorTex, uv, 0.0 );
+    // front distance from the centre, rescaled to this ray
+    float front = textureLod( u_cloudDepthTex, uv, 0.0 ).x * (length(pos-ro)/len);
+    // Clear texels hold only the sun glare, which renderClouds() adds regardless
+    if( sum.a<=0.0 ) return sum;
+    if( front>=resT ) return vec4(0.0);
+    resT = min( resT, front );
+    return sum;
+}
+
 //------------------------------------------------------------------------------------------
 // terrain
 //------------------------------------------------------------------------------------------
@@ -510,6 +602,57 @@ vec3 terrainNormal( in vec2 pos )
 #endif    
 }
 
+// Baked heightfield (TerrainCache): (height, normal.x, normal.z, steep flag) every
+// few units around the camera, toroidally wrapped. Used beyond kTerrainCacheNear,
+// where the bilinear error (the finest fbm octave, about a unit) is lost in the
+// fog. Closer in, and outside the baked window, the analytic fbm is kept.
+uniform sampler2D u_terrainTex;
+uniform int   u_terrainCache;        // 1 when u_terrainTex is baked
+uniform vec4  u_terrainWindow;       // usable world (minX, minZ, maxX, maxZ)
+uniform float u_terrainInvSize;      // 1 / (world size of one wrap)
+// Tiles are baked a few per frame, so right after a jump only some are in place
+uniform vec4  u_terrainTileGrid;     // xy window min corner, z 1 / tile size, w texel / tile size
+uniform uvec2 u_terrainTileMask;     // baked tiles, bit row * 8 + column (TerrainCache::kTiles)
+const float kTerrainCacheNear = 300.0;
+
+bool terrainTileBaked( in vec2 g )
+{
+    ivec2 t = clamp(ivec2(floor(g)),0,7);
+    int bit = t.y*8 + t.x;
+    uint word = (bit < 32) ? u_terrainTileMask.x : u_terrainTileMask.y;
+    return ((word >> uint(bit & 31)) & 1u) != 0u;
+}
+
+bool terrainCached( in vec2 p, in float t )
+{
+    if( u_terrainCache==0 || t<=kTerrainCacheNear ||
+        any(lessThan(p,u_terrainWindow.xy)) || any(greaterThan(p,u_terrainWindow.zw)) ) return false;
+    if( all(equal(u_terrainTileMask,uvec2(0xFFFFFFFFu))) ) return true;
+    // Every tile the bilinear footprint touches must be baked
+    vec2 g = (p-u_terrainTileGrid.xy)*u_terrainTileGrid.z;
+    float w = u_terrainTileGrid.w;
+    return terrainTileBaked(g-w) && terrainTileBaked(g+w) &&
+           terrainTileBaked(vec2(g.x-w,g.y+w)) && terrainTileBaked(vec2(g.x+w,g.y-w));
+}
+
+// terrainMap() for a point seen from distance 't'
+vec2 terrainMapLod( in vec2 p, in float t )
+{
+    if( terrainCached(p,t) ) return textureLod( u_terrainTex, p*u_terrainInvSize, 0.0 ).xw;
+    return terrainMap( p );
+}
+
+// terrainNormal() for a point seen from distance 't'
+vec3 terrainNormalLod( in vec2 p, in float t )
+{
+    if( terrainCached(p,t) )
+    {
+        vec2 n = textureLod( u_terrainTex, p*u_terrainInvSize, 0.0 ).yz;
+        return normalize( vec3( n.x, sqrt(max(1.0-dot(n,n),0.0)), n.y ) );
+    }
+    return terrainNormal( p );
+}
+
 float terrainShadow( in vec3 ro, in vec3 rd, in float mint )
 {
     float res = 1.0;
@@ -518,7 +661,7 @@ float terrainShadow( in vec3 ro, in vec3 rd, in float mint )
     for( int i=ZERO; i<32; i++ )
     {
         vec3  pos = ro + t*rd;
-        vec2  env = terrainMap( pos.xz );
+        vec2  env = terrainMapLod( pos.xz, t );
         float hei = pos.y - env.x;
         res = min( res, 32.0*hei/t );
         if( res<0.0001 || pos.y>kMaxHeight ) break;
@@ -528,7 +671,7 @@ float terrainShadow( in vec3 ro, in vec3 rd, in float mint )
     for( int i=ZERO; i<128; i++ )
     {
         vec3  pos = ro + t*rd;
-        vec2  env = terrainMap( pos.xz );
+        vec2  env = terrainMapLod( pos.xz, t );
         float hei = pos.y - env.x;
         res = min( res, 32.0*hei/t );
         if( res<0.0001 || pos.y>kMaxHeight  ) break;
@@ -551,12 +694,12 @@ vec2 raymarchTerrain( in vec3 ro, in vec3 rd, float tmin, float tmax )
     float ot = t;
     float odis = 0.0;
     float odis2 = 0.0;
-    for( int i=ZERO; i<400; i++ )
+    for( int i=ZERO; i<TERRAIN_STEPS; i++ )
     {
         th = 0.001*t;
 
         vec3  pos = ro + t*rd;
-        vec2  env = terrainMap( pos.xz );
+        vec2  env = terrainMapLod( pos.xz, t );
         float hei = env.x;
 
         // tree envelope
@@ -586,6 +729,33 @@ vec2 raymarchTerrain( in vec3 ro, in vec3 rd, float tmin, float tmax )
     return vec2(t,t2);
 }
 
+// Steepest rise of terrainMap per unit of horizontal distance, cliffs included
+const float kCoarseMaxSlope = 3.0;
+
+// Cone version of the envelope march in raymarchTerrain(). The cone has radius
+// t*coneSlope; it stops where the tree envelope could rise into that radius, and
+// backs off by one radius so every ray in the cone is still in open air.
+float coarseMarchEnvelope( in vec3 ro, in vec3 rd, float tmin, float tmax, float coneSlope )
+{
+    float tp = (kMaxHeight+kMaxTreeHeight-ro.y)/rd.y;
+    if( tp>0.0 ) tmax = min( tmax, tp );
+
+    float t = tmin;
+    for( int i=ZERO; i<160; i++ )
+    {
+        vec3  pos = ro + t*rd;
+        vec2  env = terrainMap( pos.xz );
+        float r   = t*coneSlope;
+        // vertical clearance left once the cone radius and the ground's rise across it are paid
+        float clear = pos.y - (env.x+kMaxTreeHeight*1.1) - r*(1.0+kCoarseMaxSlope);
+        if( clear<0.001*t ) break;
+        t += clear*0.8*(1.0-0.75*env.y);
+        if( t>tmax ) break;
+    }
+    t = min( t, tmax );
+    return max( tmin, t - t*coneSlope );
+}
+
 //------------------------------------------------------------------------------------------
 // trees
 //------------------------------------------------------------------------------------------
@@ -596,7 +766,7 @@ float treesMap( in vec3 p, in float rt, out float oHei, out float oMat, out floa
     oDis = 0.0;
     oMat = 0.0;
         
-    float base = terrainMap(p.xz).x; 
+    float base = terrainMapLod(p.xz, rt).x; 
     
     float bb = fbm_4(p.xz*0.075);
 
@@ -725,7 +895,12 @@ vec3 renderSky( in vec3 ro, in vec3 rd )
 
 void mainImage( out vec4 outColor, in vec2 fragCoord )
 {
+#ifdef TEMPORAL
+    // Reprojection needs the exact pixel centre
+    vec2 o = vec2(0.0);
+#else
     vec2 o = hash2( vec2(iFrame,1) ) - 0.5;
+#endif
     
     vec2 p = (2.0*(fragCoord+o)-iResolution.xy)/ iResolution.y;
     
@@ -755,7 +930,12 @@ void mainImage( out vec4 outColor, in vec2 fragCoord )
     {
         const float tmax = 2000.0;
         int   obj = 0;
-        vec2 t = raymarchTerrain( ro, rd, 15.0, tmax );
+#ifdef COARSE_START
+        float tStart = max( 15.0, texelFetch( u_coarseTex, ivec2(fragCoord/kCoarseTile), 0 ).x );
+#else
+        float tStart = 15.0;
+#endif
+        vec2 t = raymarchTerrain( ro, rd, tStart, tmax );
         if( t.x>0.0 )
         {
             resT = t.x;
@@ -771,7 +951,7 @@ void mainImage( out vec4 outColor, in vec2 fragCoord )
         {
             float tf = t.y;
             float tfMax = (t.x>0.0)?t.x:tmax;
-            for(int i=ZERO; i<64; i++) 
+            for(int i=ZERO; i<TREE_STEPS; i++) 
             { 
                 vec3  pos = ro + tf*rd; 
                 float dis = treesMap( pos, tf, hei, mid, displa); 
@@ -801,7 +981,7 @@ void mainImage( out vec4 outColor, in vec2 fragCoord )
             float sha2  = treesShadow( pos+vec3(0,0.02,0), kSunDir );
 #endif
 
-            vec3 tnor = terrainNormal( pos.xz );
+            vec3 tnor = terrainNormalLod( pos.xz, resT );
             vec3 nor;
             
             vec3 speC = vec3(1.0);
@@ -889,12 +1069,16 @@ void mainImage( out vec4 outColor, in vec2 fragCoord )
         }
     }
 
+    g_hitT = resT;
+
     float isCloud = 0.0;
     //----------------------------------
     // clouds
     //----------------------------------
     {
-        vec4 res = renderClouds( ro, rd, 0.0, resT, resT, fragCoord );
+        // The cache only holds the view from below the layer
+        vec4 res = (u_cloudCache!=0 && ro.y<600.0) ? cachedClouds( ro, rd, resT )
+                                                   : renderClouds( ro, rd, 0.0, resT, resT, fragCoord );
         col = col*(1.0-res.w) + res.xyz;
         isCloud = res.w;
     }
@@ -921,6 +1105,56 @@ void mainImage( out vec4 outColor, in vec2 fragCoord )
     outColor = vec4(col, 1.0);
 }
 
+#ifdef COARSE_PREPASS
+// One texel per tile: the ray through the tile centre, widened to a cone that
+// covers the tile's corners plus the half-pixel jitter
+void main() {
+    vec2 centre = (floor(gl_FragCoord.xy) + 0.5) * kCoarseTile;
+    vec2 p = (2.0*centre-iResolution.xy)/ iResolution.y;
+    mat3 ca = setCamera( u_camPos, u_camTarget, 0.0 );
+    vec3 rd = ca * normalize( vec3(p,1.5) );
+    // angular radius of the tile, in the same units as the march distance
+    float coneSlope = (0.5*kCoarseTile+0.5)*1.4143*2.0/(1.5*iResolution.y);
+    fragColor = vec4( coarseMarchEnvelope( u_camPos, rd, 15.0, 2000.0, coneSlope ), 0.0, 0.0, 1.0 );
+}
+#elif defined(TERRAIN_BAKE)
+// TerrainCache tile: one texel per fragment, world = origin + gl_FragCoord * spacing
+uniform vec2  u_bakeOrigin;
+uniform float u_bakeSpacing;
+void main() {
+    vec2 p = u_bakeOrigin + gl_FragCoord.xy*u_bakeSpacing;
+    vec2 e = terrainMap( p );
+    vec3 n = terrainMapD( p ).yzw;
+    fragColor = vec4( e.x, n.x, n.z, e.y );
+}
+#elif defined(CLOUD_BAKE)
+// CloudCache band: march the layer from the cache centre with no terrain in the way
+layout(location = 1) out float cloudDepth;
+uniform float u_cloudCacheSize;      // texels per side
+void main() {
+    vec2 uv = gl_FragCoord.xy/u_cloudCacheSize;
+    vec3 rd = cloudsHemiOctDecode( uv );
+    float resT = 2000.0;
+    fragColor  = renderClouds( u_cloudCentre, rd, 0.0, 2000.0, resT, gl_FragCoord.xy );
+    cloudDepth = resT;
+}
+#else
 void main() {
+#ifdef TEMPORAL
+    ivec2 px = sparseToPixel(ivec2(gl_FragCoord.xy), u_pattern, u_phase);
+    if (u_portalCull == 1 && portalCovers(vec2(px) + 0.5)) {
+        fragColor = vec4(0.0, 0.0, 0.0, g_hitT);
+        return;
+    }
+    vec4 color;
+    mainImage(color, vec2(px) + 0.5);
+    fragColor = vec4(color.rgb, g_hitT);
+#else
+    if (u_portalCull == 1 && portalCovers(gl_FragCoord.xy)) {
+        fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
     mainImage(fragColor, gl_FragCoord.xy);
-}
\ No newline at end of file
+#endif
+}
+#endif
\ No newline at end of file
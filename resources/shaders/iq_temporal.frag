@@ -0,0 +1,106 @@
+#version 330 core
+out vec4 fragColor;
+
+// Temporal reconstruction for the sparse rainforest render. Pixels shaded this
+// frame are copied through. The others take their hit distance from the
+// nearest shaded neighbour, reproject that point into the previous camera,
+// fetch the history there and clamp it to the neighbours' colour range. The
+// clamp rejects disocclusions and lighting changes. Off-screen or mismatched
+// history falls back to the neighbour average.
+
+uniform sampler2D u_sparseTex;    // this frame: rgb colour, a hit distance
+uniform sampler2D u_historyTex;   // last resolved frame, same layout, full res
+uniform int   u_historyValid;
+uniform int   u_pattern;
+uniform int   u_phase;
+uniform vec3  iResolution;        // render size in pixels
+
+// IQ camera model (setCamera + normalize(vec3(p, 1.5))), now and last frame
+uniform vec3 u_camPos;
+uniform vec3 u_camTarget;
+uniform vec3 u_prevCamPos;
+uniform vec3 u_prevCamTarget;
+
+#include "temporal_pattern.glsl"
+
+mat3 cameraBasis(vec3 ro, vec3 ta) {
+    vec3 cw = normalize(ta - ro);
+    vec3 cu = normalize(cross(cw, vec3(0.0, 1.0, 0.0)));
+    vec3 cv = normalize(cross(cu, cw));
+    return mat3(cu, cv, cw);
+}
+
+vec4 fetchSparse(ivec2 px) {
+    ivec2 maxPx = ivec2(iResolution.xy) - 1;
+    ivec2 t = pixelToSparse(clamp(px, ivec2(0), maxPx), u_pattern);
+    return texelFetch(u_sparseTex, t, 0);
+}
+
+void main() {
+    ivec2 px = ivec2(gl_FragCoord.xy);
+    if (shadedThisFrame(px, u_pattern, u_phase)) {
+        fragColor = fetchSparse(px);
+        return;
+    }
+
+    // Four shaded neighbours: the cross in a checkerboard, or the shaded pixel
+    // of this 2x2 block and of the three blocks toward this pixel when interleaved
+    ivec2 nb[4];
+    if (u_pattern == 0) {
+        nb[0] = px + ivec2(-1, 0);
+        nb[1] = px + ivec2( 1, 0);
+        nb[2] = px + ivec2( 0,-1);
+        nb[3] = px + ivec2( 0, 1);
+    } else {
+        ivec2 block = px >> 1;
+        ivec2 dir = ivec2((px.x & 1) == 1 ? 1 : -1, (px.y & 1) == 1 ? 1 : -1);
+        nb[0] = sparseToPixel(block, 1, u_phase);
+        nb[1] = sparseToPixel(block + ivec2(dir.x, 0), 1, u_phase);
+        nb[2] = sparseToPixel(block + ivec2(0, dir.y), 1, u_phase);
+        nb[3] = sparseToPixel(block + dir, 1, u_phase);
+    }
+
+    vec3 mn = vec3(1e9);
+    vec3 mx = vec3(-1e9);
+    vec3 avg = vec3(0.0);
+    float hitT = 1e9;
+    for (int i = 0; i < 4; ++i) {
+        vec4 s = fetchSparse(nb[i]);
+        mn = min(mn, s.rgb);
+        mx = max(mx, s.rgb);
+        avg += 0.25 * s.rgb;
+        hitT = min(hitT, s.a);   // nearest surface wins at silhouettes
+    }
+
+    if (u_historyValid == 0) {
+        fragColor = vec4(avg, hitT);
+        return;
+    }
+
+    // World point along this pixel's ray, then into the previous camera
+    vec2 p = (2.0 * gl_FragCoord.xy - iResolution.xy) / iResolution.y;
+    vec3 rd = cameraBasis(u_camPos, u_camTarget) * normalize(vec3(p, 1.5));
+    vec3 pos = u_camPos + rd * hitT;
+
+    vec3 local = transpose(cameraBasis(u_prevCamPos, u_prevCamTarget)) * (pos - u_prevCamPos);
+    if (local.z <= 1e-3) {
+        fragColor = vec4(avg, hitT);
+        return;
+    }
+    vec2 prevP = local.xy / local.z * 1.5;
+    vec2 prevCoord = 0.5 * (prevP * iResolution.y + iResolution.xy);
+    if (any(lessThan(prevCoord, vec2(0.5))) || any(greaterThan(prevCoord, iResolution.xy - 0.5))) {
+        fragColor = vec4(avg, hitT);
+        return;
+    }
+
+    vec4 history = texture(u_historyTex, prevCoord / vec2(textureSize(u_historyTex, 0)));
+    // The history saw a different surface there (disocclusion)
+    float expectedT = length(pos - u_prevCamPos);
+    if (abs(history.a - expectedT) > 0.1 * expectedT) {
+        fragColor = vec4(avg, hitT);
+        return;
+    }
+
+    fragColor = vec4(clamp(history.rgb, mn, mx), hitT);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 fragColor;
+
+// Dilates the tile-max velocities: each tile takes the longest vector of its 3x3 neighbourhood
+uniform sampler2D u_tileMaxTex;
+
+void main() {
+    ivec2 size = textureSize(u_tileMaxTex, 0);
+    ivec2 p = ivec2(gl_FragCoord.xy);
+
+    vec2 best = vec2(0.0);
+    float bestLen2 = 0.0;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            vec2 v = texelFetch(u_tileMaxTex, clamp(p + ivec2(dx, dy), ivec2(0), size - 1), 0).xy;
+            float len2 = dot(v, v);
+            if (len2 > bestLen2) {
+                best = v;
+                bestLen2 = len2;
+            }
+        }
+    }
+    fragColor = vec4(best, 0.0, 1.0);
+}
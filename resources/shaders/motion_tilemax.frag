@@ -0,0 +1,32 @@
+#version 330 core
+out vec4 fragColor;
+
+// Reduces the velocity buffer to one vector per u_tileSize x u_tileSize tile:
+// the longest velocity in the tile, in pixels
+uniform sampler2D u_velocityTex;   // UV units per frame
+uniform int u_tileSize;
+
+void main() {
+    ivec2 size = textureSize(u_velocityTex, 0);
+    ivec2 origin = ivec2(gl_FragCoord.xy) * u_tileSize;
+    ivec2 end = min(origin + ivec2(u_tileSize), size);
+
+    vec2 best = vec2(0.0);
+    float bestLen2 = 0.0;
+    for (int y = origin.y; y < end.y; ++y) {
+        for (int x = origin.x; x < end.x; ++x) {
+            vec2 v = texelFetch(u_velocityTex, ivec2(x, y), 0).xy * vec2(size);
+            float len2 = dot(v, v);
+            if (len2 > bestLen2) {
+                best = v;
+                bestLen2 = len2;
+            }
+        }
+    }
+
+    // Streaks never exceed one tile, so the 3x3 neighbourhood always covers them
+    float len = sqrt(bestLen2);
+    float maxLen = float(u_tileSize);
+    if (len > maxLen) best *= maxLen / len;
+    fragColor = vec4(best, 0.0, 1.0);
+}
@@ -2,54 +2,80 @@
 in vec2 v_uv;
 out vec4 fragColor;
 
+// Reconstruction-filter motion blur: gathers along the dominant velocity of the
+// neighbourhood (neighbour-max tile) and weights each tap by whether it, or this
+// pixel, actually moves across the other, with a soft depth test so foreground
+// streaks cover the background but not the other way round
 uniform sampler2D u_colorTex;
-uniform sampler2D u_velocityTex;
-uniform vec2  u_texelSize;      // 1/width, 1/height
-uniform float u_maxBlurPixels;  // clamp in pixels (e.g., 16)
-uniform int   u_numSamples;     // total taps along the line (e.g., 12)
+uniform sampler2D u_velocityTex;     // UV units per frame
+uniform sampler2D u_depthTex;
+uniform sampler2D u_neighborMaxTex;  // pixels, one texel per tile
+
+uniform float u_near;
+uniform float u_far;
+uniform int   u_tileSize;
+uniform int   u_maxSamples;          // taps for a full tile-length streak
+
+#include "depth.glsl"
+
+// 1 when 'za' is in front of 'zb', fading out over a soft extent (5% of the depth) behind it
+float softDepthCompare(float za, float zb) {
+    return clamp(1.0 - (za - zb) / max(0.05 * zb, 1e-3), 0.0, 1.0);
+}
+
+float cone(float dist, float velLen) {
+    return clamp(1.0 - dist / max(velLen, 1e-3), 0.0, 1.0);
+}
+
+float cylinder(float dist, float velLen) {
+    return 1.0 - smoothstep(0.95 * velLen, 1.05 * velLen, dist);
+}
 
 void main() {
     vec3 base = texture(u_colorTex, v_uv).rgb;
-    vec2 velUV = texture(u_velocityTex, v_uv).xy;    // velocity in UV units (0..1)
-
-    // Convert pixel to UV units
-    vec2 maxUV = u_texelSize * u_maxBlurPixels;
-
-    // Clamp velocity magnitude
-    vec2 vel = velUV;
-    float mag = length(vel);
-    float maxMag = length(maxUV);
-    if (mag > maxMag && mag > 1e-6) {
-        vel *= (maxMag / mag);
-        mag = maxMag;
-    }
+    vec2 screen = vec2(textureSize(u_colorTex, 0));
 
-    if (mag < 1e-5 || u_numSamples <= 1) {
+    // Streaks are centred on the pixel, so each side covers half the frame's motion
+    vec2 vN = 0.5 * texelFetch(u_neighborMaxTex, ivec2(gl_FragCoord.xy) / u_tileSize, 0).xy;
+    float lenN = length(vN);
+    if (lenN < 0.5) {
+        // Nothing nearby moves more than half a pixel
         fragColor = vec4(base, 1.0);
         return;
     }
 
-    // Symmetric sampling around current pixel to reduce trailing bias
-    int halfSamples = (u_numSamples - 1) / 2;
-    vec3 accum = base;
-    float wsum = 1.0;
-
-    // Step in UV per sample
-    vec2 stepUV = vel / float(max(halfSamples, 1));
-
-    // Linear falloff weights
-    for (int i = 1; i <= halfSamples; i++) {
-        float t = float(i) / float(halfSamples);
-        float w = 1.0 - t; // more weight near the center
-        vec2 duv = stepUV * float(i);
-        vec3 c1 = texture(u_colorTex, v_uv + duv).rgb;
-        vec3 c2 = texture(u_colorTex, v_uv - duv).rgb;
-        accum += (c1 + c2) * w;
-        wsum += 2.0 * w;
-    }
+    float maxLen = 0.5 * float(u_tileSize);
+    vec2 vX = 0.5 * texture(u_velocityTex, v_uv).xy * screen;
+    float lenX = min(length(vX), maxLen);
+    float zX = linearizeDepth(texture(u_depthTex, v_uv).r, u_near, u_far);
 
-    vec3 color = accum / max(wsum, 1e-6);
-    fragColor = vec4(color, 1.0);
-}
+    // Taps scale with the streak length: short streaks take few taps
+    int samples = clamp(int(ceil(float(u_maxSamples) * lenN / maxLen)), 2, u_maxSamples);
+    // Per-pixel jitter (interleaved gradient noise) trades banding for fine noise
+    float jitter = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715)))) - 0.5;
+
+    float weight = 1.0 / max(lenX, 1.0);
+    vec3 accum = base * weight;
+    float wsum = weight;
+    for (int i = 0; i < samples; ++i) {
+        // t in (-1, 1), symmetric around the pixel
+        float t = mix(-1.0, 1.0, (float(i) + jitter + 1.0) / float(samples + 1));
+        vec2 offsetPx = vN * t;
+        vec2 uvY = v_uv + offsetPx / screen;
+        float dist = abs(t) * lenN;
 
+        float zY = linearizeDepth(texture(u_depthTex, uvY).r, u_near, u_far);
+        float lenY = min(length(0.5 * texture(u_velocityTex, uvY).xy * screen), maxLen);
 
+        float f = softDepthCompare(zY, zX);  // Y in front of X
+        float b = softDepthCompare(zX, zY);  // Y behind X
+        float w = f * cone(dist, lenY)                            // Y blurs over X
+                + b * cone(dist, lenX)                            // X blurs over Y's background
+                + cylinder(dist, lenY) * cylinder(dist, lenX) * 2.0;  // both move together
+
+        accum += texture(u_colorTex, uvY).rgb * w;
+        wsum += w;
+    }
+
+    fragColor = vec4(accum / wsum, 1.0);
+}
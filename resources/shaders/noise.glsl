@@ -0,0 +1,34 @@
+// Hash-based value noise shared by the procedural planet and dune shading
+
+// Simple 4D hash -> [0,1]
+float hash41(vec4 p) {
+    float h = dot(p, vec4(127.1, 311.7, 74.7, 157.3));
+    return fract(sin(h) * 43758.5453123);
+}
+
+// Value noise -> [-1,1]
+float noise(vec3 p, int s) {
+    vec3 f = floor(p);
+    vec3 q = fract(p);
+
+    // smooth interpolation
+    q *= q * (3.0 - 2.0 * q);
+    q *= q * (3.0 - 2.0 * q);
+
+    float n000 = hash41(vec4(f + vec3(0,0,0), float(s)));
+    float n001 = hash41(vec4(f + vec3(0,0,1), float(s)));
+    float n010 = hash41(vec4(f + vec3(0,1,0), float(s)));
+    float n011 = hash41(vec4(f + vec3(0,1,1), float(s)));
+    float n100 = hash41(vec4(f + vec3(1,0,0), float(s)));
+    float n101 = hash41(vec4(f + vec3(1,0,1), float(s)));
+    float n110 = hash41(vec4(f + vec3(1,1,0), float(s)));
+    float n111 = hash41(vec4(f + vec3(1,1,1), float(s)));
+
+    float nz  = mix(mix(n000, n001, q.z),
+                    mix(n010, n011, q.z), q.y);
+    float nz2 = mix(mix(n100, n101, q.z),
+                    mix(n110, n111, q.z), q.y);
+    float n = mix(nz, nz2, q.x);
+
+    return n * 2.0 - 1.0;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+// Shown while the current mode's programs are still compiling: the clear
+// color with a slow sweep so the window visibly stays alive.
+uniform float u_time;
+in vec2 v_uv;
+out vec4 fragColor;
+
+void main() {
+    vec3 top = vec3(0.85, 0.9, 1.0);
+    vec3 bottom = vec3(0.62, 0.7, 0.86);
+    vec3 col = mix(bottom, top, v_uv.y);
+    float sweep = exp(-40.0 * pow(fract(v_uv.x - 0.35 * u_time) - 0.5, 2.0));
+    col += 0.05 * sweep;
+    fragColor = vec4(col, 1.0);
+}
@@ -6,6 +6,8 @@ out vec4 fragColor;
 uniform sampler2D u_portalTex;
 uniform float     u_alpha;
 uniform float     u_time;
+uniform vec2      u_uvScale;   // rendered part of u_portalTex
+uniform mat4      u_reproject; // this frame's far-side NDC -> the frame in u_portalTex
 
 const float PI = 3.141592653589793;
 
@@ -38,9 +40,13 @@ void main() {
         discard; // or fragColor = vec4(0.0);
     }
 
-    // Sample portal interior normally
-    vec3 portalColor = texture(u_portalTex, uvOrig).rgb;
-
+#ifdef PORTAL_MASK
+    // Stencil pass: marks where the far side is drawn in place, colour writes are off
+    if (res < 0.5) {
+        discard;
+    }
+    fragColor = vec4(0.0);
+#else
     // Edge tint (glow) around the irregular boundary
     vec3 edgeColor = vec3(0.6, 0.9, 1.5); // icy blue
     float edgeBand = smoothstep(targetVal - thk*0.6, targetVal - thk*0.1, d)
@@ -48,7 +54,21 @@ void main() {
     // fade out toward the center so only rim glows
     edgeBand *= smoothstep(r - 0.2, r + 0.05, d);
 
+#ifdef PORTAL_RIM
+    // Both scenes are already on screen: add the glow only (blended with GL_ONE, GL_ONE)
+    fragColor = vec4(edgeColor * edgeBand * u_alpha, 0.0);
+#else
+    // Follow the far camera's turn since the texture was rendered (identity when fresh)
+    vec4 prevClip = u_reproject * vec4(uvOrig * 2.0 - 1.0, 1.0, 1.0);
+    vec2 farUv = prevClip.w > 0.0 ? prevClip.xy / prevClip.w * 0.5 + 0.5 : uvOrig;
+
+    // Sample portal interior; the far side only fills the lower-left u_uvScale of the texture
+    vec2 halfTexel = 0.5 / vec2(textureSize(u_portalTex, 0));
+    vec3 portalColor = texture(u_portalTex, clamp(farUv * u_uvScale, halfTexel, u_uvScale - halfTexel)).rgb;
+
     vec3 col = portalColor + edgeColor * edgeBand;
 
     fragColor = vec4(col, res * u_alpha);
+#endif
+#endif
 }
@@ -0,0 +1,119 @@
+#version 330 core
+
+// Fused post pass. Realtime compiles one permutation per set of enabled effects:
+//   SKY       background pixels show the sky texture (planet scene)
+//   TOON      per-channel posterisation
+//   EDGES     depth Sobel + normal crease outlines
+//   FOG       exp2 distance fog from the depth buffer
+//   GRADE     contrast / saturation / warm tint
+//   VIGNETTE  radial darkening
+// Every texel is fetched once: the 3x3 depth/normal neighbourhood is loaded
+// into registers and shared by the sky test, the edges and the fog.
+
+in vec2 v_uv;
+out vec4 fragColor;
+
+uniform sampler2D u_sceneTex;
+uniform sampler2D u_depthTex;
+
+uniform float u_near;
+uniform float u_far;
+uniform vec2  u_srcScale;      // lower-left part of the scene targets holding this view
+
+#ifdef SKY
+uniform sampler2D u_skyTex;
+#endif
+#ifdef EDGES
+uniform sampler2D u_normalTex;
+#endif
+#ifdef FOG
+uniform vec3  u_fogColor;
+uniform float u_fogDensity;
+uniform vec2  u_tanHalfFov;    // (tan(fovY/2) * aspect, tan(fovY/2))
+#include "fog.glsl"
+#endif
+
+#include "depth.glsl"
+
+#ifdef EDGES
+const float kOutlineThickness = 2.0;
+#endif
+
+void main() {
+    // Scene targets are read through srcUv; v_uv stays the position on the output
+    vec2 srcUv = v_uv * u_srcScale;
+    vec3 color = texture(u_sceneTex, srcUv).rgb;
+
+#ifdef EDGES
+    // 3x3 neighbourhood, row-major from (-1, +1); index 4 is this pixel
+    vec2 texel = kOutlineThickness / vec2(textureSize(u_depthTex, 0));
+    vec2 srcMax = u_srcScale - 0.5 / vec2(textureSize(u_depthTex, 0));
+    float raw[9];
+    vec3 n[9];
+    for (int j = 0; j < 3; ++j) {
+        for (int i = 0; i < 3; ++i) {
+            vec2 uv = min(srcUv + texel * vec2(float(i - 1), float(1 - j)), srcMax);
+            raw[j * 3 + i] = texture(u_depthTex, uv).r;
+            n[j * 3 + i] = normalize(texture(u_normalTex, uv).xyz * 2.0 - 1.0);
+        }
+    }
+    float rawDepth = raw[4];
+#else
+    float rawDepth = texture(u_depthTex, srcUv).r;
+#endif
+    bool background = rawDepth >= 1.0 - 1e-5;
+
+#ifdef SKY
+    // No geometry here: sky instead of the scene colour, and no toon/edges/fog
+    if (background) color = texture(u_skyTex, vec2(v_uv.x, 1.0 - v_uv.y)).rgb;
+#endif
+
+    if (!background) {
+#ifdef TOON
+        // 6 bands per channel
+        const float levels = 6.0;
+        color = floor(color * levels) / (levels - 1.0);
+#endif
+
+#ifdef EDGES
+        float d[9];
+        for (int k = 0; k < 9; ++k) d[k] = linearizeDepth(raw[k], u_near, u_far);
+
+        // Depth Sobel
+        float gx = -d[0] - 2.0 * d[3] - d[6] + d[2] + 2.0 * d[5] + d[8];
+        float gy = -d[0] - 2.0 * d[1] - d[2] + d[6] + 2.0 * d[7] + d[8];
+        float depthEdge = smoothstep(0.05, 0.15, 0.1 * sqrt(gx * gx + gy * gy));
+
+        // Normal creases: largest 1 - cos against the centre normal
+        float maxDiff = 0.0;
+        for (int k = 0; k < 9; ++k) maxDiff = max(maxDiff, 1.0 - max(0.0, dot(n[4], n[k])));
+        float normalEdge = smoothstep(0.1, 0.3, maxDiff);
+
+        color = mix(color, vec3(0.0), clamp(depthEdge + normalEdge, 0.0, 1.0));
+#endif
+
+#ifdef FOG
+        // Distance along the view ray, as the forward pass measures it
+        vec2 ndc = v_uv * 2.0 - 1.0;
+        float z = linearizeDepth(rawDepth, u_near, u_far);
+        float dist = z * length(vec3(ndc * u_tanHalfFov, 1.0));
+        color = mix(color, u_fogColor, fogFactorExp2(dist, u_fogDensity));
+#endif
+    }
+
+#ifdef GRADE
+    // Gentle S-curve, +15% saturation, warm highlights
+    color = clamp(color, 0.0, 1.0);
+    color = mix(color, color * color * (3.0 - 2.0 * color), 0.35);
+    float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    color = mix(vec3(luma), color, 1.15);
+    color *= mix(vec3(1.0), vec3(1.06, 1.0, 0.92), luma);
+#endif
+
+#ifdef VIGNETTE
+    vec2 centered = v_uv - 0.5;
+    color *= mix(1.0, 0.55, smoothstep(0.3, 0.85, length(centered) * 1.414));
+#endif
+
+    fragColor = vec4(color, 1.0);
+}
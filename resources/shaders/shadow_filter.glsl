@@ -0,0 +1,102 @@
+// Directional shadow-map lookups (PCF, hardware-compare PCF, EVSM).
+// SHADOW_FILTER may be defined by the permutation (0=PCF, 1=hardware PCF, 2=EVSM);
+// otherwise the filter is read from u_shadowFilter at runtime.
+#include "evsm.glsl"
+
+uniform sampler2D u_shadowMap;          // raw depth, nearest (manual PCF)
+uniform sampler2DShadow u_shadowMapCmp; // same depth, hardware compare + bilinear
+uniform sampler2D u_shadowMoments;      // blurred + mipmapped EVSM moments
+uniform float u_shadowDepthRange;       // far - near of the light projection (world units)
+
+#ifndef SHADOW_FILTER
+uniform int u_shadowFilter;
+#define SHADOW_FILTER u_shadowFilter
+#endif
+
+const float EVSM_BLEED_REDUCTION = 0.2;
+
+// Simple 3x3 PCF on the raw depth map
+float shadowPCF(vec3 projCoords, float bias) {
+    vec2 texelSize = 1.0 / vec2(textureSize(u_shadowMap, 0));
+    float result = 0.0;
+    int samples = 0;
+
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+            vec2 offset = vec2(x, y) * texelSize;
+            float closestDepth = texture(u_shadowMap, projCoords.xy + offset).r;
+            // If current depth is farther than stored depth -> in shadow
+            result += (projCoords.z - bias > closestDepth) ? 0.0 : 1.0;
+            samples++;
+        }
+    }
+
+    return result / float(samples);
+}
+
+// Each compare tap is already a bilinear 2x2 PCF, so four taps offset by
+// half a texel cover the same 3x3 footprint as shadowPCF() with smooth edges.
+float shadowHardwarePCF(vec3 projCoords, float bias) {
+    vec2 texelSize = 1.0 / vec2(textureSize(u_shadowMapCmp, 0));
+    float ref = projCoords.z - bias;
+    float result = 0.0;
+    result += texture(u_shadowMapCmp, vec3(projCoords.xy + vec2(-0.5, -0.5) * texelSize, ref));
+    result += texture(u_shadowMapCmp, vec3(projCoords.xy + vec2( 0.5, -0.5) * texelSize, ref));
+    result += texture(u_shadowMapCmp, vec3(projCoords.xy + vec2(-0.5,  0.5) * texelSize, ref));
+    result += texture(u_shadowMapCmp, vec3(projCoords.xy + vec2( 0.5,  0.5) * texelSize, ref));
+    return result * 0.25;
+}
+
+float chebyshevUpperBound(vec2 moments, float mean, float minVariance) {
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+    return (mean <= moments.x) ? 1.0 : pMax;
+}
+
+// Exponential variance shadow map: one trilinear tap on the prefiltered moments
+float shadowEVSM(vec3 projCoords) {
+    float d = projCoords.z * 2.0 - 1.0;
+    vec2 warped = vec2(exp(EVSM_POS * d), -exp(-EVSM_NEG * d));
+    vec4 moments = texture(u_shadowMoments, projCoords.xy);
+
+    // Minimum variance scaled to the slope of each warp
+    vec2 depthScale = 0.0001 * vec2(EVSM_POS, EVSM_NEG) * warped;
+    vec2 minVariance = depthScale * depthScale;
+
+    float pPos = chebyshevUpperBound(moments.xy, warped.x, minVariance.x);
+    float pNeg = chebyshevUpperBound(moments.zw, warped.y, minVariance.y);
+    float p = min(pPos, pNeg);
+
+    // Light bleeding reduction
+    return clamp((p - EVSM_BLEED_REDUCTION) / (1.0 - EVSM_BLEED_REDUCTION), 0.0, 1.0);
+}
+
+float computeShadow(vec4 lightSpacePos, vec3 normal, vec3 lightDir) {
+    // Perspective divide
+    vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
+
+    // Transform from NDC [-1,1] to [0,1]
+    projCoords = projCoords * 0.5 + 0.5;
+
+    // If outside light frustum, treat as unshadowed
+    if (projCoords.x < 0.0 || projCoords.x > 1.0 ||
+        projCoords.y < 0.0 || projCoords.y > 1.0 ||
+        projCoords.z < 0.0 || projCoords.z > 1.0) {
+        return 1.0;
+    }
+
+    if (SHADOW_FILTER == 2) {
+        return shadowEVSM(projCoords);
+    }
+
+    // Bias to avoid shadow acne (angle-dependent), in world units so it
+    // holds as the fitted light frustum changes depth range
+    float worldBias = max(0.16 * (1.0 - dot(normal, lightDir)), 0.04);
+    float bias = worldBias / max(u_shadowDepthRange, 1e-3);
+
+    if (SHADOW_FILTER == 1) {
+        return shadowHardwarePCF(projCoords, bias);
+    }
+    return shadowPCF(projCoords, bias);
+}
@@ -0,0 +1,21 @@
+// Sparse shading patterns shared by iq_rainforest.frag (TEMPORAL) and iq_temporal.frag.
+// pattern 0: checkerboard, half the pixels per frame; sparse target is (w/2, h)
+// pattern 1: interleaved 2x2, a quarter per frame;   sparse target is (w/2, h/2)
+// 'phase' cycles every 2 (checkerboard) or 4 (interleaved) frames.
+
+const ivec2 kInterleaveOffsets[4] = ivec2[](ivec2(0, 0), ivec2(1, 1), ivec2(1, 0), ivec2(0, 1));
+
+// Full-res pixel shaded by sparse texel 't' this frame
+ivec2 sparseToPixel(ivec2 t, int pattern, int phase) {
+    if (pattern == 0) return ivec2(2 * t.x + ((t.y + phase) & 1), t.y);
+    return 2 * t + kInterleaveOffsets[phase & 3];
+}
+
+// Sparse texel that covers full-res pixel 'px' (whether or not it shaded it)
+ivec2 pixelToSparse(ivec2 px, int pattern) {
+    return (pattern == 0) ? ivec2(px.x >> 1, px.y) : (px >> 1);
+}
+
+bool shadedThisFrame(ivec2 px, int pattern, int phase) {
+    return sparseToPixel(pixelToSparse(px, pattern), pattern, phase) == px;
+}
@@ -32,8 +32,16 @@ precision highp float;
 #define DRAG_MULT 0.38 // changes how much waves pull on the water
 #define WATER_DEPTH 1.0 // how deep is the water
 #define CAMERA_HEIGHT 1.5 // how high the camera should be
+// Quality tier budgets; Realtime overrides them as permutation defines
+#ifndef ITERATIONS_RAYMARCH
 #define ITERATIONS_RAYMARCH 12 // waves iterations of raymarching
+#endif
+#ifndef ITERATIONS_NORMAL
 #define ITERATIONS_NORMAL 36 // waves iterations when calculating normals
+#endif
+#ifndef WATER_MARCH_STEPS
+#define WATER_MARCH_STEPS 64 // raymarch steps between the water layer bounds
+#endif
 
 #define NormalizedMouse (iMouse.xy / iResolution.xy) // normalize mouse coords
 
@@ -46,28 +54,40 @@ vec2 wavedx(vec2 position, vec2 direction, float frequency, float timeshift) {
   return vec2(wave, -dx);
 }
 
-// Calculates waves by summing octaves of various waves with various parameters
-float getwaves(vec2 position, int iterations) {
-  float wavePhaseShift = length(position) * 0.1; // this is to avoid every octave having exactly the same phase everywhere
+// getwaves() between two octaves: the drag-shifted position and the weighted sum so far
+struct WaveState {
+  vec2 position;
+  float sumOfValues;
+};
+
+// Runs octaves [first, last) of the getwaves() sum on 'state'. 'origin' is the
+// unshifted position, which the phase shift is taken from. The per-octave parameters
+// are stepped up to 'first' exactly as the full sum steps them, so resuming a baked
+// state gives the same result as summing from octave 0.
+WaveState wavesOctaves(WaveState state, vec2 origin, int first, int last) {
+  float wavePhaseShift = length(origin) * 0.1; // this is to avoid every octave having exactly the same phase everywhere
   float iter = 0.0; // this will help generating well distributed wave directions
   float frequency = 1.0; // frequency of the wave, this will change every iteration
   float timeMultiplier = 2.0; // time multiplier for the wave, this will change every iteration
   float weight = 1.0;// weight in final sum for the wave, this will change every iteration
-  float sumOfValues = 0.0; // will store final sum of values
-  float sumOfWeights = 0.0; // will store final sum of weights
-  for(int i=0; i < iterations; i++) {
+  for(int i=0; i < first; i++) {
+    weight = mix(weight, 0.0, 0.2);
+    frequency *= 1.18;
+    timeMultiplier *= 1.07;
+    iter += 1232.399963;
+  }
+  for(int i=first; i < last; i++) {
     // generate some wave direction that looks kind of random
     vec2 p = vec2(sin(iter), cos(iter));
     
     // calculate wave data
-    vec2 res = wavedx(position, p, frequency, iTime * timeMultiplier + wavePhaseShift);
+    vec2 res = wavedx(state.position, p, frequency, iTime * timeMultiplier + wavePhaseShift);
 
     // shift position around according to wave drag and derivative of the wave
-    position += p * res.y * weight * DRAG_MULT;
+    state.position += p * res.y * weight * DRAG_MULT;
 
     // add the results to sums
-    sumOfValues += res.x * weight;
-    sumOfWeights += weight;
+    state.sumOfValues += res.x * weight;
 
     // modify next octave ;
     weight = mix(weight, 0.0, 0.2);
@@ -77,17 +97,105 @@ float getwaves(vec2 position, int iterations) {
     // add some kind of random value to make next wave look random too
     iter += 1232.399963;
   }
-  // calculate and return
-  return sumOfValues / sumOfWeights;
+  return state;
+}
+
+// Sum of the octave weights of a getwaves() call with 'iterations' octaves
+float wavesWeightSum(int iterations) {
+  float weight = 1.0;
+  float sumOfWeights = 0.0;
+  for(int i=0; i < iterations; i++) {
+    sumOfWeights += weight;
+    weight = mix(weight, 0.0, 0.2);
+  }
+  return sumOfWeights;
+}
+
+// Calculates waves by summing octaves of various waves with various parameters
+float getwaves(vec2 position, int iterations) {
+  WaveState state = wavesOctaves(WaveState(position, 0.0), position, 0, iterations);
+  return state.sumOfValues / wavesWeightSum(iterations);
+}
+
+// Wave cascades (WaveCache): the wave field baked this frame into camera-centred
+// square grids of growing extent. Each cascade is band-limited to the octaves its
+// spacing resolves (u_waveCascadeOctaves, 3+ texels per wavelength): a point sample
+// of finer ones would alias. A texel holds
+//   x:   getwaves(ITERATIONS_RAYMARCH), when the cascade resolves all of them
+//   yzw: the WaveState after min(resolved, ITERATIONS_NORMAL) octaves, as
+//        (sumOfValues, position - origin)
+// Lookups use the finest cascade covering the point and sum only the octaves it
+// lacks analytically, resuming from the baked state.
+#define WAVE_CASCADES 4
+uniform sampler2DArray u_waveTex;
+uniform int  u_waveCache;                       // 1 when u_waveTex was baked this frame
+uniform vec3 u_waveCascade[WAVE_CASCADES];      // xy world origin, z 1/extent
+uniform int  u_waveCascadeOctaves[WAVE_CASCADES]; // octaves each cascade resolves
+
+// Finest cascade whose bilinear footprint holds 'p' and the normal taps around it
+// (two texels of margin, wider than the 0.01 tap offset); -1 if none
+int waveCascade(vec2 p, out vec2 uv) {
+  float margin = 2.0 / float(textureSize(u_waveTex, 0).x);
+  for(int i = 0; i < WAVE_CASCADES; i++) {
+    uv = (p - u_waveCascade[i].xy) * u_waveCascade[i].z;
+    if(all(greaterThanEqual(uv, vec2(margin))) && all(lessThanEqual(uv, vec2(1.0 - margin)))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Octaves of the WaveState baked into cascade 'c'
+int waveStateOctaves(int c) {
+  return min(u_waveCascadeOctaves[c], ITERATIONS_NORMAL);
+}
+
+// getwaves(p, iterations) resumed from cascade 'c', iterations >= its state octaves
+float wavesFromCascade(vec2 p, int c, int iterations) {
+  vec2 uv = (p - u_waveCascade[c].xy) * u_waveCascade[c].z;
+  vec3 baked = textureLod(u_waveTex, vec3(uv, float(c)), 0.0).yzw;
+  WaveState state = WaveState(p + baked.yz, baked.x);
+  state = wavesOctaves(state, p, waveStateOctaves(c), iterations);
+  return state.sumOfValues / wavesWeightSum(iterations);
+}
+
+// getwaves(p, ITERATIONS_RAYMARCH) from the cascades when possible
+float waveHeight(vec2 p) {
+  vec2 uv;
+  int c = (u_waveCache != 0) ? waveCascade(p, uv) : -1;
+  if(c < 0) return getwaves(p, ITERATIONS_RAYMARCH);
+  if(u_waveCascadeOctaves[c] >= ITERATIONS_RAYMARCH) {
+    return textureLod(u_waveTex, vec3(uv, float(c)), 0.0).x;
+  }
+  return wavesFromCascade(p, c, ITERATIONS_RAYMARCH);
+}
+
+vec3 normal(vec2 pos, float e, float depth);
+
+// normal(p, e, depth) from the cascades when possible: the same three taps, each
+// summing only the octaves above what the cascade holds
+vec3 waveNormal(vec2 p, float e, float depth) {
+  vec2 uv;
+  int c = (u_waveCache != 0) ? waveCascade(p, uv) : -1;
+  if(c < 0) return normal(p, e, depth);
+  vec2 ex = vec2(e, 0);
+  float H = wavesFromCascade(p, c, ITERATIONS_NORMAL) * depth;
+  vec3 a = vec3(p.x, H, p.y);
+  return normalize(
+    cross(
+      a - vec3(p.x - e, wavesFromCascade(p - ex.xy, c, ITERATIONS_NORMAL) * depth, p.y),
+      a - vec3(p.x, wavesFromCascade(p + ex.yx, c, ITERATIONS_NORMAL) * depth, p.y + e)
+    )
+  );
 }
 
 // Raymarches the ray from top water layer boundary to low water layer boundary
 float raymarchwater(vec3 camera, vec3 start, vec3 end, float depth) {
   vec3 pos = start;
   vec3 dir = normalize(end - start);
-  for(int i=0; i < 64; i++) {
+  for(int i=0; i < WATER_MARCH_STEPS; i++) {
     // the height is from 0 to -depth
-    float height = getwaves(pos.xz, ITERATIONS_RAYMARCH) * depth - depth;
+    float height = waveHeight(pos.xz) * depth - depth;
     // if the waves height almost nearly matches the ray height, assume its a hit and return the hit distance
     if(height + 0.01 > pos.y) {
       return distance(pos, camera);
@@ -237,7 +345,7 @@ void mainImage(out vec4 fragColor_, in vec2 fragCoord) {
   vec3 waterHitPos = origin + ray * dist;
 
   // calculate normal at the hit position
-  vec3 N = normal(waterHitPos.xz, 0.01, WATER_DEPTH);
+  vec3 N = waveNormal(waterHitPos.xz, 0.01, WATER_DEPTH);
 
   // smooth the normal with distance to avoid disturbing high frequency noise
   N = mix(N, vec3(0.0, 1.0, 0.0), 0.8 * min(1.0, sqrt(dist*0.01) * 1.1));
@@ -258,8 +366,26 @@ void mainImage(out vec4 fragColor_, in vec2 fragCoord) {
   fragColor_ = vec4(aces_tonemap(C * 2.0), 1.0);
 }
 
+#ifdef WAVE_BAKE
+// One WaveCache texel per fragment: world = origin + gl_FragCoord * spacing
+uniform vec2  u_bakeOrigin;
+uniform float u_bakeSpacing;
+uniform int   u_bakeOctaves;   // octaves this cascade resolves
+void main() {
+  vec2 p = u_bakeOrigin + gl_FragCoord.xy * u_bakeSpacing;
+  // One pass over the octaves: the marching height is read off on the way (it is
+  // only looked up when the cascade resolves all of its octaves)
+  int stateOctaves = min(u_bakeOctaves, ITERATIONS_NORMAL);
+  int heightOctaves = min(stateOctaves, ITERATIONS_RAYMARCH);
+  WaveState state = wavesOctaves(WaveState(p, 0.0), p, 0, heightOctaves);
+  float height = state.sumOfValues / wavesWeightSum(ITERATIONS_RAYMARCH);
+  state = wavesOctaves(state, p, heightOctaves, stateOctaves);
+  fragColor = vec4(height, state.sumOfValues, state.position - p);
+}
+#else
 void main() {
   mainImage(fragColor, gl_FragCoord.xy);
 }
+#endif
 
 
@@ -15,6 +15,7 @@ int main(int argc, char *argv[]) {
     QSurfaceFormat fmt;
     fmt.setVersion(4, 1);
     fmt.setProfile(QSurfaceFormat::CoreProfile);
+    fmt.setStencilBufferSize(8); // stencil-masked portal
     QSurfaceFormat::setDefaultFormat(fmt);
 
     MainWindow w;
@@ -9,6 +9,35 @@
 #include <QGroupBox>
 #include <iostream>
 
+static QString shadowFilterLabel(ShadowFilter filter) {
+    switch (filter) {
+    case ShadowFilter::PCF:         return QStringLiteral("Shadows: PCF 3x3");
+    case ShadowFilter::HardwarePCF: return QStringLiteral("Shadows: Hardware PCF");
+    case ShadowFilter::EVSM:        return QStringLiteral("Shadows: EVSM");
+    }
+    return QString();
+}
+
+static QString temporalModeLabel(TemporalMode mode) {
+    switch (mode) {
+    case TemporalMode::Off:          return QStringLiteral("Rainforest temporal: Off");
+    case TemporalMode::Checkerboard: return QStringLiteral("Rainforest temporal: Checkerboard");
+    case TemporalMode::Interleaved:  return QStringLiteral("Rainforest temporal: Interleaved");
+    }
+    return QString();
+}
+
+static QString qualityLabel() {
+    if (settings.autoQuality) return QStringLiteral("Quality: Auto");
+    switch (settings.qualityTier) {
+    case QualityTier::Low:    return QStringLiteral("Quality: Low");
+    case QualityTier::Medium: return QStringLiteral("Quality: Medium");
+    case QualityTier::High:   return QStringLiteral("Quality: High");
+    case QualityTier::Ultra:  return QStringLiteral("Quality: Ultra");
+    }
+    return QString();
+}
+
 void MainWindow::initialize() {
     realtime = new Realtime;
     aspectRatioWidget = new AspectRatioWidget(this);
@@ -239,6 +268,55 @@ void MainWindow::initialize() {
     fog->setText(QStringLiteral("Fog"));
     fog->setChecked(settings.fogEnabled);
 
+    // Colour grading / vignette (fused into the post uber pass)
+    colorGrade = new QCheckBox();
+    colorGrade->setText(QStringLiteral("Color grading"));
+    colorGrade->setChecked(settings.colorGrade);
+
+    vignette = new QCheckBox();
+    vignette->setText(QStringLiteral("Vignette"));
+    vignette->setChecked(settings.vignette);
+
+    // Deferred shading
+    deferred = new QCheckBox();
+    deferred->setText(QStringLiteral("Deferred shading"));
+    deferred->setChecked(settings.deferredShading);
+
+    // Dynamic resolution (fullscreen raymarched scenes)
+    dynamicResolution = new QCheckBox();
+    dynamicResolution->setText(QStringLiteral("Dynamic resolution"));
+    dynamicResolution->setChecked(settings.dynamicResolution);
+
+    // Rainforest coarse depth prepass
+    rainforestPrepass = new QCheckBox();
+    rainforestPrepass->setText(QStringLiteral("Rainforest depth prepass"));
+    rainforestPrepass->setChecked(settings.rainforestPrepass);
+
+    // Rainforest baked terrain
+    terrainCache = new QCheckBox();
+    terrainCache->setText(QStringLiteral("Rainforest baked terrain"));
+    terrainCache->setChecked(settings.rainforestTerrainCache);
+
+    // Rainforest cached clouds
+    cloudCache = new QCheckBox();
+    cloudCache->setText(QStringLiteral("Rainforest cached clouds"));
+    cloudCache->setChecked(settings.rainforestCloudCache);
+
+    // Water baked wave cascades
+    waveCache = new QCheckBox();
+    waveCache->setText(QStringLiteral("Water baked waves"));
+    waveCache->setChecked(settings.waterWaveCache);
+
+    // Stencil-masked portal
+    portalStencil = new QCheckBox();
+    portalStencil->setText(QStringLiteral("Stencil portal"));
+    portalStencil->setChecked(settings.portalStencil);
+
+    // Portal far side at half rate
+    portalHalfRate = new QCheckBox();
+    portalHalfRate->setText(QStringLiteral("Portal half-rate far side"));
+    portalHalfRate->setChecked(settings.portalHalfRate);
+
 	// Fullscreen Scene toggle
 	toggleScene = new QPushButton();
 	{
@@ -249,6 +327,18 @@ void MainWindow::initialize() {
 		toggleScene->setText(label);
 	}
 
+    // Shadow filter cycle
+    toggleShadowFilter = new QPushButton();
+    toggleShadowFilter->setText(shadowFilterLabel(settings.shadowFilter));
+
+    // Fullscreen shader quality cycle
+    toggleQuality = new QPushButton();
+    toggleQuality->setText(qualityLabel());
+
+    // Rainforest temporal rendering cycle
+    toggleTemporal = new QPushButton();
+    toggleTemporal->setText(temporalModeLabel(settings.rainforestTemporal));
+
     vLayout->addWidget(uploadFile);
     vLayout->addWidget(saveImage);
     vLayout->addWidget(tesselation_label);
@@ -269,7 +359,31 @@ void MainWindow::initialize() {
     vLayout2->addWidget(ec2);
     vLayout2->addWidget(ec4);
     vLayout2->addWidget(fog);
+    vLayout2->addWidget(colorGrade);
+    vLayout2->addWidget(vignette);
+    vLayout2->addWidget(deferred);
+    vLayout2->addWidget(dynamicResolution);
+    vLayout2->addWidget(rainforestPrepass);
+    vLayout2->addWidget(terrainCache);
+    vLayout2->addWidget(cloudCache);
+    vLayout2->addWidget(waveCache);
+    vLayout2->addWidget(portalStencil);
+    vLayout2->addWidget(portalHalfRate);
 	vLayout2->addWidget(toggleScene);
+    vLayout2->addWidget(toggleShadowFilter);
+    vLayout2->addWidget(toggleTemporal);
+    vLayout2->addWidget(toggleQuality);
+
+    // Texture budget
+    QLabel *textureBudget_label = new QLabel();
+    textureBudget_label->setText("Texture budget (MB):");
+    textureBudgetBox = new QSpinBox();
+    textureBudgetBox->setMinimum(16);
+    textureBudgetBox->setMaximum(8192);
+    textureBudgetBox->setSingleStep(64);
+    textureBudgetBox->setValue(settings.textureBudgetMB);
+    vLayout2->addWidget(textureBudget_label);
+    vLayout2->addWidget(textureBudgetBox);
 
     // Rainforest Intensity
     QLabel *iqIntensity_label = new QLabel();
@@ -345,8 +459,23 @@ void MainWindow::connectUIElements() {
     connectFocusRange();
     connectMaxBlurRadius();
     connect(fog, &QCheckBox::toggled, this, &MainWindow::onFogToggled);
+    connect(colorGrade, &QCheckBox::toggled, this, &MainWindow::onColorGradeToggled);
+    connect(vignette, &QCheckBox::toggled, this, &MainWindow::onVignetteToggled);
+    connect(deferred, &QCheckBox::toggled, this, &MainWindow::onDeferredToggled);
+    connect(dynamicResolution, &QCheckBox::toggled, this, &MainWindow::onDynamicResolutionToggled);
+    connect(rainforestPrepass, &QCheckBox::toggled, this, &MainWindow::onRainforestPrepassToggled);
+    connect(terrainCache, &QCheckBox::toggled, this, &MainWindow::onTerrainCacheToggled);
+    connect(cloudCache, &QCheckBox::toggled, this, &MainWindow::onCloudCacheToggled);
+    connect(waveCache, &QCheckBox::toggled, this, &MainWindow::onWaveCacheToggled);
+    connect(portalStencil, &QCheckBox::toggled, this, &MainWindow::onPortalStencilToggled);
+    connect(portalHalfRate, &QCheckBox::toggled, this, &MainWindow::onPortalHalfRateToggled);
     connectExtraCredit();
 	connect(toggleScene, &QPushButton::clicked, this, &MainWindow::onToggleScene);
+    connect(toggleShadowFilter, &QPushButton::clicked, this, &MainWindow::onToggleShadowFilter);
+    connect(toggleTemporal, &QPushButton::clicked, this, &MainWindow::onToggleTemporal);
+    connect(toggleQuality, &QPushButton::clicked, this, &MainWindow::onToggleQuality);
+    connect(textureBudgetBox, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::onValChangeTextureBudget);
     // Rainforest intensity
     connect(iqIntensitySlider, &QSlider::valueChanged, this, &MainWindow::onValChangeIQIntensitySlider);
     connect(iqIntensityBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
@@ -577,6 +706,61 @@ void MainWindow::onFogToggled(bool checked) {
     realtime->settingsChanged();
 }
 
+void MainWindow::onColorGradeToggled(bool checked) {
+    settings.colorGrade = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onVignetteToggled(bool checked) {
+    settings.vignette = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onDeferredToggled(bool checked) {
+    settings.deferredShading = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onDynamicResolutionToggled(bool checked) {
+    settings.dynamicResolution = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onRainforestPrepassToggled(bool checked) {
+    settings.rainforestPrepass = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onTerrainCacheToggled(bool checked) {
+    settings.rainforestTerrainCache = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onCloudCacheToggled(bool checked) {
+    settings.rainforestCloudCache = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onWaveCacheToggled(bool checked) {
+    settings.waterWaveCache = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onPortalStencilToggled(bool checked) {
+    settings.portalStencil = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onPortalHalfRateToggled(bool checked) {
+    settings.portalHalfRate = checked;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeTextureBudget(int newValue) {
+    settings.textureBudgetMB = newValue;
+    realtime->settingsChanged();
+}
+
 void MainWindow::onToggleScene() {
 	// Toggle between IQ and Water
 	if (settings.fullscreenScene == FullscreenScene::IQ) {
@@ -589,6 +773,42 @@ void MainWindow::onToggleScene() {
 	realtime->settingsChanged();
 }
 
+void MainWindow::onToggleShadowFilter() {
+    // Cycle PCF -> hardware PCF -> EVSM
+    switch (settings.shadowFilter) {
+    case ShadowFilter::PCF:         settings.shadowFilter = ShadowFilter::HardwarePCF; break;
+    case ShadowFilter::HardwarePCF: settings.shadowFilter = ShadowFilter::EVSM;        break;
+    case ShadowFilter::EVSM:        settings.shadowFilter = ShadowFilter::PCF;         break;
+    }
+    toggleShadowFilter->setText(shadowFilterLabel(settings.shadowFilter));
+    realtime->settingsChanged();
+}
+
+void MainWindow::onToggleTemporal() {
+    // Cycle off -> checkerboard -> interleaved
+    switch (settings.rainforestTemporal) {
+    case TemporalMode::Off:          settings.rainforestTemporal = TemporalMode::Checkerboard; break;
+    case TemporalMode::Checkerboard: settings.rainforestTemporal = TemporalMode::Interleaved;  break;
+    case TemporalMode::Interleaved:  settings.rainforestTemporal = TemporalMode::Off;          break;
+    }
+    toggleTemporal->setText(temporalModeLabel(settings.rainforestTemporal));
+    realtime->settingsChanged();
+}
+
+void MainWindow::onToggleQuality() {
+    // Cycle auto -> low -> medium -> high -> ultra
+    if (settings.autoQuality) {
+        settings.autoQuality = false;
+        settings.qualityTier = QualityTier::Low;
+    } else if (settings.qualityTier == QualityTier::Ultra) {
+        settings.autoQuality = true;
+    } else {
+        settings.qualityTier = QualityTier(int(settings.qualityTier) + 1);
+    }
+    toggleQuality->setText(qualityLabel());
+    realtime->settingsChanged();
+}
+
 void MainWindow::onValChangeIQIntensitySlider(int newValue) {
     iqIntensityBox->setValue(newValue / 100.0);
     settings.rainforestIntensity = iqIntensityBox->value();
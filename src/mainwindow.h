@@ -71,8 +71,26 @@ private:
     QCheckBox *ec4;
     // Rendering toggles
     QCheckBox *fog;
+    QCheckBox *colorGrade;
+    QCheckBox *vignette;
+    QCheckBox *deferred;
+    QCheckBox *dynamicResolution;
+    QCheckBox *rainforestPrepass;
+    QCheckBox *terrainCache;
+    QCheckBox *cloudCache;
+    QCheckBox *waveCache;
+    QCheckBox *portalStencil;
+    QCheckBox *portalHalfRate;
 	// Fullscreen scene toggle
 	QPushButton *toggleScene;
+    // Shadow filter cycle (PCF / hardware PCF / EVSM)
+    QPushButton *toggleShadowFilter;
+    // Rainforest temporal rendering cycle (off / checkerboard / interleaved)
+    QPushButton *toggleTemporal;
+    // Fullscreen shader quality cycle (auto / low / medium / high / ultra)
+    QPushButton *toggleQuality;
+    // Texture residency budget (MB)
+    QSpinBox *textureBudgetBox;
 
 private slots:
     // From old Project 6
@@ -105,6 +123,20 @@ private slots:
     void onExtraCredit4();
     // Rendering toggles:
     void onFogToggled(bool checked);
+    void onColorGradeToggled(bool checked);
+    void onVignetteToggled(bool checked);
+    void onDeferredToggled(bool checked);
+    void onDynamicResolutionToggled(bool checked);
+    void onRainforestPrepassToggled(bool checked);
+    void onTerrainCacheToggled(bool checked);
+    void onCloudCacheToggled(bool checked);
+    void onWaveCacheToggled(bool checked);
+    void onPortalStencilToggled(bool checked);
+    void onPortalHalfRateToggled(bool checked);
 	// Scene toggle:
 	void onToggleScene();
+    void onToggleShadowFilter();
+    void onToggleTemporal();
+    void onToggleQuality();
+    void onValChangeTextureBudget(int newValue);
 };
@@ -18,8 +18,82 @@
 #include <QImage>
 #include <cmath>
 #include <algorithm>
+#include <limits>
 // ================== Rendering the Scene!
 
+namespace {
+// Object-space AABB of a vertex range in the interleaved (pos3, nor3, uv2) buffer
+void vertexRangeBounds(const std::vector<float> &data, int first, int count,
+                       glm::vec3 &outMin, glm::vec3 &outMax) {
+    outMin = glm::vec3(std::numeric_limits<float>::max());
+    outMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (int v = first; v < first + count; ++v) {
+        glm::vec3 p(data[8 * v + 0], data[8 * v + 1], data[8 * v + 2]);
+        outMin = glm::min(outMin, p);
+        outMax = glm::max(outMax, p);
+    }
+    if (count <= 0) {
+        outMin = outMax = glm::vec3(0.f);
+    }
+}
+
+// Expands [outMin, outMax] by the 8 corners of an AABB transformed by M
+void transformBounds(const glm::mat4 &M, const glm::vec3 &bmin, const glm::vec3 &bmax,
+                     glm::vec3 &outMin, glm::vec3 &outMax) {
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 c((i & 1) ? bmax.x : bmin.x,
+                    (i & 2) ? bmax.y : bmin.y,
+                    (i & 4) ? bmax.z : bmin.z);
+        glm::vec3 w = glm::vec3(M * glm::vec4(c, 1.f));
+        outMin = glm::min(outMin, w);
+        outMax = glm::max(outMax, w);
+    }
+}
+
+// Iteration budgets per QualityTier for the fullscreen raymarchers. Medium is
+// the shaders' own default; Low and Medium keep LOWQUALITY (no tree shadows,
+// coarser terrain shadows).
+ShaderDefines rainforestQualityDefines(QualityTier tier, std::initializer_list<const char *> extra = {}) {
+    ShaderDefines defines;
+    switch (tier) {
+    case QualityTier::Low:    defines = {"LOWQUALITY", "TERRAIN_STEPS 200", "TREE_STEPS 32", "CLOUD_STEPS 48"}; break;
+    case QualityTier::Medium: defines = {"LOWQUALITY"}; break;
+    case QualityTier::High:   break;
+    case QualityTier::Ultra:  defines = {"TERRAIN_STEPS 600", "TREE_STEPS 96", "CLOUD_STEPS 192"}; break;
+    }
+    defines.insert(defines.end(), extra.begin(), extra.end());
+    return defines;
+}
+
+ShaderDefines waterQualityDefines(QualityTier tier, std::initializer_list<const char *> extra = {}) {
+    ShaderDefines defines;
+    switch (tier) {
+    case QualityTier::Low:    defines = {"ITERATIONS_RAYMARCH 8", "ITERATIONS_NORMAL 20", "WATER_MARCH_STEPS 40"}; break;
+    case QualityTier::Medium: break;
+    case QualityTier::High:   defines = {"ITERATIONS_RAYMARCH 16", "ITERATIONS_NORMAL 48"}; break;
+    case QualityTier::Ultra:  defines = {"ITERATIONS_RAYMARCH 24", "ITERATIONS_NORMAL 64", "WATER_MARCH_STEPS 96"}; break;
+    }
+    defines.insert(defines.end(), extra.begin(), extra.end());
+    return defines;
+}
+
+// Rotation-only view-projection of a portal's far-side camera. The far scenes sit well
+// beyond the camera's own motion per frame, so turning is what reprojection must follow.
+glm::mat4 farRotationViewProj(const Camera &cam, float aspect) {
+    return glm::perspective(cam.getFovYRadians(), aspect, 0.1f, 100.f) *
+           glm::mat4(glm::mat3(cam.getViewMatrix()));
+}
+
+// Distance fog shared by the forward pass and the post uber pass
+const glm::vec3 kFogColor(1.f, 0.5f, 1.0f); // blue-white fog color
+
+// exp2 density that reaches ~98% fog at the far plane
+float fogDensity(float nearZ, float farZ) {
+    float target = 0.02f;
+    return (farZ > nearZ) ? (std::sqrt(std::max(0.0f, -std::log(target))) / farZ) : 0.0f;
+}
+}
+
 Realtime::Realtime(QWidget *parent)
     : QOpenGLWidget(parent)
 {
@@ -56,43 +130,15 @@ void Realtime::finish() {
 
     releaseSceneFBO();
     releaseFullscreenFBO();
+    releaseDynResFBO();
+    releaseRainforestTemporal();
+    releaseRainforestCoarse();
+    m_terrainCache.release();
+    m_cloudCache.release();
+    m_waveCache.release();
+    m_dynamicResolution.release();
     releaseScreenQuad();
-    if (m_postProg) {
-        glDeleteProgram(m_postProg);
-        m_postProg = 0;
-    }
-    if (m_postProgMotion) {
-        glDeleteProgram(m_postProgMotion);
-        m_postProgMotion = 0;
-    }
-    if (m_postProgDepth) {
-        glDeleteProgram(m_postProgDepth);
-        m_postProgDepth = 0;
-    }
-    if (m_postProgIQ) {
-        glDeleteProgram(m_postProgIQ);
-        m_postProgIQ = 0;
-    }
-	if (m_postProgWater) {
-		glDeleteProgram(m_postProgWater);
-		m_postProgWater = 0;
-	}
-    if (m_postProgDirectional) {
-        glDeleteProgram(m_postProgDirectional);
-        m_postProgDirectional = 0;
-    }
-    if (m_portalProg) {
-        glDeleteProgram(m_portalProg);
-        m_portalProg = 0;
-    }
-    if (m_postProgToon) {
-        glDeleteProgram(m_postProgToon);
-        m_postProgToon = 0;
-    }
-    if (m_skyTex) {
-        glDeleteTextures(1, &m_skyTex);
-        m_skyTex = 0;
-    }
+    m_postGraph.releaseTargets();
     if (m_shadowDepthTex) {
         glDeleteTextures(1, &m_shadowDepthTex);
         m_shadowDepthTex = 0;
@@ -101,10 +147,17 @@ void Realtime::finish() {
         glDeleteFramebuffers(1, &m_shadowFBO);
         m_shadowFBO = 0;
     }
-    if (m_shadowShader) {
-        glDeleteProgram(m_shadowShader);
-        m_shadowShader = 0;
+    if (m_shadowSamplerNearest) {
+        glDeleteSamplers(1, &m_shadowSamplerNearest);
+        m_shadowSamplerNearest = 0;
     }
+    if (m_shadowSamplerCompare) {
+        glDeleteSamplers(1, &m_shadowSamplerCompare);
+        m_shadowSamplerCompare = 0;
+    }
+    releaseEVSMFBO();
+    releaseLightBuffers();
+    releaseLightVolumes();
     releasePortalQuad();
     releasePortalFBO();
 
@@ -116,13 +169,26 @@ void Realtime::finish() {
         glDeleteVertexArrays(1, &m_vao);
         m_vao = 0;
     }
-    if (m_prog) {
-        glDeleteProgram(m_prog);
-        m_prog = 0;
-    }
-
-    for (auto &kv : m_textureCache) { if (kv.second) { glDeleteTextures(1, &kv.second); } }
-    m_textureCache.clear();
+    // Every program lives in the cache; the slots only borrow them
+    m_shaderCache.clear();
+    m_dofDownsampleProg = m_dofBlurProg = m_dofCompositeProg = 0;
+    m_postProgMotion = m_motionTileMaxProg = m_motionNeighborMaxProg = m_postProgDepth = 0;
+    m_postProgIQ = m_postProgWater = m_postProgDirectional = m_dynResUpscaleProg = 0;
+    m_postProgIQTemporal = m_iqResolveProg = m_iqCoarseProg = m_terrainBakeProg = 0;
+    m_cloudBakeProg = m_waveBakeProg = 0;
+    m_iqPrepassActive = false;
+    m_portalProg = m_postProgUber = m_shadowShader = 0;
+    m_portalMaskProg = m_portalRimProg = 0;
+    m_postUberFeatures = 0;
+    m_fogInPost = false;
+    m_evsmMomentsProg = m_evsmBlurProg = 0;
+    m_deferredLightProg = m_deferredStencilProg = 0;
+    m_placeholderProg = 0;
+    ShaderLoader::setBinaryCache(nullptr);
+
+    // Owns the sky and scene textures
+    m_textureStreamer.clear();
+    m_skyTex = 0;
 
     this->doneCurrent();
 }
@@ -140,6 +206,10 @@ void Realtime::initializeGL() {
     }
     std::cout << "Initialized GL: Version " << glewGetString(GLEW_VERSION) << std::endl;
 
+    // Reuse linked programs from earlier runs when the driver allows it
+    m_programBinaryCache.init();
+    ShaderLoader::setBinaryCache(m_programBinaryCache.enabled() ? &m_programBinaryCache : nullptr);
+
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
     // Set clear color to blue-white fog color
@@ -148,79 +218,21 @@ void Realtime::initializeGL() {
     glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
 
     // Students: anything requiring OpenGL calls when the program starts should be done here
-    // Compile shaders and create VAO/VBO
-    try {
-        // Use Qt resource path provided by qt6_add_resources
-        m_prog = ShaderLoader::createShaderProgram(":/resources/shaders/default.vert",
-                                                   ":/resources/shaders/default.frag");
-        m_postProg = ShaderLoader::createShaderProgram(":/resources/shaders/post.vert",
-                                                       ":/resources/shaders/dof.frag");
-        m_postProgMotion = ShaderLoader::createShaderProgram(":/resources/shaders/post.vert",
-                                                             ":/resources/shaders/motionblur.frag");
-        m_postProgDepth = ShaderLoader::createShaderProgram(":/resources/shaders/post.vert",
-                                                            ":/resources/shaders/debug_depth.frag");
-        // Rainforest fullscreen shader (IQ)
-        m_postProgIQ = ShaderLoader::createShaderProgram(":/resources/shaders/post.vert",
-                                                         ":/resources/shaders/iq_rainforest.frag");
-		// Water fullscreen shader
-		m_postProgWater = ShaderLoader::createShaderProgram(":/resources/shaders/post.vert",
-															":/resources/shaders/water.frag");
-        // Simple directional blur for fullscreen IQ sprint
-        m_postProgDirectional = ShaderLoader::createShaderProgram(":/resources/shaders/post.vert",
-                                                                  ":/resources/shaders/directional_blur.frag");
-        // Portal compositing shader
-        m_portalProg = ShaderLoader::createShaderProgram(":/resources/shaders/portal.vert",
-                                                         ":/resources/shaders/portal.frag");
-        // Toon shader
-        m_postProgToon = ShaderLoader::createShaderProgram(
-            ":/resources/shaders/post.vert",
-            ":/resources/shaders/toon.frag"
-            );
-        // Shadow
-        m_shadowShader = ShaderLoader::createShaderProgram(
-            ":/resources/shaders/shadow.vert",
-            ":/resources/shaders/shadow.frag"
-            );
-
-    } catch (const std::exception &e) {
-        std::cerr << "Shader error: " << e.what() << std::endl;
-        if (m_prog == 0) m_prog = 0;
-        if (m_postProg == 0) m_postProg = 0;
-        if (m_postProgMotion == 0) m_postProgMotion = 0;
-        if (m_postProgDepth == 0) m_postProgDepth = 0;
-		if (m_postProgIQ == 0) m_postProgIQ = 0;
-		if (m_postProgWater == 0) m_postProgWater = 0;
-        if (m_postProgDirectional == 0) m_postProgDirectional = 0;
-        if (m_portalProg == 0) m_portalProg = 0;
-        if (m_postProgToon == 0) m_postProgToon = 0;
-    }
-    // Load sky texture for Planet/Toon mode
+    // Let the driver compile on as many threads as it likes
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    }
+    // Only the placeholder is compiled up front. Everything else is requested
+    // per frame by requestPrograms and compiles in the background.
+    m_shaderTimer.start();
+    m_placeholderProg = m_shaderCache.program(":/resources/shaders/post.vert",
+                                              ":/resources/shaders/placeholder.frag");
+    requestPrograms(computeRenderMode());
+    // Decode workers + upload buffers for every image texture
+    m_textureStreamer.init();
+    // Load sky texture for Planet/Toon mode (streamed in; white until it lands)
     //https://stock.adobe.com/images/watercolor-cosmic-cosmos-starry-background-colorful-watercolor-galaxy-universe-or-night-sky-with-stars-hand-drawn-illustration-with-blobs-spots-texture-emerald-black-watercolour-stains/199993248?isa0=1&state=%7B%22ac%22%3A%22stock.adobe.com%22%7D
-    {
-        QImage img(":/resources/images/sky1.png");
-        if (!img.isNull()) {
-            QImage rgba = img.convertToFormat(QImage::Format_RGBA8888);
-
-            glGenTextures(1, &m_skyTex);
-            glBindTexture(GL_TEXTURE_2D, m_skyTex);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
-                         rgba.width(), rgba.height(),
-                         0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.constBits());
-            glGenerateMipmap(GL_TEXTURE_2D);
-
-            glBindTexture(GL_TEXTURE_2D, 0);
-        } else {
-            std::cerr << "Failed to load sky texture!" << std::endl;
-        }
-    }
-
+    m_skyTex = m_textureStreamer.request(":/resources/images/sky1.png", GL_CLAMP_TO_EDGE);
 
     glGenVertexArrays(1, &m_vao);
     glGenBuffers(1, &m_vbo);
@@ -244,7 +256,16 @@ void Realtime::initializeGL() {
     createPortalQuad();
     createOrResizePortalFBO(fbw, fbh);
     createOrResizeFullscreenFBO(fbw, fbh);
+    createOrResizeDynResFBO(fbw, fbh);
+    createOrResizeRainforestTemporal(fbw, fbh);
+    createOrResizeRainforestCoarse(fbw, fbh);
+    m_dynamicResolution.init();
+    m_terrainCache.init();
+    m_cloudCache.init();
+    m_waveCache.init();
     makeShadowMapFBO();
+    createLightBuffers();
+    createLightVolumes();
 	// Place portal in world: at y=1.2, z=0 facing +Z (camera starts at z=5 looking -Z)
 	m_portalModel = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 1.2f, 0.f));
     // Lift camera slightly at start to avoid Water-in-portal artifacts when too low
@@ -324,6 +345,27 @@ void Realtime::makeShadowMapFBO() {
                   << std::hex << status << std::dec << std::endl;
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Raw depth reads for manual PCF
+    if (m_shadowSamplerNearest == 0) {
+        glGenSamplers(1, &m_shadowSamplerNearest);
+        glSamplerParameteri(m_shadowSamplerNearest, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glSamplerParameteri(m_shadowSamplerNearest, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glSamplerParameteri(m_shadowSamplerNearest, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glSamplerParameteri(m_shadowSamplerNearest, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glSamplerParameterfv(m_shadowSamplerNearest, GL_TEXTURE_BORDER_COLOR, borderCol);
+    }
+    // Hardware comparison: with linear filtering every tap returns a bilinear 2x2 PCF result
+    if (m_shadowSamplerCompare == 0) {
+        glGenSamplers(1, &m_shadowSamplerCompare);
+        glSamplerParameteri(m_shadowSamplerCompare, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glSamplerParameteri(m_shadowSamplerCompare, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glSamplerParameteri(m_shadowSamplerCompare, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glSamplerParameteri(m_shadowSamplerCompare, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glSamplerParameterfv(m_shadowSamplerCompare, GL_TEXTURE_BORDER_COLOR, borderCol);
+        glSamplerParameteri(m_shadowSamplerCompare, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glSamplerParameteri(m_shadowSamplerCompare, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
 }
 void Realtime::updateShadowLightSelection() {
     m_hasShadowLight = false;
@@ -345,6 +387,29 @@ void Realtime::updateShadowLightSelection() {
         m_shadowLightIndex = 0;
     }
 }
+// World-space AABB of a draw, widened to cover its vertex-shader animation
+void Realtime::drawWorldBounds(const DrawItem &d, glm::vec3 &outMin, glm::vec3 &outMax) const {
+    outMin = glm::vec3(std::numeric_limits<float>::max());
+    outMax = glm::vec3(-std::numeric_limits<float>::max());
+    transformBounds(d.model, d.boundsMin, d.boundsMax, outMin, outMax);
+
+    if (d.isMoon) {
+        // Orbit sweeps a circle around moonCenter in XZ plus a 0.1 vertical wobble
+        float r = 0.f;
+        for (int i = 0; i < 4; ++i) {
+            glm::vec2 c((i & 1) ? outMax.x : outMin.x, (i & 2) ? outMax.z : outMin.z);
+            r = std::max(r, glm::length(c - glm::vec2(d.moonCenter.x, d.moonCenter.z)));
+        }
+        outMin.x = d.moonCenter.x - r;  outMax.x = d.moonCenter.x + r;
+        outMin.z = d.moonCenter.z - r;  outMax.z = d.moonCenter.z + r;
+        outMin.y -= 0.1f;               outMax.y += 0.1f;
+    }
+    if (d.isFloatingCube) {
+        outMin.y -= std::abs(d.floatAmp);
+        outMax.y += std::abs(d.floatAmp);
+    }
+}
+
 void Realtime::updateLightViewProj() {
     if (!m_hasShadowLight ||
         m_shadowLightIndex < 0 ||
@@ -355,29 +420,109 @@ void Realtime::updateLightViewProj() {
     const SceneLightData &L = m_render.lights[m_shadowLightIndex];
 
     // Use the light direction to build a view matrix.
-    glm::vec3 lightDir = glm::normalize(glm::vec3(L.dir));
+    glm::vec3 lightDir = glm::vec3(L.dir);
     if (glm::length(lightDir) < 1e-4f) {
-        lightDir = glm::normalize(glm::vec3(0.3f, -1.0f, 0.2f));
+        lightDir = glm::vec3(0.3f, -1.0f, 0.2f);
     }
+    lightDir = glm::normalize(lightDir);
 
-    // Place light some distance "upstream" along this direction.
-    glm::vec3 target(0.f, 0.f, 0.f); // focus around origin / terrain region
-    glm::vec3 lightPos = target - lightDir * 30.0f;
-
-    glm::mat4 lightView = glm::lookAt(lightPos,
-                                      target,
-                                      glm::vec3(0.f, 1.f, 0.f));
+    // Casters: every draw, so all receivers are casters too
+    const float inf = std::numeric_limits<float>::max();
+    std::vector<glm::vec3> casterMin, casterMax;
+    casterMin.reserve(m_draws.size());
+    casterMax.reserve(m_draws.size());
+    glm::vec3 sceneMin(inf), sceneMax(-inf);
+    for (const DrawItem &d : m_draws) {
+        glm::vec3 bmin, bmax;
+        drawWorldBounds(d, bmin, bmax);
+        casterMin.push_back(bmin);
+        casterMax.push_back(bmax);
+        sceneMin = glm::min(sceneMin, bmin);
+        sceneMax = glm::max(sceneMax, bmax);
+    }
+
+    if (m_draws.empty()) {
+        // Nothing to fit: keep a fixed box around the origin
+        glm::mat4 lightView = glm::lookAt(-lightDir * 30.0f, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+        m_lightViewProj = glm::ortho(-25.f, 25.f, -25.f, 25.f, 1.f, 80.f) * lightView;
+        m_shadowDepthRange = 79.f;
+        return;
+    }
 
-    // Orthographic frustum that covers planet/terrain region
-    float orthoSize = 25.0f;
-    float nearPlane = 1.0f;
-    float farPlane  = 80.0f;
+    // Receivers: view frustum AABB clipped to the scene
+    glm::vec3 recvMin(inf), recvMax(-inf);
+    {
+        glm::mat4 invVP = glm::inverse(m_camera.getProjectionMatrix() * m_camera.getViewMatrix());
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 ndc((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f, 1.f);
+            glm::vec4 w = invVP * ndc;
+            glm::vec3 p = glm::vec3(w) / w.w;
+            recvMin = glm::min(recvMin, p);
+            recvMax = glm::max(recvMax, p);
+        }
+        recvMin = glm::max(recvMin, sceneMin);
+        recvMax = glm::min(recvMax, sceneMax);
+        if (glm::any(glm::greaterThan(recvMin, recvMax))) {
+            // Camera sees no geometry; fit the whole scene so the map stays valid
+            recvMin = sceneMin;
+            recvMax = sceneMax;
+        }
+    }
 
-    glm::mat4 lightProj = glm::ortho(-orthoSize, orthoSize,
-                                     -orthoSize, orthoSize,
-                                     nearPlane,  farPlane);
+    glm::vec3 up = (std::abs(lightDir.y) > 0.99f) ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    // Light space is anchored at the world origin rather than the receivers, so the
+    // texel grid the fit snaps to below stays put while the camera moves
+    glm::mat4 lightView = glm::lookAt(-lightDir, glm::vec3(0.f), up);
+
+    // Receiver footprint in light space
+    glm::vec3 recvLsMin(inf), recvLsMax(-inf);
+    transformBounds(lightView, recvMin, recvMax, recvLsMin, recvLsMax);
+
+    // Casters overlapping the footprint decide X/Y extent and the depth range
+    glm::vec2 xyMin(inf), xyMax(-inf);
+    float zNear = -inf; // closest to the light (light looks down -Z)
+    float zFar  = inf;
+    for (size_t i = 0; i < casterMin.size(); ++i) {
+        glm::vec3 lsMin(inf), lsMax(-inf);
+        transformBounds(lightView, casterMin[i], casterMax[i], lsMin, lsMax);
+        if (lsMax.x < recvLsMin.x || lsMin.x > recvLsMax.x ||
+            lsMax.y < recvLsMin.y || lsMin.y > recvLsMax.y) {
+            continue;
+        }
+        xyMin = glm::min(xyMin, glm::vec2(lsMin));
+        xyMax = glm::max(xyMax, glm::vec2(lsMax));
+        zNear = std::max(zNear, lsMax.z);
+        zFar  = std::min(zFar,  lsMin.z);
+    }
+    if (zFar > zNear) {
+        // No caster in view: any valid box will do
+        xyMin = glm::vec2(recvLsMin);
+        xyMax = glm::vec2(recvLsMax);
+        zNear = recvLsMax.z;
+        zFar  = recvLsMin.z;
+    }
+    xyMin = glm::max(xyMin, glm::vec2(recvLsMin));
+    xyMax = glm::min(xyMax, glm::vec2(recvLsMax));
+
+    // Square, quantized extent with a center snapped to the fixed light-space texel grid
+    // keeps shadow edges from shimmering as the camera moves or turns
+    float extent = std::max(std::max(xyMax.x - xyMin.x, xyMax.y - xyMin.y), 1e-3f);
+    extent = std::exp2(std::ceil(std::log2(extent) * 8.f) / 8.f);
+    float texel = extent / float(m_shadowRes);
+    glm::vec2 mid = glm::floor(0.5f * (xyMin + xyMax) / texel) * texel;
+    float half = 0.5f * extent + texel;
+
+    // Exact caster depth range, padded slightly so boundary casters are not clipped
+    float pad = std::max(1e-3f, 0.01f * (zNear - zFar));
+    float nearPlane = -zNear - pad;
+    float farPlane  = -zFar + pad;
+
+    glm::mat4 lightProj = glm::ortho(mid.x - half, mid.x + half,
+                                     mid.y - half, mid.y + half,
+                                     nearPlane,    farPlane);
 
     m_lightViewProj = lightProj * lightView;
+    m_shadowDepthRange = farPlane - nearPlane;
 }
 
 void Realtime::renderShadowMap() {
@@ -444,6 +589,10 @@ void Realtime::renderShadowMap() {
 
     glBindVertexArray(0);
 
+    if (settings.shadowFilter == ShadowFilter::EVSM) {
+        filterShadowMoments();
+    }
+
     // Restore state
     glUseProgram(prevProgram);
     glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
@@ -451,6 +600,365 @@ void Realtime::renderShadowMap() {
                prevViewport[2], prevViewport[3]);
 }
 
+void Realtime::makeEVSMFBO() {
+    if (m_evsmFBO == 0) {
+        glGenFramebuffers(1, &m_evsmFBO);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (m_evsmTex[i] == 0) {
+            glGenTextures(1, &m_evsmTex[i]);
+        }
+        glBindTexture(GL_TEXTURE_2D, m_evsmTex[i]);
+        // 32-bit float: the positive warp squared overflows half floats
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_evsmRes, m_evsmRes, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (i == 0) {
+            // Final moments are mipmapped so wide kernels stay a single tap
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        } else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_evsmFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_evsmTex[0], 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "EVSM FBO incomplete: 0x"
+                  << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Realtime::releaseEVSMFBO() {
+    if (m_evsmTex[0] || m_evsmTex[1]) {
+        glDeleteTextures(2, m_evsmTex);
+        m_evsmTex[0] = m_evsmTex[1] = 0;
+    }
+    if (m_evsmFBO) {
+        glDeleteFramebuffers(1, &m_evsmFBO);
+        m_evsmFBO = 0;
+    }
+}
+
+// Depth map -> EVSM moments -> horizontal blur -> vertical blur -> mip chain.
+// Caller restores framebuffer, viewport and program.
+void Realtime::filterShadowMoments() {
+    if (m_evsmMomentsProg == 0 || m_evsmBlurProg == 0 || m_screenVAO == 0) return;
+    if (m_evsmFBO == 0) {
+        makeEVSMFBO();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_evsmFBO);
+    glViewport(0, 0, m_evsmRes, m_evsmRes);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(m_screenVAO);
+    glActiveTexture(GL_TEXTURE0);
+
+    // 1. Warp + downsample depth into m_evsmTex[0]
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_evsmTex[0], 0);
+    glUseProgram(m_evsmMomentsProg);
+    glUniform1i(glGetUniformLocation(m_evsmMomentsProg, "u_depthTex"), 0);
+    glUniform1i(glGetUniformLocation(m_evsmMomentsProg, "u_downsample"),
+                std::max(1, m_shadowRes / m_evsmRes));
+    glBindTexture(GL_TEXTURE_2D, m_shadowDepthTex);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    // 2. Separable gaussian, ping-ponging back into m_evsmTex[0]
+    glUseProgram(m_evsmBlurProg);
+    glUniform1i(glGetUniformLocation(m_evsmBlurProg, "u_momentsTex"), 0);
+    GLint locDir = glGetUniformLocation(m_evsmBlurProg, "u_direction");
+    const float texel = 1.f / float(m_evsmRes);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_evsmTex[1], 0);
+    glBindTexture(GL_TEXTURE_2D, m_evsmTex[0]);
+    glUniform2f(locDir, texel, 0.f);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_evsmTex[0], 0);
+    glBindTexture(GL_TEXTURE_2D, m_evsmTex[1]);
+    glUniform2f(locDir, 0.f, texel);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    // 3. Prefilter for any kernel size
+    glBindTexture(GL_TEXTURE_2D, m_evsmTex[0]);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void Realtime::createLightBuffers() {
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &m_maxTextureBufferSize);
+
+    auto makeTBO = [](GLuint &buffer, GLuint &tex, GLenum format) {
+        if (buffer == 0) glGenBuffers(1, &buffer);
+        if (tex == 0) glGenTextures(1, &tex);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, tex);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    };
+    makeTBO(m_lightDataBuffer,    m_lightDataTex,    GL_RGBA32F);
+    makeTBO(m_clusterRangeBuffer, m_clusterRangeTex, GL_RG32UI);
+    makeTBO(m_lightIndexBuffer,   m_lightIndexTex,   GL_R32UI);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Realtime::releaseLightBuffers() {
+    GLuint textures[3] = {m_lightDataTex, m_clusterRangeTex, m_lightIndexTex};
+    GLuint buffers[3]  = {m_lightDataBuffer, m_clusterRangeBuffer, m_lightIndexBuffer};
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+    m_lightDataTex = m_clusterRangeTex = m_lightIndexTex = 0;
+    m_lightDataBuffer = m_clusterRangeBuffer = m_lightIndexBuffer = 0;
+}
+
+void Realtime::uploadLightClusters(const glm::mat4 &V) {
+    if (m_lightDataBuffer == 0) return;
+
+    m_lightClusterer.setProjection(m_camera.getFovYRadians(), m_camera.getAspectRatio(),
+                                   m_camera.getNearPlane(), m_camera.getFarPlane());
+    m_lightClusterer.build(m_render.lights, V, m_maxTextureBufferSize);
+
+    // Orphan and refill; never upload zero bytes so the buffers stay valid
+    auto upload = [](GLuint buffer, const void *data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), nullptr, GL_STREAM_DRAW);
+        if (bytes > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    };
+    const auto &texels  = m_lightClusterer.lightTexels();
+    const auto &ranges  = m_lightClusterer.clusterRanges();
+    const auto &indices = m_lightClusterer.lightIndices();
+    upload(m_lightDataBuffer,    texels.data(),  texels.size()  * sizeof(glm::vec4));
+    upload(m_clusterRangeBuffer, ranges.data(),  ranges.size()  * sizeof(uint32_t));
+    upload(m_lightIndexBuffer,   indices.data(), indices.size() * sizeof(uint32_t));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Realtime::createLightVolumes() {
+    if (m_lightVolumeVAO) return;
+
+    // Coarse unit sphere (radius 0.5) and cone; volumes are scaled up a little so
+    // the inscribed tessellation still encloses the light's range
+    auto sphereGen = ShapeFactory::create(PrimitiveType::PRIMITIVE_SPHERE);
+    sphereGen->updateParams(12, 24);
+    std::vector<float> data = sphereGen->generateShape();
+    m_lightSphereCount = static_cast<int>(data.size() / 8);
+
+    auto coneGen = ShapeFactory::create(PrimitiveType::PRIMITIVE_CONE);
+    coneGen->updateParams(1, 24);
+    std::vector<float> coneData = coneGen->generateShape();
+    m_lightConeFirst = m_lightSphereCount;
+    m_lightConeCount = static_cast<int>(coneData.size() / 8);
+    data.insert(data.end(), coneData.begin(), coneData.end());
+
+    glGenVertexArrays(1, &m_lightVolumeVAO);
+    glGenBuffers(1, &m_lightVolumeVBO);
+    glBindVertexArray(m_lightVolumeVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_lightVolumeVBO);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Realtime::releaseLightVolumes() {
+    if (m_lightVolumeVBO) { glDeleteBuffers(1, &m_lightVolumeVBO); m_lightVolumeVBO = 0; }
+    if (m_lightVolumeVAO) { glDeleteVertexArrays(1, &m_lightVolumeVAO); m_lightVolumeVAO = 0; }
+}
+
+// Adds every light on top of the ambient/fog color written by the deferred geometry pass.
+// Global lights are one fullscreen pass; bounded lights rasterize a volume twice: first
+// marking the pixels whose scene depth lies inside it in the stencil (z-fail counting,
+// so the camera may sit inside), then shading only those pixels and clearing the mark.
+void Realtime::runDeferredLighting(const glm::mat4 &V, const glm::mat4 &P) {
+    const float volumePad = 1.1f;
+
+    // Depth test the volumes against the scene while sampling the scene depth texture
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_sceneFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_deferredFBO);
+    glBlitFramebuffer(0, 0, m_fbWidth, m_fbHeight, 0, 0, m_fbWidth, m_fbHeight,
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_deferredFBO);
+    glStencilMask(0xFF);
+    const GLint stencilClear = 0;
+    glClearBufferiv(GL_STENCIL, 0, &stencilClear);
+
+    glm::mat4 VP = P * V;
+    glm::mat4 invVP = glm::inverse(VP);
+
+    // G-buffer on units 0-3, shadow maps on 4-6, light buffers on 7 and 9 as in the forward path
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_sceneDepthTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_sceneNormalTex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_sceneAlbedoTex);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_sceneSpecularTex);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightDataTex);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightIndexTex);
+
+    glUseProgram(m_deferredLightProg);
+    GLint uMVP        = glGetUniformLocation(m_deferredLightProg, "u_MVP");
+    GLint uFullscreen = glGetUniformLocation(m_deferredLightProg, "u_fullscreen");
+    GLint uLightIndex = glGetUniformLocation(m_deferredLightProg, "u_lightIndex");
+
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_gDepth"), 0);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_gNormal"), 1);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_gAlbedo"), 2);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_gSpecular"), 3);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_lightData"), 7);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_lightIndices"), 9);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_numGlobalLights"),
+                m_lightClusterer.numGlobalLights());
+    glUniformMatrix4fv(glGetUniformLocation(m_deferredLightProg, "u_invViewProj"), 1, GL_FALSE,
+                       glm::value_ptr(invVP));
+    glUniform2f(glGetUniformLocation(m_deferredLightProg, "u_screen"),
+                float(m_fbWidth), float(m_fbHeight));
+    const glm::ivec2 viewport = sceneViewport();
+    glUniform2f(glGetUniformLocation(m_deferredLightProg, "u_viewport"),
+                float(viewport.x), float(viewport.y));
+    glUniform3fv(glGetUniformLocation(m_deferredLightProg, "u_camPos"), 1,
+                 glm::value_ptr(m_camera.getPosition()));
+
+    // Shadows: same conditions and fallback as runGeometryPass
+    bool planetMode = settings.sceneFilePath.empty() &&
+                      (settings.fullscreenScene == FullscreenScene::Planet);
+    ShadowFilter filter = settings.shadowFilter;
+    if (filter == ShadowFilter::EVSM && m_evsmTex[0] == 0) filter = ShadowFilter::HardwarePCF;
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_shadowMap"), 4);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_shadowMapCmp"), 5);
+    glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_shadowMoments"), 6);
+    if (planetMode && m_hasShadowLight && m_shadowDepthTex != 0) {
+        glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_useShadows"), 1);
+        glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_shadowLightIndex"), m_shadowLightIndex);
+        glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_shadowFilter"), static_cast<int>(filter));
+        glUniform1f(glGetUniformLocation(m_deferredLightProg, "u_shadowDepthRange"), m_shadowDepthRange);
+        glUniformMatrix4fv(glGetUniformLocation(m_deferredLightProg, "u_lightViewProj"), 1, GL_FALSE,
+                           glm::value_ptr(m_lightViewProj));
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, m_shadowDepthTex);
+        glBindSampler(4, m_shadowSamplerNearest);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, m_shadowDepthTex);
+        glBindSampler(5, m_shadowSamplerCompare);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, filter == ShadowFilter::EVSM ? m_evsmTex[0] : 0);
+    } else {
+        glUniform1i(glGetUniformLocation(m_deferredLightProg, "u_useShadows"), 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+
+    // Directional / unbounded lights
+    if (m_lightClusterer.numGlobalLights() > 0) {
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glUniform1i(uFullscreen, 1);
+        glUniform1i(uLightIndex, -1);
+        glBindVertexArray(m_screenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    glUniform1i(uFullscreen, 0);
+
+    // Bounded lights
+    GLint uStencilMVP = glGetUniformLocation(m_deferredStencilProg, "u_MVP");
+    glUseProgram(m_deferredStencilProg);
+    glUniform1i(glGetUniformLocation(m_deferredStencilProg, "u_fullscreen"), 0);
+
+    glBindVertexArray(m_lightVolumeVAO);
+    glEnable(GL_STENCIL_TEST);
+    // Keep volumes that poke through the far plane closed for the stencil count
+    glEnable(GL_DEPTH_CLAMP);
+
+    const auto &texels = m_lightClusterer.lightTexels();
+    const int numLights = static_cast<int>(texels.size()) / LightClusterer::kTexelsPerLight;
+    for (int i = 0; i < numLights; ++i) {
+        const glm::vec4 &posType    = texels[size_t(i) * 4 + 0];
+        const glm::vec4 &colorRange = texels[size_t(i) * 4 + 1];
+        const glm::vec4 &dirAngle   = texels[size_t(i) * 4 + 2];
+        float range = colorRange.w;
+        if (range <= 0.f) continue;  // global (handled above) or contributes nothing
+
+        glm::vec3 pos(posType);
+        glm::mat4 model;
+        GLint first = 0, count = m_lightSphereCount;
+        bool isSpot = static_cast<int>(posType.w) == 2;
+        if (isSpot && dirAngle.w < glm::radians(60.f) && glm::length(glm::vec3(dirAngle)) > 0.f) {
+            // Cone: apex at the light, axis along the spot direction
+            glm::vec3 axis = glm::normalize(glm::vec3(dirAngle));
+            glm::vec3 y = -axis;
+            glm::vec3 helper = std::abs(y.y) < 0.99f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+            glm::vec3 x = glm::normalize(glm::cross(helper, y));
+            glm::vec3 z = glm::cross(x, y);
+            glm::mat4 basis(glm::vec4(x, 0.f), glm::vec4(y, 0.f), glm::vec4(z, 0.f), glm::vec4(pos, 1.f));
+            float width = 2.f * range * std::tan(dirAngle.w) * volumePad;
+            model = basis *
+                    glm::scale(glm::mat4(1.f), glm::vec3(width, range * volumePad, width)) *
+                    glm::translate(glm::mat4(1.f), glm::vec3(0.f, -0.5f, 0.f));
+            first = m_lightConeFirst;
+            count = m_lightConeCount;
+        } else {
+            model = glm::translate(glm::mat4(1.f), pos) *
+                    glm::scale(glm::mat4(1.f), glm::vec3(2.f * range * volumePad));
+        }
+        glm::mat4 MVP = VP * model;
+
+        // 1) Stencil: count volume faces behind the scene surface
+        glUseProgram(m_deferredStencilProg);
+        glUniformMatrix4fv(uStencilMVP, 1, GL_FALSE, glm::value_ptr(MVP));
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        glStencilOpSeparate(GL_BACK,  GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        glDrawArrays(GL_TRIANGLES, first, count);
+
+        // 2) Light: back faces only so it works from inside; reset the stencil as we go
+        glUseProgram(m_deferredLightProg);
+        glUniformMatrix4fv(uMVP, 1, GL_FALSE, glm::value_ptr(MVP));
+        glUniform1i(uLightIndex, i);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+        glDrawArrays(GL_TRIANGLES, first, count);
+    }
+
+    // Restore the state the rest of the frame expects
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+    glCullFace(GL_BACK);
+    if (settings.sceneFilePath.empty()) {
+        glDisable(GL_CULL_FACE);
+    } else {
+        glEnable(GL_CULL_FACE);
+    }
+    glBindSampler(4, 0);
+    glBindSampler(5, 0);
+    glBindVertexArray(0);
+}
 
 SceneRenderMode Realtime::computeRenderMode() const {
     // Fullscreen IQ or Water → procedural shader
@@ -488,6 +996,26 @@ void Realtime::renderFullscreenProcedural(){
         int outW = size().width() * m_devicePixelRatio;
         int outH = size().height() * m_devicePixelRatio;
 
+        // The far side is only rendered when the portal quad is on screen
+        const bool portalVisible = portalActive &&
+            updatePortalViewport(m_camera.getProjectionMatrix() * m_camera.getViewMatrix(), outW, outH);
+        // Stencil path: mark the portal pixels, shade Scene A outside them and Scene B
+        // in place inside them, so neither the portal FBO nor its texture read is used
+        const bool stencilPortal = portalVisible && settings.portalStencil &&
+                                   m_portalMaskProg != 0 && m_portalRimProg != 0 &&
+                                   framebufferHasStencil(static_cast<GLuint>(prevFBO));
+        // Texture path: at half rate every other frame reprojects the previous far side
+        const bool portalWaterDue = portalVisible && !stencilPortal &&
+            portalFarSideDue(FullscreenScene::Water,
+                             farRotationViewProj(m_cameraWater, float(outW) / float(outH)));
+
+        // Water is drawn this frame (full screen or through the portal): bake its waves once
+        if (portalActive ? (stencilPortal || portalWaterDue)
+                         : settings.fullscreenScene == FullscreenScene::Water) {
+            bakeWaterWaves();
+            glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
+        }
+
         if (!portalActive) {
             GLuint prog = 0;
             if (settings.fullscreenScene == FullscreenScene::IQ) {
@@ -514,52 +1042,10 @@ void Realtime::renderFullscreenProcedural(){
                                     m_postProgDirectional && m_fullscreenFBO && m_fullscreenColorTex;
                 if (blurActiveIQ) {
                     // 1) Render IQ to fullscreen offscreen texture
-                    glBindFramebuffer(GL_FRAMEBUFFER, m_fullscreenFBO);
-                    glViewport(0, 0, outW, outH);
-                    const float clearC[4] = {0.f, 0.f, 0.f, 1.f};
-                    glClearBufferfv(GL_COLOR, 0, clearC);
+                    const glm::ivec2 renderSize = beginScaledProcedural(m_fullscreenFBO, outW, outH);
                     glDisable(GL_DEPTH_TEST);
-                    glUseProgram(m_postProgIQ);
-                    glBindVertexArray(m_screenVAO);
-                    GLint locRes  = glGetUniformLocation(m_postProgIQ, "iResolution");
-                    GLint locTime = glGetUniformLocation(m_postProgIQ, "iTime");
-                    GLint locFrame = glGetUniformLocation(m_postProgIQ, "iFrame");
-                    if (locRes  >= 0) glUniform3f(locRes,  float(outW), float(outH), 1.0f);
-                    if (locTime >= 0) glUniform1f(locTime, m_timeSec);
-                    if (locFrame >= 0) glUniform1i(locFrame, m_frameCount);
-                    // IQ camera/light uniforms
-                    GLint locCamPos  = glGetUniformLocation(m_postProgIQ, "u_camPos");
-                    GLint locCamLook = glGetUniformLocation(m_postProgIQ, "u_camLook");
-                    GLint locCamUp   = glGetUniformLocation(m_postProgIQ, "u_camUp");
-                    GLint locFovY    = glGetUniformLocation(m_postProgIQ, "u_camFovY");
-                    GLint locCamTarget = glGetUniformLocation(m_postProgIQ, "u_camTarget");
-                    if (locCamPos >= 0 || locCamLook >= 0 || locCamUp >= 0 || locFovY >= 0 || locCamTarget >= 0) {
-                        glm::vec3 camPos  = m_camera.getPosition();
-                        glm::vec3 camLook = m_camera.getLook();
-                        glm::vec3 camUp   = m_camera.getUp();
-                        float fovY        = 2.f * std::atan(1.f / 1.5f);
-                        glm::vec3 camTarget = camPos + glm::normalize(camLook);
-                        if (locCamPos  >= 0) glUniform3f(locCamPos,  camPos.x,  camPos.y,  camPos.z);
-                        if (locCamLook >= 0) glUniform3f(locCamLook, camLook.x, camLook.y, camLook.z);
-                        if (locCamUp   >= 0) glUniform3f(locCamUp,   camUp.x,   camUp.y,   camUp.z);
-                        if (locFovY    >= 0) glUniform1f(locFovY,    fovY);
-                        if (locCamTarget >= 0) glUniform3f(locCamTarget, camTarget.x, camTarget.y, camTarget.z);
-                    }
-                    GLint locSunDir = glGetUniformLocation(m_postProgIQ, "u_sunDir");
-                    GLint locExposure = glGetUniformLocation(m_postProgIQ, "u_exposure");
-                    if (locSunDir >= 0) {
-                        const glm::vec3 sunDir(-0.624695f, 0.468521f, -0.624695f);
-                        glUniform3f(locSunDir, sunDir.x, sunDir.y, sunDir.z);
-                    }
-                    if (locExposure >= 0) {
-                        glUniform1f(locExposure, 1.0f);
-                    }
-                    // Rainforest intensity
-                    {
-                        GLint locIntensity = glGetUniformLocation(m_postProgIQ, "u_rainforestIntensity");
-                        if (locIntensity >= 0) glUniform1f(locIntensity, settings.rainforestIntensity);
-                    }
-                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                    drawRainforest(renderSize);
+                    resolveScaledProcedural(m_fullscreenFBO, outW, outH, renderSize);
 
                 // 2) Apply directional blur to screen
                     glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
@@ -587,90 +1073,76 @@ void Realtime::renderFullscreenProcedural(){
                     m_frameCount++;
                     return;
                 } else {
-                    if (prevFBO == 0) {
-                        glViewport(0, 0, outW, outH);
-                    }
+                    const glm::ivec2 renderSize = beginScaledProcedural(static_cast<GLuint>(prevFBO), outW, outH);
                     glDisable(GL_DEPTH_TEST);
-                    glUseProgram(prog);
-                    glBindVertexArray(m_screenVAO);
-                    // Common uniforms
-                    GLint locRes  = glGetUniformLocation(prog, "iResolution");
-                    GLint locTime = glGetUniformLocation(prog, "iTime");
-                    if (locRes  >= 0) glUniform3f(locRes,  float(outW), float(outH), 1.0f);
-                    if (locTime >= 0) glUniform1f(locTime, m_timeSec);
-                    // iFrame (IQ only)
-                    GLint locFrame = glGetUniformLocation(prog, "iFrame");
-                    if (locFrame >= 0) glUniform1i(locFrame, m_frameCount);
-                    // iMouse (water uses; safe if unused)
-                    GLint locMouse = glGetUniformLocation(prog, "iMouse");
-                    if (locMouse >= 0) {
-                        float mouseX = m_prev_mouse_pos.x * float(m_devicePixelRatio);
-                        float mouseY = (size().height() - m_prev_mouse_pos.y) * float(m_devicePixelRatio);
-                        float clickX = m_mouseDown ? mouseX : 0.f;
-                        float clickY = m_mouseDown ? mouseY : 0.f;
-                        glUniform4f(locMouse, mouseX, mouseY, clickX, clickY);
-                    }
-                    // Camera uniforms: apply only for IQ shader
-                    GLint locSunDir = glGetUniformLocation(prog, "u_sunDir");
-                    GLint locExposure = glGetUniformLocation(prog, "u_exposure");
                     if (prog == m_postProgIQ) {
-                        GLint locCamPos  = glGetUniformLocation(prog, "u_camPos");
-                        GLint locCamLook = glGetUniformLocation(prog, "u_camLook");
-                        GLint locCamUp   = glGetUniformLocation(prog, "u_camUp");
-                        GLint locFovY    = glGetUniformLocation(prog, "u_camFovY");
-                        GLint locCamTarget = glGetUniformLocation(prog, "u_camTarget");
-                        if (locCamPos >= 0 || locCamLook >= 0 || locCamUp >= 0 || locFovY >= 0 || locCamTarget >= 0) {
-                            glm::vec3 camPos  = m_camera.getPosition();
-                            glm::vec3 camLook = m_camera.getLook();
-                            glm::vec3 camUp   = m_camera.getUp();
-                            float fovY        = 2.f * std::atan(1.f / 1.5f);
-                            glm::vec3 camTarget = camPos + glm::normalize(camLook);
-                            if (locCamPos  >= 0) glUniform3f(locCamPos,  camPos.x,  camPos.y,  camPos.z);
-                            if (locCamLook >= 0) glUniform3f(locCamLook, camLook.x, camLook.y, camLook.z);
-                            if (locCamUp   >= 0) glUniform3f(locCamUp,   camUp.x,   camUp.y,   camUp.z);
-                            if (locFovY    >= 0) glUniform1f(locFovY,    fovY);
-                            if (locCamTarget >= 0) glUniform3f(locCamTarget, camTarget.x, camTarget.y, camTarget.z);
+                        drawRainforest(renderSize);
+                    } else {
+                        glUseProgram(prog);
+                        glBindVertexArray(m_screenVAO);
+                        setWaterWaveUniforms(prog);
+                        // Common uniforms
+                        GLint locRes  = glGetUniformLocation(prog, "iResolution");
+                        GLint locTime = glGetUniformLocation(prog, "iTime");
+                        if (locRes  >= 0) glUniform3f(locRes,  float(renderSize.x), float(renderSize.y), 1.0f);
+                        if (locTime >= 0) glUniform1f(locTime, m_timeSec);
+                        // iMouse
+                        GLint locMouse = glGetUniformLocation(prog, "iMouse");
+                        if (locMouse >= 0) {
+                            // In render-target pixels
+                            const float mouseScale = float(renderSize.x) / float(outW);
+                            float mouseX = m_prev_mouse_pos.x * float(m_devicePixelRatio) * mouseScale;
+                            float mouseY = (size().height() - m_prev_mouse_pos.y) * float(m_devicePixelRatio) * mouseScale;
+                            float clickX = m_mouseDown ? mouseX : 0.f;
+                            float clickY = m_mouseDown ? mouseY : 0.f;
+                            glUniform4f(locMouse, mouseX, mouseY, clickX, clickY);
                         }
-                        // Rainforest intensity
-                        GLint locIntensity = glGetUniformLocation(prog, "u_rainforestIntensity");
-                        if (locIntensity >= 0) glUniform1f(locIntensity, settings.rainforestIntensity);
-                    } else if (prog == m_postProgWater) {
-                        // Upload Water camera (interactive when Water is fullscreen)
-                        GLint locCamPosW  = glGetUniformLocation(prog, "u_camPos");
-                        GLint locCamLookW = glGetUniformLocation(prog, "u_camLook");
-                        GLint locCamUpW   = glGetUniformLocation(prog, "u_camUp");
-                        GLint locFovYW    = glGetUniformLocation(prog, "u_camFovY");
-                        if (locCamPosW >= 0 || locCamLookW >= 0 || locCamUpW >= 0 || locFovYW >= 0) {
-                            const glm::vec3 camPosW  = m_cameraWater.getPosition();
-                            const glm::vec3 camLookW = glm::normalize(m_cameraWater.getLook());
-                            const glm::vec3 camUpW   = glm::normalize(m_cameraWater.getUp());
-                            const float fovYW        = m_cameraWater.getFovYRadians();
-                            if (locCamPosW  >= 0) glUniform3f(locCamPosW,  camPosW.x,  camPosW.y,  camPosW.z);
-                            if (locCamLookW >= 0) glUniform3f(locCamLookW, camLookW.x, camLookW.y, camLookW.z);
-                            if (locCamUpW   >= 0) glUniform3f(locCamUpW,   camUpW.x,   camUpW.y,   camUpW.z);
-                            if (locFovYW    >= 0) glUniform1f(locFovYW,    fovYW);
+                        GLint locSunDir = glGetUniformLocation(prog, "u_sunDir");
+                        GLint locExposure = glGetUniformLocation(prog, "u_exposure");
+                        {
+                            // Upload Water camera (interactive when Water is fullscreen)
+                            GLint locCamPosW  = glGetUniformLocation(prog, "u_camPos");
+                            GLint locCamLookW = glGetUniformLocation(prog, "u_camLook");
+                            GLint locCamUpW   = glGetUniformLocation(prog, "u_camUp");
+                            GLint locFovYW    = glGetUniformLocation(prog, "u_camFovY");
+                            if (locCamPosW >= 0 || locCamLookW >= 0 || locCamUpW >= 0 || locFovYW >= 0) {
+                                const glm::vec3 camPosW  = m_cameraWater.getPosition();
+                                const glm::vec3 camLookW = glm::normalize(m_cameraWater.getLook());
+                                const glm::vec3 camUpW   = glm::normalize(m_cameraWater.getUp());
+                                const float fovYW        = m_cameraWater.getFovYRadians();
+                                if (locCamPosW  >= 0) glUniform3f(locCamPosW,  camPosW.x,  camPosW.y,  camPosW.z);
+                                if (locCamLookW >= 0) glUniform3f(locCamLookW, camLookW.x, camLookW.y, camLookW.z);
+                                if (locCamUpW   >= 0) glUniform3f(locCamUpW,   camUpW.x,   camUpW.y,   camUpW.z);
+                                if (locFovYW    >= 0) glUniform1f(locFovYW,    fovYW);
+                            }
                         }
+                        if (locSunDir >= 0) {
+                            const glm::vec3 sunDir(-0.624695f, 0.468521f, -0.624695f);
+                            glUniform3f(locSunDir, sunDir.x, sunDir.y, sunDir.z);
+                        }
+                        if (locExposure >= 0) {
+                            // Match original brightness; let shader handle grading and gamma
+                            glUniform1f(locExposure, 1.0f);
+                        }
+                        glDrawArrays(GL_TRIANGLES, 0, 6);
                     }
-                    if (locSunDir >= 0) {
-                        // Original IQ rainforest sun direction
-                        const glm::vec3 sunDir(-0.624695f, 0.468521f, -0.624695f);
-                        glUniform3f(locSunDir, sunDir.x, sunDir.y, sunDir.z);
-                    }
-                    if (locExposure >= 0) {
-                        // Match original brightness; let shader handle grading and gamma
-                        glUniform1f(locExposure, 1.0f);
-                    }
-                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                    resolveScaledProcedural(static_cast<GLuint>(prevFBO), outW, outH, renderSize);
                     // If we're in Water and portal is enabled, composite portal showing Planet
                     if (settings.fullscreenScene == FullscreenScene::Water &&
                         m_portalEnabled &&
-                        m_portalProg != 0 && m_portalVAO != 0 &&
-                        m_portalFBO != 0 && m_portalColorTex != 0) {
-                        // Render Planet into portal FBO
-                        renderPlanetIntoPortalFBO();
+                        m_portalProg != 0 && m_postProgUber != 0 && m_portalVAO != 0 &&
+                        m_portalFBO != 0 && m_portalColorTex != 0 &&
+                        updatePortalViewport(m_cameraWater.getProjectionMatrix() * m_cameraWater.getViewMatrix(),
+                                             outW, outH)) {
+                        // Render Planet into portal FBO (its shadow and geometry passes
+                        // included), unless half rate lets last frame's image stand in
+                        if (portalFarSideDue(FullscreenScene::Planet,
+                                             farRotationViewProj(m_camera, float(outW) / float(outH)))) {
+                            renderPlanetIntoPortalFBO();
+                        }
                         // Back to default framebuffer for compositing
                         glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
-                        if (prevFBO == 0) glViewport(0, 0, outW, outH);
+                        glViewport(0, 0, outW, outH);
                         // Draw portal quad in world-space using Water camera matrices
                         glEnable(GL_BLEND);
                         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -688,6 +1160,7 @@ void Realtime::renderFullscreenProcedural(){
 
                         if (locSamp >= 0) glUniform1i(locSamp, 0);
                         if (locAlpha >= 0) glUniform1f(locAlpha, 1.0f);
+                        setPortalSampling();
                         if (locM >= 0) glUniformMatrix4fv(locM, 1, GL_FALSE, glm::value_ptr(m_portalModel));
                         if (locV >= 0) glUniformMatrix4fv(locV, 1, GL_FALSE, glm::value_ptr(m_cameraWater.getViewMatrix()));
                         if (locP >= 0) glUniformMatrix4fv(locP, 1, GL_FALSE, glm::value_ptr(m_cameraWater.getProjectionMatrix()));
@@ -708,45 +1181,26 @@ void Realtime::renderFullscreenProcedural(){
                 }
             }
         } else {
-            // 1) Render Scene B (Water) into portal FBO
-            glBindFramebuffer(GL_FRAMEBUFFER, m_portalFBO);
-            glViewport(0, 0, m_portalWidth, m_portalHeight);
-            const float clearC[4] = {0.f, 0.f, 0.f, 1.f};
-            glClearBufferfv(GL_COLOR, 0, clearC);
-            glDisable(GL_DEPTH_TEST);
-            glUseProgram(m_postProgWater);
-            glBindVertexArray(m_screenVAO);
-            GLint locResB  = glGetUniformLocation(m_postProgWater, "iResolution");
-            GLint locTimeB = glGetUniformLocation(m_postProgWater, "iTime");
-            if (locResB  >= 0) glUniform3f(locResB,  float(m_portalWidth), float(m_portalHeight), 1.0f);
-            if (locTimeB >= 0) glUniform1f(locTimeB, m_timeSec);
-            GLint locMouseB = glGetUniformLocation(m_postProgWater, "iMouse");
-            if (locMouseB >= 0) {
-                float mouseX = m_prev_mouse_pos.x * float(m_devicePixelRatio);
-                float mouseY = (size().height() - m_prev_mouse_pos.y) * float(m_devicePixelRatio);
-                float clickX = m_mouseDown ? mouseX : 0.f;
-                float clickY = m_mouseDown ? mouseY : 0.f;
-                glUniform4f(locMouseB, mouseX, mouseY, clickX, clickY);
-            }
-
-			// Water camera for portal rendering (uses m_cameraWater)
-            {
-                GLint locCamPosW  = glGetUniformLocation(m_postProgWater, "u_camPos");
-                GLint locCamLookW = glGetUniformLocation(m_postProgWater, "u_camLook");
-                GLint locCamUpW   = glGetUniformLocation(m_postProgWater, "u_camUp");
-                GLint locFovYW    = glGetUniformLocation(m_postProgWater, "u_camFovY");
-                if (locCamPosW >= 0 || locCamLookW >= 0 || locCamUpW >= 0 || locFovYW >= 0) {
-                    const glm::vec3 camPosW  = m_cameraWater.getPosition();
-                    const glm::vec3 camLookW = glm::normalize(m_cameraWater.getLook());
-                    const glm::vec3 camUpW   = glm::normalize(m_cameraWater.getUp());
-                    const float fovYW        = m_cameraWater.getFovYRadians();
-                    if (locCamPosW  >= 0) glUniform3f(locCamPosW,  camPosW.x,  camPosW.y,  camPosW.z);
-                    if (locCamLookW >= 0) glUniform3f(locCamLookW, camLookW.x, camLookW.y, camLookW.z);
-                    if (locCamUpW   >= 0) glUniform3f(locCamUpW,   camUpW.x,   camUpW.y,   camUpW.z);
-                    if (locFovYW    >= 0) glUniform1f(locFovYW,    fovYW);
-                }
+            if (stencilPortal) {
+                glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
+                glViewport(0, 0, outW, outH);
+                glDisable(GL_DEPTH_TEST);
+                glStencilMask(0xFF);
+                const GLint stencilClear = 0;
+                glClearBufferiv(GL_STENCIL, 0, &stencilClear);
+                glEnable(GL_STENCIL_TEST);
+                glStencilFunc(GL_ALWAYS, 1, 0xFF);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                drawPortalQuad(m_portalMaskProg, m_camera.getViewMatrix(), m_camera.getProjectionMatrix());
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+                // Offscreen targets have no stencil, so only the writes into prevFBO are masked
+                glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+            } else if (portalWaterDue) {
+                // 1) Render Scene B (Water) into the footprint-sized part of the portal FBO
+                renderWaterIntoPortalFBO();
             }
-            glDrawArrays(GL_TRIANGLES, 0, 6);
 
             // 2) Render Scene A (IQ rainforest) then optional sprint blur to screen
             // Compute speed-based blur activation and strength
@@ -762,53 +1216,16 @@ void Realtime::renderFullscreenProcedural(){
             if ((numSamplesPB % 2) == 0) numSamplesPB += 1;
             bool blurActiveIQPortal = (blurPixelsPB > 0.0f) &&
                                       m_postProgDirectional && m_fullscreenFBO && m_fullscreenColorTex;
+            // Skip the raymarch under the portal, in every target the IQ pass renders into
+            // (sparse, history, dynamic-resolution). The sprint blur would smear the
+            // skipped pixels over the rim, so it keeps the full raymarch.
+            m_iqPortalCull = portalVisible && !blurActiveIQPortal;
             if (blurActiveIQPortal) {
                 // Render IQ to offscreen
-                glBindFramebuffer(GL_FRAMEBUFFER, m_fullscreenFBO);
-                glViewport(0, 0, outW, outH);
-                const float clearC2[4] = {0.f, 0.f, 0.f, 1.f};
-                glClearBufferfv(GL_COLOR, 0, clearC2);
+                const glm::ivec2 renderSize = beginScaledProcedural(m_fullscreenFBO, outW, outH);
                 glDisable(GL_DEPTH_TEST);
-                glUseProgram(m_postProgIQ);
-                glBindVertexArray(m_screenVAO);
-                GLint locResA  = glGetUniformLocation(m_postProgIQ, "iResolution");
-                GLint locTimeA = glGetUniformLocation(m_postProgIQ, "iTime");
-                GLint locFrameA = glGetUniformLocation(m_postProgIQ, "iFrame");
-                if (locResA  >= 0) glUniform3f(locResA,  float(outW), float(outH), 1.0f);
-                if (locTimeA >= 0) glUniform1f(locTimeA, m_timeSec);
-                if (locFrameA >= 0) glUniform1i(locFrameA, m_frameCount);
-                GLint locCamPosA  = glGetUniformLocation(m_postProgIQ, "u_camPos");
-                GLint locCamLookA = glGetUniformLocation(m_postProgIQ, "u_camLook");
-                GLint locCamUpA   = glGetUniformLocation(m_postProgIQ, "u_camUp");
-                GLint locFovYA    = glGetUniformLocation(m_postProgIQ, "u_camFovY");
-                GLint locCamTargetA = glGetUniformLocation(m_postProgIQ, "u_camTarget");
-                GLint locSunDirA  = glGetUniformLocation(m_postProgIQ, "u_sunDir");
-                GLint locExposureA = glGetUniformLocation(m_postProgIQ, "u_exposure");
-                if (locCamPosA >= 0 || locCamLookA >= 0 || locCamUpA >= 0 || locFovYA >= 0 || locCamTargetA >= 0) {
-                    glm::vec3 camPos  = m_camera.getPosition();
-                    glm::vec3 camLook = m_camera.getLook();
-                    glm::vec3 camUp   = m_camera.getUp();
-                    float fovY        = 2.f * std::atan(1.f / 1.5f);
-                    glm::vec3 camTarget = camPos + glm::normalize(camLook);
-                    if (locCamPosA  >= 0) glUniform3f(locCamPosA,  camPos.x,  camPos.y,  camPos.z);
-                    if (locCamLookA >= 0) glUniform3f(locCamLookA, camLook.x, camLook.y, camLook.z);
-                    if (locCamUpA   >= 0) glUniform3f(locCamUpA,   camUp.x,   camUp.y,   camUp.z);
-                    if (locFovYA    >= 0) glUniform1f(locFovYA,    fovY);
-                    if (locCamTargetA >= 0) glUniform3f(locCamTargetA, camTarget.x, camTarget.y, camTarget.z);
-                }
-                if (locSunDirA >= 0) {
-                    const glm::vec3 sunDir(-0.624695f, 0.468521f, -0.624695f);
-                    glUniform3f(locSunDirA, sunDir.x, sunDir.y, sunDir.z);
-                }
-                if (locExposureA >= 0) {
-                    glUniform1f(locExposureA, 1.0f);
-                }
-                // Rainforest intensity
-                {
-                    GLint locIntensityA = glGetUniformLocation(m_postProgIQ, "u_rainforestIntensity");
-                    if (locIntensityA >= 0) glUniform1f(locIntensityA, settings.rainforestIntensity);
-                }
-                glDrawArrays(GL_TRIANGLES, 0, 6);
+                drawRainforest(renderSize);
+                resolveScaledProcedural(m_fullscreenFBO, outW, outH, renderSize);
 
                 // Blur to screen
                 glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
@@ -832,55 +1249,32 @@ void Realtime::renderFullscreenProcedural(){
                 glBindTexture(GL_TEXTURE_2D, m_fullscreenColorTex);
                 glDrawArrays(GL_TRIANGLES, 0, 6);
             } else {
-                glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
-                if (prevFBO == 0) {
-                    glViewport(0, 0, outW, outH);
-                }
+                const glm::ivec2 renderSize = beginScaledProcedural(static_cast<GLuint>(prevFBO), outW, outH);
                 glDisable(GL_DEPTH_TEST);
-                glUseProgram(m_postProgIQ);
-                glBindVertexArray(m_screenVAO);
-                GLint locResA  = glGetUniformLocation(m_postProgIQ, "iResolution");
-                GLint locTimeA = glGetUniformLocation(m_postProgIQ, "iTime");
-                GLint locFrameA = glGetUniformLocation(m_postProgIQ, "iFrame");
-                if (locResA  >= 0) glUniform3f(locResA,  float(outW), float(outH), 1.0f);
-                if (locTimeA >= 0) glUniform1f(locTimeA, m_timeSec);
-                if (locFrameA >= 0) glUniform1i(locFrameA, m_frameCount);
-                GLint locCamPosA  = glGetUniformLocation(m_postProgIQ, "u_camPos");
-                GLint locCamLookA = glGetUniformLocation(m_postProgIQ, "u_camLook");
-                GLint locCamUpA   = glGetUniformLocation(m_postProgIQ, "u_camUp");
-                GLint locFovYA    = glGetUniformLocation(m_postProgIQ, "u_camFovY");
-                GLint locCamTargetA = glGetUniformLocation(m_postProgIQ, "u_camTarget");
-                GLint locSunDirA  = glGetUniformLocation(m_postProgIQ, "u_sunDir");
-                GLint locExposureA = glGetUniformLocation(m_postProgIQ, "u_exposure");
-                if (locCamPosA >= 0 || locCamLookA >= 0 || locCamUpA >= 0 || locFovYA >= 0 || locCamTargetA >= 0) {
-                    glm::vec3 camPos  = m_camera.getPosition();
-                    glm::vec3 camLook = m_camera.getLook();
-                    glm::vec3 camUp   = m_camera.getUp();
-                    float fovY        = 2.f * std::atan(1.f / 1.5f);
-                    glm::vec3 camTarget = camPos + glm::normalize(camLook);
-                    if (locCamPosA  >= 0) glUniform3f(locCamPosA,  camPos.x,  camPos.y,  camPos.z);
-                    if (locCamLookA >= 0) glUniform3f(locCamLookA, camLook.x, camLook.y, camLook.z);
-                    if (locCamUpA   >= 0) glUniform3f(locCamUpA,   camUp.x,   camUp.y,   camUp.z);
-                    if (locFovYA    >= 0) glUniform1f(locFovYA,    fovY);
-                    if (locCamTargetA >= 0) glUniform3f(locCamTargetA, camTarget.x, camTarget.y, camTarget.z);
-                }
-                if (locSunDirA >= 0) {
-                    const glm::vec3 sunDir(-0.624695f, 0.468521f, -0.624695f);
-                    glUniform3f(locSunDirA, sunDir.x, sunDir.y, sunDir.z);
-                }
-                if (locExposureA >= 0) {
-                    glUniform1f(locExposureA, 1.0f);
-                }
-                // Rainforest intensity
-                {
-                    GLint locIntensityA2 = glGetUniformLocation(m_postProgIQ, "u_rainforestIntensity");
-                    if (locIntensityA2 >= 0) glUniform1f(locIntensityA2, settings.rainforestIntensity);
-                }
-                glDrawArrays(GL_TRIANGLES, 0, 6);
+                drawRainforest(renderSize);
+                resolveScaledProcedural(static_cast<GLuint>(prevFBO), outW, outH, renderSize);
             }
+            m_iqPortalCull = false;
             m_frameCount++;
 
+            if (stencilPortal) {
+                // 3) Scene B goes last: the temporal copy-out is a blit, which the
+                // stencil test does not apply to, and may have covered the portal
+                glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
+                glViewport(0, 0, outW, outH);
+                glDisable(GL_DEPTH_TEST);
+                glStencilFunc(GL_EQUAL, 1, 0xFF);
+                drawPortalWater(glm::ivec2(outW, outH));
+                glDisable(GL_STENCIL_TEST);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                drawPortalQuad(m_portalRimProg, m_camera.getViewMatrix(), m_camera.getProjectionMatrix());
+                glDisable(GL_BLEND);
+                return;
+            }
+
             // 3) Composite portal quad
+            if (!portalVisible) return;
             glEnable(GL_BLEND);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
             glUseProgram(m_portalProg);
@@ -897,6 +1291,7 @@ void Realtime::renderFullscreenProcedural(){
 
             if (locSamp >= 0) glUniform1i(locSamp, 0);
             if (locAlpha >= 0) glUniform1f(locAlpha, 1.0f);
+            setPortalSampling();
             if (locM >= 0) glUniformMatrix4fv(locM, 1, GL_FALSE, glm::value_ptr(m_portalModel));
             if (locV >= 0) glUniformMatrix4fv(locV, 1, GL_FALSE, glm::value_ptr(m_camera.getViewMatrix()));
             if (locP >= 0) glUniformMatrix4fv(locP, 1, GL_FALSE, glm::value_ptr(m_camera.getProjectionMatrix()));
@@ -915,56 +1310,288 @@ void Realtime::renderFullscreenProcedural(){
         }
     }
 }
-void Realtime::renderPlanetScene() {
 
-    GLint prevFBO;
-    glm::mat4 V, P;
+void Realtime::bakeWaterWaves() {
+    if (!settings.waterWaveCache || m_waveBakeProg == 0) return;
+    glUseProgram(m_waveBakeProg);
+    GLint locTime = glGetUniformLocation(m_waveBakeProg, "iTime");
+    if (locTime >= 0) glUniform1f(locTime, m_timeSec);
+    const glm::vec3 eye = m_cameraWater.getPosition();
+    m_waveCache.update(glm::vec2(eye.x, eye.z), m_waveBakeProg, m_screenVAO);
+}
 
-    // Shadow setup (Planet only)
-    updateShadowLightSelection();
-    updateLightViewProj();
-    renderShadowMap();  // fills m_shadowDepthTex
+void Realtime::setWaterWaveUniforms(GLuint prog) {
+    // Cascades on unit 6
+    const bool cached = settings.waterWaveCache && m_waveBakeProg != 0 && m_waveCache.valid();
+    glUniform1i(glGetUniformLocation(prog, "u_waveCache"), cached ? 1 : 0);
+    if (!cached) return;
+    glm::vec3 cascades[WaveCache::kCascades];
+    for (int i = 0; i < WaveCache::kCascades; ++i) cascades[i] = m_waveCache.cascade(i);
+    glUniform3fv(glGetUniformLocation(prog, "u_waveCascade"), WaveCache::kCascades, glm::value_ptr(cascades[0]));
+    GLint octaves[WaveCache::kCascades];
+    for (int i = 0; i < WaveCache::kCascades; ++i) octaves[i] = m_waveCache.octaves(i);
+    glUniform1iv(glGetUniformLocation(prog, "u_waveCascadeOctaves"), WaveCache::kCascades, octaves);
+    glUniform1i(glGetUniformLocation(prog, "u_waveTex"), 6);
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_waveCache.texture());
+    glActiveTexture(GL_TEXTURE0);
+}
 
-    // 1. Geometry Pass (shared)
-    runGeometryPass(prevFBO, V, P);
+QualityTier Realtime::activeQualityTier() const {
+    return settings.autoQuality ? QualityTier(m_qualitySelector.tier()) : settings.qualityTier;
+}
 
-    // 2. Post-process: TOON ONLY
-    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
-    int outW = size().width() * m_devicePixelRatio;
-    int outH = size().height() * m_devicePixelRatio;
+glm::ivec2 Realtime::beginScaledProcedural(GLuint destFBO, int outW, int outH) {
+    const float scale = m_dynamicResolution.scale();
+    const int w = std::max(1, int(std::lround(float(outW) * scale)));
+    const int h = std::max(1, int(std::lround(float(outH) * scale)));
+    if ((w == outW && h == outH) || m_dynResFBO == 0 || m_dynResUpscaleProg == 0 ||
+        outW > m_dynResWidth || outH > m_dynResHeight) {
+        // Native: draw straight into the destination
+        glBindFramebuffer(GL_FRAMEBUFFER, destFBO);
+        glViewport(0, 0, outW, outH);
+        return glm::ivec2(outW, outH);
+    }
+    // Scaled: the lower-left w x h of the full-size target. The target is only
+    // reallocated on resize, so the controller can change the scale every few frames
+    // without allocation stalls
+    glBindFramebuffer(GL_FRAMEBUFFER, m_dynResFBO);
+    glViewport(0, 0, w, h);
+    return glm::ivec2(w, h);
+}
+
+void Realtime::resolveScaledProcedural(GLuint destFBO, int outW, int outH, const glm::ivec2 &renderSize) {
+    if (renderSize.x == outW && renderSize.y == outH) return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, destFBO);
     glViewport(0, 0, outW, outH);
     glDisable(GL_DEPTH_TEST);
-
-    glUseProgram(m_postProgToon);
+    glUseProgram(m_dynResUpscaleProg);
     glBindVertexArray(m_screenVAO);
-
-    // Texture bindings
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_sceneTex"), 0);
+    glUniform1i(glGetUniformLocation(m_dynResUpscaleProg, "u_srcTex"), 0);
+    glUniform2f(glGetUniformLocation(m_dynResUpscaleProg, "u_srcSize"), float(renderSize.x), float(renderSize.y));
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_sceneColorTex);
+    glBindTexture(GL_TEXTURE_2D, m_dynResColorTex);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
 
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_depthTex"), 1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_sceneDepthTex);
+void Realtime::setRainforestUniforms(GLuint prog, const glm::ivec2 &renderSize) {
+    GLint locRes  = glGetUniformLocation(prog, "iResolution");
+    GLint locTime = glGetUniformLocation(prog, "iTime");
+    GLint locFrame = glGetUniformLocation(prog, "iFrame");
+    if (locRes  >= 0) glUniform3f(locRes,  float(renderSize.x), float(renderSize.y), 1.0f);
+    if (locTime >= 0) glUniform1f(locTime, m_timeSec);
+    if (locFrame >= 0) glUniform1i(locFrame, m_frameCount);
+    // IQ camera/light uniforms
+    GLint locCamPos  = glGetUniformLocation(prog, "u_camPos");
+    GLint locCamLook = glGetUniformLocation(prog, "u_camLook");
+    GLint locCamUp   = glGetUniformLocation(prog, "u_camUp");
+    GLint locFovY    = glGetUniformLocation(prog, "u_camFovY");
+    GLint locCamTarget = glGetUniformLocation(prog, "u_camTarget");
+    if (locCamPos >= 0 || locCamLook >= 0 || locCamUp >= 0 || locFovY >= 0 || locCamTarget >= 0) {
+        glm::vec3 camPos  = m_camera.getPosition();
+        glm::vec3 camLook = m_camera.getLook();
+        glm::vec3 camUp   = m_camera.getUp();
+        float fovY        = 2.f * std::atan(1.f / 1.5f);
+        glm::vec3 camTarget = camPos + glm::normalize(camLook);
+        if (locCamPos  >= 0) glUniform3f(locCamPos,  camPos.x,  camPos.y,  camPos.z);
+        if (locCamLook >= 0) glUniform3f(locCamLook, camLook.x, camLook.y, camLook.z);
+        if (locCamUp   >= 0) glUniform3f(locCamUp,   camUp.x,   camUp.y,   camUp.z);
+        if (locFovY    >= 0) glUniform1f(locFovY,    fovY);
+        if (locCamTarget >= 0) glUniform3f(locCamTarget, camTarget.x, camTarget.y, camTarget.z);
+    }
+    GLint locSunDir = glGetUniformLocation(prog, "u_sunDir");
+    GLint locExposure = glGetUniformLocation(prog, "u_exposure");
+    if (locSunDir >= 0) {
+        const glm::vec3 sunDir(-0.624695f, 0.468521f, -0.624695f);
+        glUniform3f(locSunDir, sunDir.x, sunDir.y, sunDir.z);
+    }
+    if (locExposure >= 0) {
+        glUniform1f(locExposure, 1.0f);
+    }
+    // Rainforest intensity
+    GLint locIntensity = glGetUniformLocation(prog, "u_rainforestIntensity");
+    if (locIntensity >= 0) glUniform1f(locIntensity, settings.rainforestIntensity);
+    GLint locCoarse = glGetUniformLocation(prog, "u_coarseTex");
+    if (locCoarse >= 0) glUniform1i(locCoarse, 2);
+    // Pixels the portal's far side will cover, in the same camera the quad is drawn with
+    GLint locPortalCull = glGetUniformLocation(prog, "u_portalCull");
+    if (locPortalCull >= 0) {
+        glUniform1i(locPortalCull, m_iqPortalCull ? 1 : 0);
+        const glm::mat4 invMVP = glm::inverse(m_camera.getProjectionMatrix() *
+                                              m_camera.getViewMatrix() * m_portalModel);
+        glUniformMatrix4fv(glGetUniformLocation(prog, "u_portalInvMVP"), 1, GL_FALSE,
+                           glm::value_ptr(invMVP));
+    }
+    // Baked terrain on unit 3, only once a bake has landed
+    GLint locTerrainCache = glGetUniformLocation(prog, "u_terrainCache");
+    if (locTerrainCache >= 0) {
+        const bool cached = settings.rainforestTerrainCache && m_terrainBakeProg != 0 &&
+                            m_terrainCache.valid();
+        const glm::vec4 window = m_terrainCache.window();
+        glUniform1i(locTerrainCache, cached ? 1 : 0);
+        glUniform1i(glGetUniformLocation(prog, "u_terrainTex"), 3);
+        glUniform4f(glGetUniformLocation(prog, "u_terrainWindow"), window.x, window.y, window.z, window.w);
+        glUniform1f(glGetUniformLocation(prog, "u_terrainInvSize"),
+                    1.f / (TerrainCache::kTexels * TerrainCache::kSpacing));
+        const glm::vec4 grid = m_terrainCache.tileGrid();
+        const uint64_t mask = m_terrainCache.tileMask();
+        glUniform4f(glGetUniformLocation(prog, "u_terrainTileGrid"), grid.x, grid.y, grid.z, grid.w);
+        glUniform2ui(glGetUniformLocation(prog, "u_terrainTileMask"),
+                     GLuint(mask & 0xFFFFFFFFu), GLuint(mask >> 32));
+    }
+    // Cached clouds on units 4/5 while the camera is below the layer
+    GLint locCloudCache = glGetUniformLocation(prog, "u_cloudCache");
+    if (locCloudCache >= 0) {
+        const bool cached = settings.rainforestCloudCache && m_cloudBakeProg != 0 &&
+                            m_cloudCache.valid() &&
+                            m_camera.getPosition().y < CloudCache::kMaxCameraY;
+        const glm::vec3 &centre = m_cloudCache.centre();
+        glUniform1i(locCloudCache, cached ? 1 : 0);
+        glUniform1i(glGetUniformLocation(prog, "u_cloudColorTex"), 4);
+        glUniform1i(glGetUniformLocation(prog, "u_cloudDepthTex"), 5);
+        glUniform3f(glGetUniformLocation(prog, "u_cloudCentre"), centre.x, centre.y, centre.z);
+    }
+}
 
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_normalTex"), 2);
+void Realtime::drawRainforest(const glm::ivec2 &renderSize) {
+    const bool temporal = settings.rainforestTemporal != TemporalMode::Off &&
+                          m_postProgIQTemporal != 0 && m_iqResolveProg != 0 &&
+                          m_iqSparseFBO != 0 &&
+                          renderSize.x <= m_fbWidth && renderSize.y <= m_fbHeight;
+    GLint targetFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFBO);
+
+    // Bake whatever terrain tiles the camera has uncovered since last frame,
+    // and the next band of the cloud panorama
+    const glm::vec3 eye = m_camera.getPosition();
+    const bool bakeTerrain = settings.rainforestTerrainCache && m_terrainBakeProg != 0;
+    const bool bakeClouds = settings.rainforestCloudCache && m_cloudBakeProg != 0;
+    if (bakeTerrain) {
+        m_terrainCache.update(glm::vec2(eye.x, eye.z), m_terrainBakeProg, m_screenVAO);
+    }
+    if (bakeClouds) {
+        glUseProgram(m_cloudBakeProg);
+        setRainforestUniforms(m_cloudBakeProg, renderSize);
+        m_cloudCache.update(eye, m_cloudBakeProg, m_screenVAO);
+    }
+    if (bakeTerrain || bakeClouds) {
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(targetFBO));
+        glViewport(0, 0, renderSize.x, renderSize.y);
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_terrainCache.texture());
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, m_cloudCache.colorTexture());
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, m_cloudCache.depthTexture());
+
+    // 0) Coarse prepass: one conservative start distance per tile
+    const bool prepass = m_iqPrepassActive && m_iqCoarseFBO != 0 &&
+                         renderSize.x <= m_fbWidth && renderSize.y <= m_fbHeight;
+    if (prepass) {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_iqCoarseFBO);
+        glViewport(0, 0, (renderSize.x + kIqCoarseTile - 1) / kIqCoarseTile,
+                   (renderSize.y + kIqCoarseTile - 1) / kIqCoarseTile);
+        glUseProgram(m_iqCoarseProg);
+        glBindVertexArray(m_screenVAO);
+        setRainforestUniforms(m_iqCoarseProg, renderSize);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(targetFBO));
+        glViewport(0, 0, renderSize.x, renderSize.y);
+    }
+    // The IQ programs sample it on unit 2 (0 and 1 belong to the temporal resolve)
     glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, m_sceneNormalTex);
-
-    glUniform1f(glGetUniformLocation(m_postProgToon, "u_near"), settings.nearPlane);
-    glUniform1f(glGetUniformLocation(m_postProgToon, "u_far"),  settings.farPlane);
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_enablePost"), 1);
+    glBindTexture(GL_TEXTURE_2D, prepass ? m_iqCoarseTex : 0);
+    glActiveTexture(GL_TEXTURE0);
 
-    // Sky texture
-    GLint locSky = glGetUniformLocation(m_postProgToon, "u_skyTex");
-    if (locSky >= 0 && m_skyTex != 0) {
-        glUniform1i(locSky, 3);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, m_skyTex);
+    if (!temporal) {
+        glUseProgram(m_postProgIQ);
+        glBindVertexArray(m_screenVAO);
+        setRainforestUniforms(m_postProgIQ, renderSize);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        m_iqHistoryValid = false;
+        return;
     }
 
+    const int pattern = (settings.rainforestTemporal == TemporalMode::Checkerboard) ? 0 : 1;
+    const int phaseCount = (pattern == 0) ? 2 : 4;
+    m_iqPhase = (m_iqPhase + 1) % phaseCount;
+    // Scale changes move every pixel; the old history no longer lines up
+    if (renderSize != m_iqHistorySize) m_iqHistoryValid = false;
+
+    const glm::vec3 camPos = m_camera.getPosition();
+    const glm::vec3 camTarget = camPos + glm::normalize(m_camera.getLook());
+
+    // 1) Sparse shading: one sparse texel per shaded pixel
+    const int sparseW = (renderSize.x + 1) / 2;
+    const int sparseH = (pattern == 0) ? renderSize.y : (renderSize.y + 1) / 2;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_iqSparseFBO);
+    glViewport(0, 0, sparseW, sparseH);
+    glUseProgram(m_postProgIQTemporal);
+    glBindVertexArray(m_screenVAO);
+    setRainforestUniforms(m_postProgIQTemporal, renderSize);
+    glUniform1i(glGetUniformLocation(m_postProgIQTemporal, "u_pattern"), pattern);
+    glUniform1i(glGetUniformLocation(m_postProgIQTemporal, "u_phase"), m_iqPhase);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
+    // 2) Resolve into this frame's history target
+    const int writeIndex = m_iqHistoryIndex;
+    const int readIndex = 1 - writeIndex;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_iqHistoryFBO[writeIndex]);
+    glViewport(0, 0, renderSize.x, renderSize.y);
+    glUseProgram(m_iqResolveProg);
+    glUniform1i(glGetUniformLocation(m_iqResolveProg, "u_sparseTex"), 0);
+    glUniform1i(glGetUniformLocation(m_iqResolveProg, "u_historyTex"), 1);
+    glUniform1i(glGetUniformLocation(m_iqResolveProg, "u_historyValid"), m_iqHistoryValid ? 1 : 0);
+    glUniform1i(glGetUniformLocation(m_iqResolveProg, "u_pattern"), pattern);
+    glUniform1i(glGetUniformLocation(m_iqResolveProg, "u_phase"), m_iqPhase);
+    glUniform3f(glGetUniformLocation(m_iqResolveProg, "iResolution"), float(renderSize.x), float(renderSize.y), 1.0f);
+    glUniform3f(glGetUniformLocation(m_iqResolveProg, "u_camPos"), camPos.x, camPos.y, camPos.z);
+    glUniform3f(glGetUniformLocation(m_iqResolveProg, "u_camTarget"), camTarget.x, camTarget.y, camTarget.z);
+    glUniform3f(glGetUniformLocation(m_iqResolveProg, "u_prevCamPos"),
+                m_iqPrevCamPos.x, m_iqPrevCamPos.y, m_iqPrevCamPos.z);
+    glUniform3f(glGetUniformLocation(m_iqResolveProg, "u_prevCamTarget"),
+                m_iqPrevCamTarget.x, m_iqPrevCamTarget.y, m_iqPrevCamTarget.z);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_iqSparseTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_iqHistoryTex[readIndex]);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glActiveTexture(GL_TEXTURE0);
+
+    // 3) Copy out to the caller's target
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_iqHistoryFBO[writeIndex]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(targetFBO));
+    glBlitFramebuffer(0, 0, renderSize.x, renderSize.y, 0, 0, renderSize.x, renderSize.y,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(targetFBO));
+
+    m_iqHistoryIndex = readIndex;
+    m_iqHistoryValid = true;
+    m_iqHistorySize = renderSize;
+    m_iqPrevCamPos = camPos;
+    m_iqPrevCamTarget = camTarget;
+}
+
+void Realtime::renderPlanetScene() {
+
+    GLint prevFBO;
+    glm::mat4 V, P;
+
+    // Shadow setup (Planet only)
+    updateShadowLightSelection();
+    updateLightViewProj();
+    renderShadowMap();  // fills m_shadowDepthTex
+
+    // 1. Geometry Pass (shared)
+    runGeometryPass(prevFBO, V, P);
+
+    // 2. Post-process: toon uber pass, then whatever camera effects are enabled
+    int outW = size().width() * m_devicePixelRatio;
+    int outH = size().height() * m_devicePixelRatio;
+    runPostChain(static_cast<GLuint>(prevFBO), outW, outH, true);
+
     // Update previous matrices
     m_prevV = V;
     m_prevP = P;
@@ -972,6 +1599,53 @@ void Realtime::renderPlanetScene() {
 
 }
 
+void Realtime::renderWaterIntoPortalFBO() {
+    // The full-screen pass covers the whole viewport, so nothing needs clearing
+    glBindFramebuffer(GL_FRAMEBUFFER, m_portalFBO);
+    glViewport(0, 0, m_portalViewport.x, m_portalViewport.y);
+    glDisable(GL_DEPTH_TEST);
+    drawPortalWater(m_portalViewport);
+}
+
+void Realtime::drawPortalWater(const glm::ivec2 &resolution) {
+    glUseProgram(m_postProgWater);
+    glBindVertexArray(m_screenVAO);
+    setWaterWaveUniforms(m_postProgWater);
+    GLint locResB  = glGetUniformLocation(m_postProgWater, "iResolution");
+    GLint locTimeB = glGetUniformLocation(m_postProgWater, "iTime");
+    if (locResB  >= 0) glUniform3f(locResB,  float(resolution.x), float(resolution.y), 1.0f);
+    if (locTimeB >= 0) glUniform1f(locTimeB, m_timeSec);
+    GLint locMouseB = glGetUniformLocation(m_postProgWater, "iMouse");
+    if (locMouseB >= 0) {
+        // In render-target pixels, as in the full-screen Water view
+        const float mouseScale = float(resolution.x) / float(size().width() * m_devicePixelRatio);
+        float mouseX = m_prev_mouse_pos.x * float(m_devicePixelRatio) * mouseScale;
+        float mouseY = (size().height() - m_prev_mouse_pos.y) * float(m_devicePixelRatio) * mouseScale;
+        float clickX = m_mouseDown ? mouseX : 0.f;
+        float clickY = m_mouseDown ? mouseY : 0.f;
+        glUniform4f(locMouseB, mouseX, mouseY, clickX, clickY);
+    }
+
+    // Water camera for portal rendering (uses m_cameraWater)
+    {
+        GLint locCamPosW  = glGetUniformLocation(m_postProgWater, "u_camPos");
+        GLint locCamLookW = glGetUniformLocation(m_postProgWater, "u_camLook");
+        GLint locCamUpW   = glGetUniformLocation(m_postProgWater, "u_camUp");
+        GLint locFovYW    = glGetUniformLocation(m_postProgWater, "u_camFovY");
+        if (locCamPosW >= 0 || locCamLookW >= 0 || locCamUpW >= 0 || locFovYW >= 0) {
+            const glm::vec3 camPosW  = m_cameraWater.getPosition();
+            const glm::vec3 camLookW = glm::normalize(m_cameraWater.getLook());
+            const glm::vec3 camUpW   = glm::normalize(m_cameraWater.getUp());
+            const float fovYW        = m_cameraWater.getFovYRadians();
+            if (locCamPosW  >= 0) glUniform3f(locCamPosW,  camPosW.x,  camPosW.y,  camPosW.z);
+            if (locCamLookW >= 0) glUniform3f(locCamLookW, camLookW.x, camLookW.y, camLookW.z);
+            if (locCamUpW   >= 0) glUniform3f(locCamUpW,   camUpW.x,   camUpW.y,   camUpW.z);
+            if (locFovYW    >= 0) glUniform1f(locFovYW,    fovYW);
+        }
+    }
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
 void Realtime::renderPlanetIntoPortalFBO() {
     if (m_portalFBO == 0 || m_portalColorTex == 0 || m_portalWidth <= 0 || m_portalHeight <= 0) {
         return;
@@ -990,7 +1664,9 @@ void Realtime::renderPlanetIntoPortalFBO() {
     GLint prevViewport[4];
     glGetIntegerv(GL_VIEWPORT, prevViewport);
 
-    // Geometry pass renders to m_sceneFBO at m_fbWidth x m_fbHeight
+    // Geometry pass renders the footprint-sized corner of m_sceneFBO; the shadow map
+    // keeps its own fixed resolution
+    m_sceneViewport = glm::min(m_portalViewport, glm::ivec2(m_fbWidth, m_fbHeight));
     glm::mat4 V, P;
     {
         updateShadowLightSelection();
@@ -1000,40 +1676,9 @@ void Realtime::renderPlanetIntoPortalFBO() {
         runGeometryPass(ignoredPrev, V, P);
     }
 
-    // Post-process toon to the portal FBO at portal resolution
-    glBindFramebuffer(GL_FRAMEBUFFER, m_portalFBO);
-    glViewport(0, 0, m_portalWidth, m_portalHeight);
-    glDisable(GL_DEPTH_TEST);
-
-    glUseProgram(m_postProgToon);
-    glBindVertexArray(m_screenVAO);
-
-    // Bind G-buffer textures from geometry pass
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_sceneTex"), 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_sceneColorTex);
-
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_depthTex"), 1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_sceneDepthTex);
-
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_normalTex"), 2);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, m_sceneNormalTex);
-
-    glUniform1f(glGetUniformLocation(m_postProgToon, "u_near"), settings.nearPlane);
-    glUniform1f(glGetUniformLocation(m_postProgToon, "u_far"),  settings.farPlane);
-    glUniform1i(glGetUniformLocation(m_postProgToon, "u_enablePost"), 1);
-
-    // Optional sky texture
-    GLint locSky = glGetUniformLocation(m_postProgToon, "u_skyTex");
-    if (locSky >= 0 && m_skyTex != 0) {
-        glUniform1i(locSky, 3);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, m_skyTex);
-    }
-
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // Post-process toon into the footprint-sized part of the portal FBO (no camera effects through the portal)
+    runPostChain(m_portalFBO, m_portalViewport.x, m_portalViewport.y, false);
+    m_sceneViewport = glm::ivec2(0);
 
     // Update previous matrices for consistent motion if needed later
     m_prevV = V;
@@ -1045,9 +1690,91 @@ void Realtime::renderPlanetIntoPortalFBO() {
     glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
 }
 
+void Realtime::assignTextureArrays() {
+    m_textureArrayGeneration = m_textureStreamer.arrayGeneration();
+    for (auto &d : m_draws) {
+        if (!d.hasTexture) continue;
+        const TextureStreamer::ArraySlot slot = m_textureStreamer.arraySlot(d.texture);
+        d.textureArray = slot.texture;
+        d.textureLayer = slot.layer;
+    }
+}
+
+uint32_t Realtime::drawFeatures(const DrawItem &d) const {
+    uint32_t f = 0;
+    if (d.isPlanet)       f |= GF_Planet;
+    if (d.isSand)         f |= GF_Sand;
+    if (d.isMoon)         f |= GF_Moon;
+    if (d.isFloatingCube) f |= GF_FloatingCube;
+    if (d.hasTexture)     f |= GF_Texture;
+    if (d.textureArray)   f |= GF_TextureArray;
+    return f;
+}
+
+uint32_t Realtime::frameGeometryFeatures() const {
+    uint32_t f = 0;
+    if (settings.deferredShading && m_deferredLightProg && m_deferredStencilProg &&
+        m_deferredFBO && m_lightVolumeVAO) {
+        f |= GF_Deferred;
+    }
+    // Shadows (only in Planet fullscreen mode)
+    bool planetMode = settings.sceneFilePath.empty() &&
+                      (settings.fullscreenScene == FullscreenScene::Planet);
+    if (planetMode && m_hasShadowLight && m_shadowDepthTex != 0) {
+        // Fall back to hardware PCF if the moments could not be built
+        ShadowFilter filter = settings.shadowFilter;
+        if (filter == ShadowFilter::EVSM && m_evsmTex[0] == 0) filter = ShadowFilter::HardwarePCF;
+        f |= GF_Shadows;
+        f |= static_cast<uint32_t>(filter) << GF_ShadowFilterShift;
+    }
+    return f;
+}
+
+GLuint Realtime::geometryProgram(uint32_t features, bool wait) {
+    ShaderDefines defines;
+    if (features & GF_Planet)       defines.push_back("PLANET");
+    if (features & GF_Sand)         defines.push_back("SAND");
+    if (features & GF_Moon)         defines.push_back("MOON");
+    if (features & GF_FloatingCube) defines.push_back("FLOATING_CUBE");
+    if (features & GF_Texture)      defines.push_back("TEXTURE");
+    if (features & GF_TextureArray) defines.push_back("TEXTURE_ARRAY");
+    if (features & GF_Deferred)     defines.push_back("DEFERRED");
+    if (features & GF_Shadows) {
+        defines.push_back("SHADOWS");
+        defines.push_back("SHADOW_FILTER " + std::to_string((features >> GF_ShadowFilterShift) & 3u));
+    }
+    if (!wait) {
+        return m_shaderCache.tryProgram(":/resources/shaders/default.vert",
+                                        ":/resources/shaders/default.frag", defines);
+    }
+    return m_shaderCache.program(":/resources/shaders/default.vert",
+                                 ":/resources/shaders/default.frag", defines);
+}
+
+uint32_t Realtime::postUberFeatures(bool planet) const {
+    uint32_t f = 0;
+    if (planet)               f |= PF_Sky | PF_Toon | PF_Edges;
+    if (settings.fogEnabled)  f |= PF_Fog;
+    if (settings.colorGrade)  f |= PF_Grade;
+    if (settings.vignette)    f |= PF_Vignette;
+    return f;
+}
+
+GLuint Realtime::postUberProgram(uint32_t features) {
+    ShaderDefines defines;
+    if (features & PF_Sky)      defines.push_back("SKY");
+    if (features & PF_Toon)     defines.push_back("TOON");
+    if (features & PF_Edges)    defines.push_back("EDGES");
+    if (features & PF_Fog)      defines.push_back("FOG");
+    if (features & PF_Grade)    defines.push_back("GRADE");
+    if (features & PF_Vignette) defines.push_back("VIGNETTE");
+    return m_shaderCache.tryProgram(":/resources/shaders/post.vert",
+                                    ":/resources/shaders/post_uber.frag", defines);
+}
+
 void Realtime::runGeometryPass(GLint &prevFBO, glm::mat4 &V, glm::mat4 &P) {
 
-    if (!m_prog || m_vertexCount == 0) {
+    if (m_vertexCount == 0) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         return;
     }
@@ -1055,8 +1782,20 @@ void Realtime::runGeometryPass(GLint &prevFBO, glm::mat4 &V, glm::mat4 &P) {
     glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
 
     // Pass 1: render scene into offscreen FBO
+    const glm::ivec2 viewport = sceneViewport();
     glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
-    glViewport(0, 0, m_fbWidth, m_fbHeight);
+    glViewport(0, 0, viewport.x, viewport.y);
+
+    // Features shared by every draw this frame
+    const uint32_t frameFeatures = frameGeometryFeatures();
+
+    // Deferred mode also fills the albedo/specular targets; lights are added afterwards
+    const bool deferred = (frameFeatures & GF_Deferred) != 0;
+    {
+        const GLenum drawBuffers[5] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2,
+                                        GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+        glDrawBuffers(deferred ? 5 : 3, drawBuffers);
+    }
 
     {
         const float colorClear[4] = {1.f, 1.f, 1.f, 1.f};
@@ -1067,6 +1806,11 @@ void Realtime::runGeometryPass(GLint &prevFBO, glm::mat4 &V, glm::mat4 &P) {
         glClearBufferfv(GL_COLOR, 1, velocityClear);
         glClearBufferfv(GL_DEPTH, 0, &depthClear);
         glClearBufferfv(GL_COLOR, 2, normalClear);
+        if (deferred) {
+            const float gbufferClear[4] = {0.f, 0.f, 0.f, 0.f};
+            glClearBufferfv(GL_COLOR, 3, gbufferClear);
+            glClearBufferfv(GL_COLOR, 4, gbufferClear);
+        }
     }
 
     glEnable(GL_DEPTH_TEST);
@@ -1077,166 +1821,166 @@ void Realtime::runGeometryPass(GLint &prevFBO, glm::mat4 &V, glm::mat4 &P) {
         glEnable(GL_CULL_FACE);
     }
 
-    glUseProgram(m_prog);
     glBindVertexArray(m_vao);
 
     V = m_camera.getViewMatrix();
     P = m_camera.getProjectionMatrix();
 
-    // Upload common uniforms
-    GLint uM = glGetUniformLocation(m_prog, "u_M");
-    GLint uV = glGetUniformLocation(m_prog, "u_V");
-    GLint uP = glGetUniformLocation(m_prog, "u_P");
-    GLint uN = glGetUniformLocation(m_prog, "u_N");
-
-    GLint uPrevM = glGetUniformLocation(m_prog, "u_prevM");
-    GLint uPrevV = glGetUniformLocation(m_prog, "u_prevV");
-    GLint uPrevP = glGetUniformLocation(m_prog, "u_prevP");
-
-    GLint uKa = glGetUniformLocation(m_prog, "u_ka");
-    GLint uKd = glGetUniformLocation(m_prog, "u_kd");
-    GLint uKs = glGetUniformLocation(m_prog, "u_ks");
-    GLint uShininess = glGetUniformLocation(m_prog, "u_shininess");
-    GLint uCamPos = glGetUniformLocation(m_prog, "u_camPos");
-    GLint uGlobal = glGetUniformLocation(m_prog, "u_global");
-
-    GLint uHasTex = glGetUniformLocation(m_prog, "u_hasTexture");
-    GLint uTexRepeat = glGetUniformLocation(m_prog, "u_texRepeat");
-    GLint uBlend = glGetUniformLocation(m_prog, "u_blend");
-    GLint uTex = glGetUniformLocation(m_prog, "u_tex");
-
-    // Fog
-    GLint uFogColor = glGetUniformLocation(m_prog, "u_fogColor");
-    GLint uFogDensity = glGetUniformLocation(m_prog, "u_fogDensity");
-    GLint uFogEnable = glGetUniformLocation(m_prog, "u_fogEnable");
-
-    // Planet-specific
-    GLint uIsPlanet = glGetUniformLocation(m_prog, "u_isPlanet");
-    GLint uTime     = glGetUniformLocation(m_prog, "u_time");
-    GLint uPlanetColorA = glGetUniformLocation(m_prog, "u_planetColorA");
-    GLint uPlanetColorB = glGetUniformLocation(m_prog, "u_planetColorB");
-    GLint uIsSand   = glGetUniformLocation(m_prog, "u_isSand");
-
-    GLint uIsMoon      = glGetUniformLocation(m_prog, "u_isMoon");
-    GLint uMoonCenter  = glGetUniformLocation(m_prog, "u_moonCenter");
-    GLint uOrbitSpeed  = glGetUniformLocation(m_prog, "u_orbitSpeed");
-    GLint uOrbitPhase  = glGetUniformLocation(m_prog, "u_orbitPhase");
-    GLint uIsCube      = glGetUniformLocation(m_prog, "u_isFloatingCube");
-    GLint uFloatSpeed  = glGetUniformLocation(m_prog, "u_floatSpeed");
-    GLint uFloatAmp    = glGetUniformLocation(m_prog, "u_floatAmp");
-    GLint uFloatPhase  = glGetUniformLocation(m_prog, "u_floatPhase");
-
-    if (uTime >= 0) glUniform1f(uTime, m_timeSec);
-
-    glUniformMatrix4fv(uV, 1, GL_FALSE, glm::value_ptr(V));
-    glUniformMatrix4fv(uP, 1, GL_FALSE, glm::value_ptr(P));
-
-    if (uPrevV >= 0) glUniformMatrix4fv(uPrevV, 1, GL_FALSE, glm::value_ptr(m_prevV));
-    if (uPrevP >= 0) glUniformMatrix4fv(uPrevP, 1, GL_FALSE, glm::value_ptr(m_prevP));
-
-    glUniform3fv(uCamPos, 1, glm::value_ptr(m_camera.getPosition()));
-    glm::vec3 globals(m_render.globalData.ka, m_render.globalData.kd, m_render.globalData.ks);
-    glUniform3fv(uGlobal, 1, glm::value_ptr(globals));
-
-    if (uTex >= 0) glUniform1i(uTex, 0);
-
-    // Fog setup
-    float nearZ = settings.nearPlane;
-    float farZ = settings.farPlane;
-
-    glm::vec3 fogColor(1.f, 0.5f, 1.0f); // blue-white fog color
-
-    float target = 0.02f;
-    float density = (farZ > nearZ)
-                        ? (std::sqrt(std::max(0.0f, -std::log(target))) / farZ)
-                        : 0.0f;
-
-    if (uFogColor >= 0)   glUniform3fv(uFogColor, 1, glm::value_ptr(fogColor));
-    if (uFogDensity >= 0) glUniform1f(uFogDensity, density);
-    if (uFogEnable >= 0)  glUniform1i(uFogEnable, settings.fogEnabled ? 1 : 0);
-
-    // Lights (unchanged)
-    GLint uNumLights = glGetUniformLocation(m_prog, "u_numLights");
-    GLint uLightType0 = glGetUniformLocation(m_prog, "u_lightType[0]");
-    GLint uLightColor0 = glGetUniformLocation(m_prog, "u_lightColor[0]");
-    GLint uLightPos0 = glGetUniformLocation(m_prog, "u_lightPos[0]");
-    GLint uLightDir0 = glGetUniformLocation(m_prog, "u_lightDir[0]");
-    GLint uLightFunc0 = glGetUniformLocation(m_prog, "u_lightFunc[0]");
-    GLint uLightAngle0 = glGetUniformLocation(m_prog, "u_lightAngle[0]");
-    GLint uLightPenumbra0 = glGetUniformLocation(m_prog, "u_lightPenumbra[0]");
-
-    const int maxLights = 8;
-    int n = std::min<int>(maxLights, static_cast<int>(m_render.lights.size()));
-    glUniform1i(uNumLights, n);
-
-    int types[maxLights] = {0};
-    glm::vec3 colors[maxLights];
-    glm::vec3 poss[maxLights];
-    glm::vec3 dirs[maxLights];
-    glm::vec3 funcs[maxLights];
-    float angles[maxLights] = {0.f};
-    float pens[maxLights] = {0.f};
-
-    for (int i = 0; i < n; i++) {
-        const auto &L = m_render.lights[i];
-        types[i] = (L.type == LightType::LIGHT_DIRECTIONAL) ? 0
-                                                            : (L.type == LightType::LIGHT_POINT ? 1 : 2);
-        colors[i] = glm::vec3(L.color);
-        poss[i]   = glm::vec3(L.pos);
-        dirs[i]   = glm::normalize(glm::vec3(L.dir));
-        funcs[i]  = L.function;
-        angles[i] = L.angle;
-        pens[i]   = L.penumbra;
-    }
-
-    glUniform1iv(uLightType0, n, types);
-    glUniform3fv(uLightColor0, n, glm::value_ptr(colors[0]));
-    glUniform3fv(uLightPos0, n, glm::value_ptr(poss[0]));
-    glUniform3fv(uLightDir0, n, glm::value_ptr(dirs[0]));
-    glUniform3fv(uLightFunc0, n, glm::value_ptr(funcs[0]));
-    glUniform1fv(uLightAngle0, n, angles);
-    glUniform1fv(uLightPenumbra0, n, pens);
-
-    // Shadow uniforms (only in Planet fullscreen mode)
-    bool planetMode = settings.sceneFilePath.empty() &&
-                      (settings.fullscreenScene == FullscreenScene::Planet);
+    // Fog setup (applied here unless the post uber pass does it from depth)
+    const float density = fogDensity(settings.nearPlane, settings.farPlane);
+    const bool forwardFog = settings.fogEnabled && !m_fogInPost;
+
+    // Lights: bin into froxels and bind the cluster texture buffers
+    uploadLightClusters(V);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightDataTex);
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_BUFFER, m_clusterRangeTex);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightIndexTex);
+    glActiveTexture(GL_TEXTURE0);
 
-    GLint uUseShadow        = glGetUniformLocation(m_prog, "u_useShadows");
-    GLint uShadowLightIndex = glGetUniformLocation(m_prog, "u_shadowLightIndex");
-    GLint uLightVP          = glGetUniformLocation(m_prog, "u_lightViewProj");
-    GLint uShadowMap        = glGetUniformLocation(m_prog, "u_shadowMap");
+    const bool useShadows = (frameFeatures & GF_Shadows) != 0;
+    const ShadowFilter filter = static_cast<ShadowFilter>((frameFeatures >> GF_ShadowFilterShift) & 3u);
+    if (useShadows) {
+        // Same depth texture on two units: raw (manual PCF) and hardware compare
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, m_shadowDepthTex);
+        glBindSampler(4, m_shadowSamplerNearest);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, m_shadowDepthTex);
+        glBindSampler(5, m_shadowSamplerCompare);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, filter == ShadowFilter::EVSM ? m_evsmTex[0] : 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
 
-    if (planetMode && m_hasShadowLight && m_shadowDepthTex != 0) {
-        if (uUseShadow        >= 0) glUniform1i(uUseShadow, 1);
+    // Draw grouped by permutation so each program is bound (and set up) once,
+    // then by texture so draws sharing a packed array keep it bound
+    std::vector<std::pair<uint64_t, int>> order;
+    order.reserve(m_draws.size());
+    for (int i = 0; i < static_cast<int>(m_draws.size()); ++i) {
+        const DrawItem &d = m_draws[i];
+        const uint64_t features = frameFeatures | drawFeatures(d);
+        const GLuint texture = d.textureArray ? d.textureArray : d.texture;
+        order.emplace_back((features << 32) | texture, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    // Per-draw uniform locations of the bound program
+    GLint uM = -1, uN = -1, uPrevM = -1;
+    GLint uKa = -1, uKd = -1, uKs = -1, uShininess = -1;
+    GLint uTexRepeat = -1, uBlend = -1, uTexLayer = -1;
+    GLint uPlanetColorA = -1, uPlanetColorB = -1;
+    GLint uMoonCenter = -1, uOrbitSpeed = -1, uOrbitPhase = -1;
+    GLint uFloatSpeed = -1, uFloatAmp = -1, uFloatPhase = -1;
+
+    // Uploads the frame-constant uniforms to a newly bound permutation
+    auto bindProgram = [&](GLuint prog) {
+        glUseProgram(prog);
+
+        uM = glGetUniformLocation(prog, "u_M");
+        uN = glGetUniformLocation(prog, "u_N");
+        uPrevM = glGetUniformLocation(prog, "u_prevM");
+        uKa = glGetUniformLocation(prog, "u_ka");
+        uKd = glGetUniformLocation(prog, "u_kd");
+        uKs = glGetUniformLocation(prog, "u_ks");
+        uShininess = glGetUniformLocation(prog, "u_shininess");
+        uTexRepeat = glGetUniformLocation(prog, "u_texRepeat");
+        uBlend = glGetUniformLocation(prog, "u_blend");
+        uTexLayer = glGetUniformLocation(prog, "u_texLayer");
+        uPlanetColorA = glGetUniformLocation(prog, "u_planetColorA");
+        uPlanetColorB = glGetUniformLocation(prog, "u_planetColorB");
+        uMoonCenter  = glGetUniformLocation(prog, "u_moonCenter");
+        uOrbitSpeed  = glGetUniformLocation(prog, "u_orbitSpeed");
+        uOrbitPhase  = glGetUniformLocation(prog, "u_orbitPhase");
+        uFloatSpeed  = glGetUniformLocation(prog, "u_floatSpeed");
+        uFloatAmp    = glGetUniformLocation(prog, "u_floatAmp");
+        uFloatPhase  = glGetUniformLocation(prog, "u_floatPhase");
+
+        GLint uV = glGetUniformLocation(prog, "u_V");
+        GLint uP = glGetUniformLocation(prog, "u_P");
+        GLint uPrevV = glGetUniformLocation(prog, "u_prevV");
+        GLint uPrevP = glGetUniformLocation(prog, "u_prevP");
+        GLint uCamPos = glGetUniformLocation(prog, "u_camPos");
+        GLint uGlobal = glGetUniformLocation(prog, "u_global");
+        GLint uTex = glGetUniformLocation(prog, "u_tex");
+        GLint uTime = glGetUniformLocation(prog, "u_time");
+
+        if (uTime >= 0) glUniform1f(uTime, m_timeSec);
+        if (uV >= 0) glUniformMatrix4fv(uV, 1, GL_FALSE, glm::value_ptr(V));
+        if (uP >= 0) glUniformMatrix4fv(uP, 1, GL_FALSE, glm::value_ptr(P));
+        if (uPrevV >= 0) glUniformMatrix4fv(uPrevV, 1, GL_FALSE, glm::value_ptr(m_prevV));
+        if (uPrevP >= 0) glUniformMatrix4fv(uPrevP, 1, GL_FALSE, glm::value_ptr(m_prevP));
+        if (uCamPos >= 0) glUniform3fv(uCamPos, 1, glm::value_ptr(m_camera.getPosition()));
+        glm::vec3 globals(m_render.globalData.ka, m_render.globalData.kd, m_render.globalData.ks);
+        if (uGlobal >= 0) glUniform3fv(uGlobal, 1, glm::value_ptr(globals));
+        if (uTex >= 0) glUniform1i(uTex, 0);
+
+        GLint uFogColor = glGetUniformLocation(prog, "u_fogColor");
+        GLint uFogDensity = glGetUniformLocation(prog, "u_fogDensity");
+        GLint uFogEnable = glGetUniformLocation(prog, "u_fogEnable");
+        if (uFogColor >= 0)   glUniform3fv(uFogColor, 1, glm::value_ptr(kFogColor));
+        if (uFogDensity >= 0) glUniform1f(uFogDensity, density);
+        if (uFogEnable >= 0)  glUniform1i(uFogEnable, forwardFog ? 1 : 0);
+
+        GLint uLightData     = glGetUniformLocation(prog, "u_lightData");
+        GLint uClusterRanges = glGetUniformLocation(prog, "u_clusterRanges");
+        GLint uLightIndices  = glGetUniformLocation(prog, "u_lightIndices");
+        GLint uNumGlobal     = glGetUniformLocation(prog, "u_numGlobalLights");
+        GLint uClusterGrid   = glGetUniformLocation(prog, "u_clusterGrid");
+        GLint uClusterScreen = glGetUniformLocation(prog, "u_clusterScreen");
+        GLint uClusterDepth  = glGetUniformLocation(prog, "u_clusterDepth");
+        if (uLightData     >= 0) glUniform1i(uLightData, 7);
+        if (uClusterRanges >= 0) glUniform1i(uClusterRanges, 8);
+        if (uLightIndices  >= 0) glUniform1i(uLightIndices, 9);
+        if (uNumGlobal     >= 0) glUniform1i(uNumGlobal, m_lightClusterer.numGlobalLights());
+        if (uClusterGrid   >= 0) glUniform3i(uClusterGrid, LightClusterer::kGridX,
+                                             LightClusterer::kGridY, LightClusterer::kGridZ);
+        if (uClusterScreen >= 0) glUniform2f(uClusterScreen, float(viewport.x), float(viewport.y));
+        if (uClusterDepth  >= 0) glUniform2f(uClusterDepth, m_lightClusterer.nearPlane(),
+                                             m_lightClusterer.farPlane());
+
+        // Shadow samplers always get their own units: different sampler types may not share unit 0
+        GLint uShadowMap        = glGetUniformLocation(prog, "u_shadowMap");
+        GLint uShadowMapCmp     = glGetUniformLocation(prog, "u_shadowMapCmp");
+        GLint uShadowMoments    = glGetUniformLocation(prog, "u_shadowMoments");
+        GLint uShadowLightIndex = glGetUniformLocation(prog, "u_shadowLightIndex");
+        GLint uLightVP          = glGetUniformLocation(prog, "u_lightViewProj");
+        GLint uShadowDepthRange = glGetUniformLocation(prog, "u_shadowDepthRange");
+        if (uShadowMap     >= 0) glUniform1i(uShadowMap, 4);
+        if (uShadowMapCmp  >= 0) glUniform1i(uShadowMapCmp, 5);
+        if (uShadowMoments >= 0) glUniform1i(uShadowMoments, 6);
         if (uShadowLightIndex >= 0) glUniform1i(uShadowLightIndex, m_shadowLightIndex);
-        if (uLightVP          >= 0) glUniformMatrix4fv(
-                uLightVP, 1, GL_FALSE,
-                glm::value_ptr(m_lightViewProj));
-        if (uShadowMap        >= 0) {
-            glActiveTexture(GL_TEXTURE4);   // use texture unit 4 for shadow map
-            glBindTexture(GL_TEXTURE_2D, m_shadowDepthTex);
-            glUniform1i(uShadowMap, 4);
-        }
-    } else {
-        if (uUseShadow >= 0) glUniform1i(uUseShadow, 0);
-    }
+        if (uLightVP          >= 0) glUniformMatrix4fv(uLightVP, 1, GL_FALSE,
+                                                       glm::value_ptr(m_lightViewProj));
+        if (uShadowDepthRange >= 0) glUniform1f(uShadowDepthRange, m_shadowDepthRange);
+    };
 
-    for (const auto &d : m_draws) {
+    uint32_t boundFeatures = ~0u;
+    GLuint boundProg = 0;
+    GLuint boundTexture = 0;
+    for (const auto &entry : order) {
+        const DrawItem &d = m_draws[entry.second];
+
+        const uint32_t features = static_cast<uint32_t>(entry.first >> 32);
+        if (features != boundFeatures) {
+            boundFeatures = features;
+            // Permutations still compiling are skipped until they link
+            boundProg = geometryProgram(boundFeatures, false);
+            if (boundProg) bindProgram(boundProg);
+        }
+        if (!boundProg) continue;
 
         glUniformMatrix4fv(uM, 1, GL_FALSE, glm::value_ptr(d.model));
         glUniformMatrix3fv(uN, 1, GL_FALSE, glm::value_ptr(d.normalMat));
         if (uPrevM >= 0) glUniformMatrix4fv(uPrevM, 1, GL_FALSE, glm::value_ptr(d.prevModel));
 
-        if (uIsPlanet >= 0) glUniform1i(uIsPlanet, d.isPlanet);
-        if (uIsSand >= 0)   glUniform1i(uIsSand,   d.isSand);
-
-        // per-object:
-        if (uIsMoon >= 0)     glUniform1i(uIsMoon, d.isMoon);
+        // per-object animation (uniforms only exist in the MOON / FLOATING_CUBE variants)
         if (uMoonCenter >= 0) glUniform3fv(uMoonCenter, 1, glm::value_ptr(d.moonCenter));
         if (uOrbitSpeed >= 0) glUniform1f(uOrbitSpeed, d.orbitSpeed);
         if (uOrbitPhase >= 0) glUniform1f(uOrbitPhase, d.orbitPhase);
 
-        if (uIsCube >= 0)     glUniform1i(uIsCube, d.isFloatingCube);
         if (uFloatSpeed >= 0) glUniform1f(uFloatSpeed, d.floatSpeed);
         if (uFloatAmp >= 0)   glUniform1f(uFloatAmp, d.floatAmp);
         if (uFloatPhase >= 0) glUniform1f(uFloatPhase, d.floatPhase);
@@ -1246,21 +1990,37 @@ void Realtime::runGeometryPass(GLint &prevFBO, glm::mat4 &V, glm::mat4 &P) {
             if (uPlanetColorB >= 0) glUniform3fv(uPlanetColorB, 1, glm::value_ptr(d.planetColorB));
         }
 
-        glUniform3fv(uKa, 1, glm::value_ptr(d.ka));
-        glUniform3fv(uKd, 1, glm::value_ptr(d.kd));
-        glUniform3fv(uKs, 1, glm::value_ptr(d.ks));
-        glUniform1f(uShininess, d.shininess);
+        if (uKa >= 0) glUniform3fv(uKa, 1, glm::value_ptr(d.ka));
+        if (uKd >= 0) glUniform3fv(uKd, 1, glm::value_ptr(d.kd));
+        if (uKs >= 0) glUniform3fv(uKs, 1, glm::value_ptr(d.ks));
+        if (uShininess >= 0) glUniform1f(uShininess, d.shininess);
 
-        if (uHasTex >= 0) glUniform1i(uHasTex, d.hasTexture);
         if (d.hasTexture) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, d.texture);
+            m_textureStreamer.touch(d.texture);
+            // Draws are sorted by texture, so a shared array is bound once
+            const GLuint texture = d.textureArray ? d.textureArray : d.texture;
+            if (texture != boundTexture) {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(d.textureArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, texture);
+                boundTexture = texture;
+            }
+            if (uTexLayer >= 0)  glUniform1f(uTexLayer, float(d.textureLayer));
             if (uTexRepeat >= 0) glUniform2fv(uTexRepeat, 1, glm::value_ptr(d.texRepeat));
             if (uBlend >= 0)     glUniform1f(uBlend, d.blend);
         }
 
         glDrawArrays(GL_TRIANGLES, d.first, d.count);
     }
+
+    glBindSampler(4, 0);
+    glBindSampler(5, 0);
+
+    if (deferred) {
+        runDeferredLighting(V, P);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+        const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, drawBuffers);
+    }
 }
 
 void Realtime::renderGeometryScene() {
@@ -1271,74 +2031,491 @@ void Realtime::renderGeometryScene() {
     // 1. Geometry Pass
     runGeometryPass(prevFBO, V, P);
 
-    // 2. Post-process selection
-    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
-
+    // 2. Post-process chain
     int outW = size().width() * m_devicePixelRatio;
     int outH = size().height() * m_devicePixelRatio;
-    glViewport(0, 0, outW, outH);
+    runPostChain(static_cast<GLuint>(prevFBO), outW, outH, true);
+
+    // Update prev matrices
+    m_prevV = V;
+    m_prevP = P;
+    for (auto &d : m_draws) d.prevModel = d.model;
+}
+
+void Realtime::runPostChain(GLuint outFBO, int outW, int outH, bool cameraEffects) {
     glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(m_screenVAO);
 
-    // Select post program
-    bool useMotion = !m_debugDepth && (settings.extraCredit4 || m_sprintBlurUnlocked);
+    RenderGraph &g = m_postGraph;
+    using Resource = RenderGraph::Resource;
+    const Resource color    = g.importTexture("sceneColor", m_sceneColorTex, m_fbWidth, m_fbHeight);
+    const Resource depth    = g.importTexture("sceneDepth", m_sceneDepthTex, m_fbWidth, m_fbHeight);
+    const Resource normal   = g.importTexture("sceneNormal", m_sceneNormalTex, m_fbWidth, m_fbHeight);
+    const Resource velocity = g.importTexture("sceneVelocity", m_sceneVelocityTex, m_fbWidth, m_fbHeight);
+    const Resource output   = g.importFramebuffer("output", outFBO, outW, outH);
+
+    // Stages in effect order. Each adds its passes reading the previous stage's
+    // colour ('in') and writing 'out' (a transient target, or the output for the last one).
+    struct Stage {
+        const char *name;
+        std::function<void(Resource in, Resource out)> add;
+    };
+    std::vector<Stage> stages;
+    // Most stages are one fullscreen pass
+    auto singlePass = [&g](const char *name, std::vector<Resource> reads,
+                           std::function<void(const RenderGraph &, Resource)> run) {
+        return Stage{name, [&g, name, reads, run](Resource in, Resource out) {
+            std::vector<Resource> all = {in};
+            all.insert(all.end(), reads.begin(), reads.end());
+            g.addPass(name, all, out, [run, in](const RenderGraph &rg) { run(rg, in); });
+        }};
+    };
 
-    if (m_debugDepth && m_postProgDepth) {
-        glUseProgram(m_postProgDepth);
-    } else if (useMotion && m_postProgMotion) {
-        glUseProgram(m_postProgMotion);
+    if (m_debugDepth && cameraEffects && m_postProgDepth) {
+        // Debug view replaces the whole chain
+        stages.push_back(singlePass("debugDepth", {depth}, [this, depth](const RenderGraph &rg, Resource) {
+            glUseProgram(m_postProgDepth);
+            glUniform1i(glGetUniformLocation(m_postProgDepth, "u_depthTex"), 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, rg.texture(depth));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }));
     } else {
-        glUseProgram(m_postProg);  // DOF + fog
+        if (m_postProgUber) {
+            // Sky / toon / edges / fog / grade / vignette fused into one pass
+            stages.push_back(singlePass("uber", {depth, normal}, [this, depth, normal](const RenderGraph &rg, Resource in) {
+                glUseProgram(m_postProgUber);
+                glUniform1i(glGetUniformLocation(m_postProgUber, "u_sceneTex"), 0);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, rg.texture(in));
+
+                glUniform1i(glGetUniformLocation(m_postProgUber, "u_depthTex"), 1);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, rg.texture(depth));
+
+                glUniform1f(glGetUniformLocation(m_postProgUber, "u_near"), settings.nearPlane);
+                glUniform1f(glGetUniformLocation(m_postProgUber, "u_far"),  settings.farPlane);
+                const glm::ivec2 src = sceneViewport();
+                glUniform2f(glGetUniformLocation(m_postProgUber, "u_srcScale"),
+                            float(src.x) / float(m_fbWidth), float(src.y) / float(m_fbHeight));
+
+                if (m_postUberFeatures & PF_Edges) {
+                    glUniform1i(glGetUniformLocation(m_postProgUber, "u_normalTex"), 2);
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(normal));
+                }
+
+                // Sky texture
+                GLint locSky = glGetUniformLocation(m_postProgUber, "u_skyTex");
+                if (locSky >= 0 && m_skyTex != 0) {
+                    glUniform1i(locSky, 3);
+                    glActiveTexture(GL_TEXTURE3);
+                    glBindTexture(GL_TEXTURE_2D, m_skyTex);
+                    m_textureStreamer.touch(m_skyTex);
+                }
+
+                if (m_postUberFeatures & PF_Fog) {
+                    const float tanHalf = std::tan(0.5f * m_camera.getFovYRadians());
+                    const float aspect = float(m_fbWidth) / float(std::max(m_fbHeight, 1));
+                    glUniform3fv(glGetUniformLocation(m_postProgUber, "u_fogColor"), 1, glm::value_ptr(kFogColor));
+                    glUniform1f(glGetUniformLocation(m_postProgUber, "u_fogDensity"),
+                                fogDensity(settings.nearPlane, settings.farPlane));
+                    glUniform2f(glGetUniformLocation(m_postProgUber, "u_tanHalfFov"), tanHalf * aspect, tanHalf);
+                }
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }));
+        }
+        if (cameraEffects && settings.extraCredit3 &&
+            m_dofDownsampleProg && m_dofBlurProg && m_dofCompositeProg) {
+            // Half-res downsample -> horizontal and vertical gathers -> bilateral composite.
+            // Blurred pixels carry no detail worth shading at full resolution, so the gather
+            // runs on a quarter of the pixels, and being separable it costs 2 * TAPS taps
+            // rather than TAPS^2. What the half-res blur loses is edges: the downsample keeps
+            // the nearest depth of each 2x2 block, and the composite weights the half-res
+            // texels by how close their depth is to the full-res pixel's before blending by
+            // its own CoC, so in-focus silhouettes stay sharp and the blur does not leak
+            // across them.
+            stages.push_back({"dof", [this, &g, depth](Resource in, Resource out) {
+                const int hw = std::max(1, (m_fbWidth + 1) / 2);
+                const int hh = std::max(1, (m_fbHeight + 1) / 2);
+                const Resource half  = g.createTarget("dofHalf", hw, hh, GL_RGBA16F);
+                const Resource blurX = g.createTarget("dofBlurX", hw, hh, GL_RGBA16F);
+                const Resource blurY = g.createTarget("dofBlurY", hw, hh, GL_RGBA16F);
+
+                g.addPass("dofDownsample", {in, depth}, half, [this, in, depth](const RenderGraph &rg) {
+                    glUseProgram(m_dofDownsampleProg);
+                    glUniform1i(glGetUniformLocation(m_dofDownsampleProg, "u_colorTex"), 0);
+                    glUniform1i(glGetUniformLocation(m_dofDownsampleProg, "u_depthTex"), 1);
+                    glUniform1f(glGetUniformLocation(m_dofDownsampleProg, "u_near"), settings.nearPlane);
+                    glUniform1f(glGetUniformLocation(m_dofDownsampleProg, "u_far"),  settings.farPlane);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(in));
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(depth));
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                });
+
+                // maxBlurRadius is in full-res pixels; the gather runs at half res with a fixed
+                // tap count, so the stride (not the cost) grows with the radius
+                const float halfRadius = 0.5f * settings.maxBlurRadius;
+                auto blurPass = [this, halfRadius, hw, hh](Resource src, glm::vec2 axis) {
+                    return [this, src, axis, halfRadius, hw, hh](const RenderGraph &rg) {
+                        glUseProgram(m_dofBlurProg);
+                        glUniform1i(glGetUniformLocation(m_dofBlurProg, "u_srcTex"), 0);
+                        glUniform2f(glGetUniformLocation(m_dofBlurProg, "u_stepUV"),
+                                    axis.x * halfRadius / (kDofBlurTaps * float(hw)),
+                                    axis.y * halfRadius / (kDofBlurTaps * float(hh)));
+                        glUniform1f(glGetUniformLocation(m_dofBlurProg, "u_focusDist"), settings.focusDist);
+                        glUniform1f(glGetUniformLocation(m_dofBlurProg, "u_focusRange"), settings.focusRange);
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_2D, rg.texture(src));
+                        glDrawArrays(GL_TRIANGLES, 0, 6);
+                    };
+                };
+                g.addPass("dofBlurX", {half}, blurX, blurPass(half, glm::vec2(1.f, 0.f)));
+                g.addPass("dofBlurY", {blurX}, blurY, blurPass(blurX, glm::vec2(0.f, 1.f)));
+
+                g.addPass("dofComposite", {in, depth, blurY}, out, [this, in, depth, blurY](const RenderGraph &rg) {
+                    glUseProgram(m_dofCompositeProg);
+                    glUniform1i(glGetUniformLocation(m_dofCompositeProg, "u_colorTex"), 0);
+                    glUniform1i(glGetUniformLocation(m_dofCompositeProg, "u_depthTex"), 1);
+                    glUniform1i(glGetUniformLocation(m_dofCompositeProg, "u_blurTex"), 2);
+                    glUniform1f(glGetUniformLocation(m_dofCompositeProg, "u_near"), settings.nearPlane);
+                    glUniform1f(glGetUniformLocation(m_dofCompositeProg, "u_far"),  settings.farPlane);
+                    glUniform1f(glGetUniformLocation(m_dofCompositeProg, "u_focusDist"), settings.focusDist);
+                    glUniform1f(glGetUniformLocation(m_dofCompositeProg, "u_focusRange"), settings.focusRange);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(in));
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(depth));
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(blurY));
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                });
+            }});
+        }
+        if (cameraEffects && (settings.extraCredit4 || m_sprintBlurUnlocked) &&
+            m_motionTileMaxProg && m_motionNeighborMaxProg && m_postProgMotion) {
+            // Tile-max velocity -> 3x3 neighbour-max -> full-res reconstruction (skips still tiles)
+            stages.push_back({"motionBlur", [this, &g, depth, velocity](Resource in, Resource out) {
+                const int tw = (m_fbWidth + kMotionTileSize - 1) / kMotionTileSize;
+                const int th = (m_fbHeight + kMotionTileSize - 1) / kMotionTileSize;
+                const Resource tileMax = g.createTarget("motionTileMax", tw, th, GL_RG16F);
+                const Resource neighborMax = g.createTarget("motionNeighborMax", tw, th, GL_RG16F);
+
+                g.addPass("motionTileMax", {velocity}, tileMax, [this, velocity](const RenderGraph &rg) {
+                    glUseProgram(m_motionTileMaxProg);
+                    glUniform1i(glGetUniformLocation(m_motionTileMaxProg, "u_velocityTex"), 0);
+                    glUniform1i(glGetUniformLocation(m_motionTileMaxProg, "u_tileSize"), kMotionTileSize);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(velocity));
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                });
+                g.addPass("motionNeighborMax", {tileMax}, neighborMax, [this, tileMax](const RenderGraph &rg) {
+                    glUseProgram(m_motionNeighborMaxProg);
+                    glUniform1i(glGetUniformLocation(m_motionNeighborMaxProg, "u_tileMaxTex"), 0);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(tileMax));
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                });
+                g.addPass("motionBlur", {in, velocity, depth, neighborMax}, out,
+                          [this, in, velocity, depth, neighborMax](const RenderGraph &rg) {
+                    glUseProgram(m_postProgMotion);
+                    glUniform1i(glGetUniformLocation(m_postProgMotion, "u_colorTex"), 0);
+                    glUniform1i(glGetUniformLocation(m_postProgMotion, "u_velocityTex"), 1);
+                    glUniform1i(glGetUniformLocation(m_postProgMotion, "u_depthTex"), 2);
+                    glUniform1i(glGetUniformLocation(m_postProgMotion, "u_neighborMaxTex"), 3);
+                    glUniform1f(glGetUniformLocation(m_postProgMotion, "u_near"), settings.nearPlane);
+                    glUniform1f(glGetUniformLocation(m_postProgMotion, "u_far"),  settings.farPlane);
+                    glUniform1i(glGetUniformLocation(m_postProgMotion, "u_tileSize"), kMotionTileSize);
+                    glUniform1i(glGetUniformLocation(m_postProgMotion, "u_maxSamples"), kMotionMaxSamples);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(in));
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(velocity));
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(depth));
+                    glActiveTexture(GL_TEXTURE3);
+                    glBindTexture(GL_TEXTURE_2D, rg.texture(neighborMax));
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                });
+            }});
+        }
     }
 
-    glBindVertexArray(m_screenVAO);
+    if (stages.empty()) {
+        // Nothing enabled: present the scene colour directly
+        g.addPass("present", {color}, output, [this, outW, outH](const RenderGraph &) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_sceneFBO);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            const glm::ivec2 src = sceneViewport();
+            glBlitFramebuffer(0, 0, src.x, src.y, 0, 0, outW, outH,
+                              GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        });
+    } else {
+        // Intermediates are transient; the graph aliases them onto pooled targets
+        Resource in = color;
+        for (size_t i = 0; i < stages.size(); ++i) {
+            const bool last = (i + 1 == stages.size());
+            const Resource out = last ? output
+                                      : g.createTarget(stages[i].name, m_fbWidth, m_fbHeight, GL_RGBA8);
+            stages[i].add(in, out);
+            in = out;
+        }
+    }
 
-    if (m_debugDepth && m_postProgDepth) {
-        glUniform1i(glGetUniformLocation(m_postProgDepth, "u_depthTex"), 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_sceneDepthTex);
+    g.execute();
+    glActiveTexture(GL_TEXTURE0);
+}
 
-    } else if (useMotion && m_postProgMotion) {
-        glUniform1i(glGetUniformLocation(m_postProgMotion, "u_colorTex"), 0);
-        glUniform1i(glGetUniformLocation(m_postProgMotion, "u_velocityTex"), 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_sceneColorTex);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, m_sceneVelocityTex);
+bool Realtime::requestPrograms(SceneRenderMode mode) {
+    static const char *kPostVert = ":/resources/shaders/post.vert";
 
-    } else {
-        // DOF + Fog
-        glUniform1i(glGetUniformLocation(m_postProg, "u_colorTex"), 0);
-        glUniform1i(glGetUniformLocation(m_postProg, "u_depthTex"), 1);
-        glUniform1f(glGetUniformLocation(m_postProg, "u_near"), settings.nearPlane);
-        glUniform1f(glGetUniformLocation(m_postProg, "u_far"),  settings.farPlane);
-        glUniform1f(glGetUniformLocation(m_postProg, "u_focusDist"), settings.focusDist);
-        glUniform1f(glGetUniformLocation(m_postProg, "u_focusRange"), settings.focusRange);
-        glUniform1f(glGetUniformLocation(m_postProg, "u_maxBlurRadius"), settings.maxBlurRadius);
-        glUniform1i(glGetUniformLocation(m_postProg, "u_enable"), settings.extraCredit3 ? 1 : 0);
-        glUniform2f(glGetUniformLocation(m_postProg, "u_texelSize"),
-                    1.f / float(m_fbWidth),
-                    1.f / float(m_fbHeight));
+    // Fused post pass for this scene's effect set; fog moves there once it links
+    auto requestPostUber = [&](bool planet) {
+        m_postUberFeatures = postUberFeatures(planet);
+        m_postProgUber = m_postUberFeatures ? postUberProgram(m_postUberFeatures) : 0;
+        m_fogInPost = m_postProgUber != 0 && (m_postUberFeatures & PF_Fog);
+    };
+    // Planet scene: toon post over the shaded geometry, plus the shadow passes
+    auto requestPlanet = [&]() {
+        requestPostUber(true);
+        m_shadowShader = m_shaderCache.tryProgram(":/resources/shaders/shadow.vert",
+                                                  ":/resources/shaders/shadow.frag");
+        if (settings.shadowFilter == ShadowFilter::EVSM) {
+            m_evsmMomentsProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/evsm_moments.frag");
+            m_evsmBlurProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/evsm_blur.frag");
+        }
+    };
+    // DoF and motion blur stack on top of either geometry scene
+    auto requestCameraEffects = [&]() {
+        m_dofDownsampleProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/dof_downsample.frag");
+        m_dofBlurProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/dof_blur.frag");
+        m_dofCompositeProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/dof_composite.frag");
+        m_motionTileMaxProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/motion_tilemax.frag");
+        m_motionNeighborMaxProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/motion_neighbormax.frag");
+        m_postProgMotion = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/motionblur.frag");
+    };
+    // Geometry permutations this frame's draws will ask for
+    auto requestDraws = [&]() {
+        if (settings.deferredShading) {
+            m_deferredLightProg = m_shaderCache.tryProgram(":/resources/shaders/deferred_light.vert",
+                                                           ":/resources/shaders/deferred_light.frag");
+            m_deferredStencilProg = m_shaderCache.tryProgram(":/resources/shaders/deferred_light.vert",
+                                                             ":/resources/shaders/shadow.frag");
+        }
+        const uint32_t frameFeatures = frameGeometryFeatures();
+        bool linked = true;
+        for (const auto &d : m_draws) {
+            if (!geometryProgram(frameFeatures | drawFeatures(d), false)) linked = false;
+        }
+        return linked;
+    };
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_sceneColorTex);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, m_sceneDepthTex);
+    // Fullscreen raymarchers at one quality tier: the scene on screen and the one seen
+    // through the portal. True once the shown scene's program links.
+    const bool iqShown = settings.fullscreenScene == FullscreenScene::IQ;
+    const bool rainforestNeeded = iqShown;
+    const bool waterNeeded = !iqShown || m_portalEnabled;
+    const char *iq = ":/resources/shaders/iq_rainforest.frag";
+    const char *water = ":/resources/shaders/water.frag";
+    auto requestFullscreen = [&](QualityTier tier) {
+        m_cloudBakeProg = m_iqCoarseProg = m_postProgIQ = m_postProgIQTemporal = 0;
+        m_iqPrepassActive = false;
+        if (rainforestNeeded) {
+            m_cloudBakeProg = settings.rainforestCloudCache
+                ? m_shaderCache.tryProgram(kPostVert, iq, rainforestQualityDefines(tier, {"CLOUD_BAKE"}))
+                : 0;
+            // Rays start at tmin until the prepass and its consumer have both linked
+            m_iqCoarseProg = settings.rainforestPrepass
+                ? m_shaderCache.tryProgram(kPostVert, iq, {"LOWQUALITY", "COARSE_PREPASS"})
+                : 0;
+            if (m_iqCoarseProg) {
+                m_postProgIQ = m_shaderCache.tryProgram(kPostVert, iq, rainforestQualityDefines(tier, {"COARSE_START"}));
+            }
+            m_iqPrepassActive = m_postProgIQ != 0;
+            if (!m_iqPrepassActive) {
+                m_postProgIQ = m_shaderCache.tryProgram(kPostVert, iq, rainforestQualityDefines(tier));
+            }
+            // Temporal rendering falls back to full-rate until both passes link
+            if (settings.rainforestTemporal != TemporalMode::Off) {
+                m_postProgIQTemporal = m_iqPrepassActive
+                    ? m_shaderCache.tryProgram(kPostVert, iq, rainforestQualityDefines(tier, {"TEMPORAL", "COARSE_START"}))
+                    : m_shaderCache.tryProgram(kPostVert, iq, rainforestQualityDefines(tier, {"TEMPORAL"}));
+            }
+        }
+        m_postProgWater = m_waveBakeProg = 0;
+        if (waterNeeded) {
+            m_postProgWater = m_shaderCache.tryProgram(kPostVert, water, waterQualityDefines(tier));
+            // Waves are summed per pixel until the bake links
+            m_waveBakeProg = settings.waterWaveCache
+                ? m_shaderCache.tryProgram(kPostVert, water, waterQualityDefines(tier, {"WAVE_BAKE"}))
+                : 0;
+        }
+        return iqShown ? m_postProgIQ != 0 : m_postProgWater != 0;
+    };
+    // Programs of the fullscreen scene that is not in use, as its settings would pick
+    // them once everything links, so switching scenes does not wait on the compiler
+    auto idleFullscreenPrograms = [&](QualityTier tier) {
+        std::vector<std::pair<const char *, ShaderDefines>> programs;
+        if (!rainforestNeeded) {
+            const char *start = settings.rainforestPrepass ? "COARSE_START" : nullptr;
+            auto withStart = [&](std::initializer_list<const char *> extra) {
+                ShaderDefines defines = rainforestQualityDefines(tier, extra);
+                if (start) defines.push_back(start);
+                return defines;
+            };
+            programs.push_back({iq, withStart({})});
+            if (settings.rainforestPrepass) programs.push_back({iq, {"LOWQUALITY", "COARSE_PREPASS"}});
+            if (settings.rainforestTemporal != TemporalMode::Off) {
+                programs.push_back({iq, withStart({"TEMPORAL"})});
+                programs.push_back({":/resources/shaders/iq_temporal.frag", {}});
+            }
+            if (settings.rainforestCloudCache) programs.push_back({iq, rainforestQualityDefines(tier, {"CLOUD_BAKE"})});
+            if (settings.rainforestTerrainCache) programs.push_back({iq, {"LOWQUALITY", "TERRAIN_BAKE"}});
+        }
+        if (!waterNeeded) {
+            programs.push_back({water, waterQualityDefines(tier)});
+            if (settings.waterWaveCache) programs.push_back({water, waterQualityDefines(tier, {"WAVE_BAKE"})});
+        }
+        return programs;
+    };
+
+    bool ready = false;
+    switch (mode) {
+    case SceneRenderMode::FullscreenProcedural:
+        m_terrainBakeProg = (rainforestNeeded && settings.rainforestTerrainCache)
+            ? m_shaderCache.tryProgram(kPostVert, iq, {"LOWQUALITY", "TERRAIN_BAKE"})
+            : 0;
+        m_postProgDirectional = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/directional_blur.frag");
+        // Scaled rendering stays native until the upscaler links
+        m_dynResUpscaleProg = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/dynres_upscale.frag");
+        m_iqResolveProg = (rainforestNeeded && settings.rainforestTemporal != TemporalMode::Off)
+            ? m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/iq_temporal.frag")
+            : 0;
+        {
+            const QualityTier tier = activeQualityTier();
+            ready = requestFullscreen(tier);
+            if (ready) {
+                if (tier != m_renderTier) {
+                    std::cout << "Quality tier " << int(m_renderTier) << " -> " << int(tier) << std::endl;
+                }
+                m_renderTier = tier;
+            } else if (tier != m_renderTier) {
+                // The previous tier stays on screen while the new one compiles
+                ready = requestFullscreen(m_renderTier);
+            }
+        }
+        if (m_portalEnabled) {
+            // The portal appears once its own programs have linked
+            m_portalProg = m_shaderCache.tryProgram(":/resources/shaders/portal.vert",
+                                                    ":/resources/shaders/portal.frag");
+            // Until these link the portal is composited from its texture
+            m_portalMaskProg = settings.portalStencil
+                ? m_shaderCache.tryProgram(":/resources/shaders/portal.vert",
+                                           ":/resources/shaders/portal.frag", {"PORTAL_MASK"})
+                : 0;
+            m_portalRimProg = settings.portalStencil
+                ? m_shaderCache.tryProgram(":/resources/shaders/portal.vert",
+                                           ":/resources/shaders/portal.frag", {"PORTAL_RIM"})
+                : 0;
+            if (settings.fullscreenScene == FullscreenScene::Water) {
+                requestPlanet();
+                requestDraws();
+            }
+        }
+        break;
+
+    case SceneRenderMode::PlanetGeometryScene:
+        requestPlanet();
+        requestCameraEffects();
+        ready = requestDraws() && m_postProgUber != 0;
+        break;
+
+    case SceneRenderMode::GeometryScene:
+        requestPostUber(false);
+        requestCameraEffects();
+        m_postProgDepth = m_shaderCache.tryProgram(kPostVert, ":/resources/shaders/debug_depth.frag");
+        ready = requestDraws();
+        break;
+    }
+
+    // Warm the idle fullscreen scene. With parallel compile it all goes to the driver
+    // threads at once. Without it every compile blocks the frame that starts it, so
+    // one starts per frame, and not before the first real frame has been presented.
+    if (ready && mode == SceneRenderMode::FullscreenProcedural) {
+        const bool parallel = GLEW_KHR_parallel_shader_compile;
+        if (parallel || m_shadersReported) {
+            for (const auto &p : idleFullscreenPrograms(m_renderTier)) {
+                if (m_shaderCache.prefetch(kPostVert, p.first, p.second) && !parallel) break;
+            }
+        }
     }
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    if (ready && !m_shadersReported) {
+        m_shadersReported = true;
+        std::cout << "Shaders ready in " << m_shaderTimer.elapsed() << " ms ("
+                  << m_programBinaryCache.hits() << " from binary cache, "
+                  << m_programBinaryCache.misses() << " compiled)" << std::endl;
+    }
+    return ready;
+}
 
-    // Update prev matrices
-    m_prevV = V;
-    m_prevP = P;
-    for (auto &d : m_draws) d.prevModel = d.model;
+void Realtime::renderPlaceholder() {
+    int outW = size().width() * m_devicePixelRatio;
+    int outH = size().height() * m_devicePixelRatio;
+    glViewport(0, 0, outW, outH);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (m_placeholderProg == 0 || m_screenVAO == 0) return;
+
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(m_placeholderProg);
+    glUniform1f(glGetUniformLocation(m_placeholderProg, "u_time"), m_timeSec);
+    glBindVertexArray(m_screenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
 }
 
 void Realtime::paintGL() {
+    ++m_paintIndex;
+    // Land textures decoded since the last frame (bounded so one frame never stalls)
+    m_textureStreamer.setResidentBudget(size_t(settings.textureBudgetMB) << 20);
+    m_textureStreamer.pump(kTextureUploadBudget);
+    {
+        const TextureStreamer::Stats &ts = m_textureStreamer.stats();
+        if (ts.evictions != m_loggedTextureEvictions) {
+            m_loggedTextureEvictions = ts.evictions;
+            std::cout << "Textures: " << (ts.residentBytes >> 20) << " of " << settings.textureBudgetMB
+                      << " MB resident (" << ts.hits << " hits, " << ts.misses << " misses, "
+                      << ts.evictions << " evictions)" << std::endl;
+        }
+    }
+    if (m_textureStreamer.arrayGeneration() != m_textureArrayGeneration) assignTextureArrays();
+
     SceneRenderMode mode = computeRenderMode();
+    // Keep presenting frames while the programs this mode needs compile
+    if (!requestPrograms(mode)) {
+        renderPlaceholder();
+        return;
+    }
     switch (mode) {
 
     case SceneRenderMode::FullscreenProcedural:
+        // GPU time of the whole procedural frame drives its render scale
+        m_dynamicResolution.setEnabled(settings.dynamicResolution);
+        m_dynamicResolution.beginFrame();
         renderFullscreenProcedural();
+        m_dynamicResolution.endFrame();
+        // Same timings pick the quality tier once the render scale has run out of room
+        if (!settings.autoQuality) {
+            m_qualitySelector.reset(int(settings.qualityTier));
+        } else if (m_dynamicResolution.settled()) {
+            const float scale = m_dynamicResolution.scale();
+            m_qualitySelector.update(m_dynamicResolution.gpuMs(), m_dynamicResolution.targetMs(),
+                                     m_dynamicResolution.enabled() && scale > DynamicResolution::kMinScale,
+                                     scale >= DynamicResolution::kMaxScale);
+        }
         return;
 
     case SceneRenderMode::PlanetGeometryScene:
@@ -1365,6 +2542,13 @@ void Realtime::resizeGL(int w, int h) {
     createOrResizeSceneFBO(fbw, fbh);
     createOrResizePortalFBO(fbw, fbh);
     createOrResizeFullscreenFBO(fbw, fbh);
+    createOrResizeDynResFBO(fbw, fbh);
+    createOrResizeRainforestTemporal(fbw, fbh);
+    createOrResizeRainforestCoarse(fbw, fbh);
+    // Pooled post targets are sized to the old framebuffer
+    m_postGraph.releaseTargets();
+    // The widget recreates its framebuffer on resize, possibly under the same name
+    m_stencilQueryBits = -1;
 }
 
 void Realtime::sceneChanged(bool preserveCamera) {
@@ -1505,6 +2689,7 @@ void Realtime::rebuildGeometryFromRenderData() {
         Realtime::DrawItem item;
         item.first = first;
         item.count = count;
+        vertexRangeBounds(cpuData, first, count, item.boundsMin, item.boundsMax);
         item.model = model;
         item.invModel = invModel;
         item.normalMat = normalMat;
@@ -1516,34 +2701,9 @@ void Realtime::rebuildGeometryFromRenderData() {
         item.isPlanet = false;
         item.isSand = false;
         if (mat.textureMap.isUsed) {
-            // Load or get from cache
-            auto it = m_textureCache.find(mat.textureMap.filename);
-            if (it == m_textureCache.end()) {
-                QImage img(QString::fromStdString(mat.textureMap.filename));
-                if (!img.isNull()) {
-                    QImage rgba = img.convertToFormat(QImage::Format_RGBA8888);
-                    GLuint texId = 0;
-                    glGenTextures(1, &texId);
-                    glBindTexture(GL_TEXTURE_2D, texId);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgba.width(), rgba.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.constBits());
-                    glGenerateMipmap(GL_TEXTURE_2D);
-                    glBindTexture(GL_TEXTURE_2D, 0);
-                    m_textureCache.emplace(mat.textureMap.filename, texId);
-                    item.texture = texId;
-                    item.hasTexture = true;
-                } else {
-                    std::cerr << "Failed to load texture: " << mat.textureMap.filename << std::endl;
-                    item.hasTexture = false;
-                }
-            } else {
-                item.texture = it->second;
-                item.hasTexture = true;
-            }
+            // Shared per file; samples a white placeholder until the upload finishes
+            item.texture = m_textureStreamer.request(mat.textureMap.filename, GL_REPEAT, true);
+            item.hasTexture = true;
             item.texRepeat = glm::vec2(mat.textureMap.repeatU, mat.textureMap.repeatV);
             item.blend = mat.blend;
         }
@@ -1551,6 +2711,8 @@ void Realtime::rebuildGeometryFromRenderData() {
         first += count;
     }
     m_vertexCount = first;
+    // Textures already packed by an earlier scene
+    assignTextureArrays();
 
     glBindVertexArray(m_vao);
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
@@ -1616,6 +2778,7 @@ void Realtime::buildPlanetScene() {
     DrawItem terrain{};
     terrain.first = 0;
     terrain.count = terrainCount;
+    vertexRangeBounds(cpuData, 0, terrainCount, terrain.boundsMin, terrain.boundsMax);
 
     // Transform terrain
     float terrainSize = 40.f;
@@ -1650,6 +2813,8 @@ void Realtime::buildPlanetScene() {
     int sphereFirst = terrainCount;
     int sphereCount = sphereData.size() / 8;
     cpuData.insert(cpuData.end(), sphereData.begin(), sphereData.end());
+    glm::vec3 sphereMin, sphereMax;
+    vertexRangeBounds(cpuData, sphereFirst, sphereCount, sphereMin, sphereMax);
 
     auto makePlanet = [&](glm::vec3 pos,
                           float radius,
@@ -1658,6 +2823,8 @@ void Realtime::buildPlanetScene() {
         DrawItem p{};
         p.first = sphereFirst;
         p.count = sphereCount;
+        p.boundsMin = sphereMin;
+        p.boundsMax = sphereMax;
 
         glm::mat4 SM =
             glm::translate(glm::mat4(1.f), pos) *
@@ -1804,6 +2971,8 @@ void Realtime::buildPlanetScene() {
     int cubeFirst = sphereFirst + sphereCount;
     int cubeCount = cubeData.size() / 8;
     cpuData.insert(cpuData.end(), cubeData.begin(), cubeData.end());
+    glm::vec3 cubeMin, cubeMax;
+    vertexRangeBounds(cpuData, cubeFirst, cubeCount, cubeMin, cubeMax);
 
     // Update total vertex count
     m_vertexCount = cubeFirst + cubeCount;
@@ -1817,6 +2986,8 @@ void Realtime::buildPlanetScene() {
         DrawItem c{};
         c.first = cubeFirst;
         c.count = cubeCount;
+        c.boundsMin = cubeMin;
+        c.boundsMax = cubeMax;
 
         glm::mat4 SM =
             glm::translate(glm::mat4(1.f), pos) *
@@ -2382,15 +3553,29 @@ void Realtime::createOrResizeSceneFBO(int width, int height) {
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
                            GL_TEXTURE_2D, m_sceneNormalTex, 0);
 
-    // Depth
+    // Deferred G-buffer: albedo + light weight, specular color (written only in deferred mode)
+    auto makeGBufferTex = [&](GLuint &tex, GLenum attachment) {
+        if (tex == 0) glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, tex, 0);
+    };
+    makeGBufferTex(m_sceneAlbedoTex, GL_COLOR_ATTACHMENT3);
+    makeGBufferTex(m_sceneSpecularTex, GL_COLOR_ATTACHMENT4);
+
+    // Depth (+ stencil so it can be blitted into the deferred lighting FBO)
     if (m_sceneDepthTex == 0) glGenTextures(1, &m_sceneDepthTex);
     glBindTexture(GL_TEXTURE_2D, m_sceneDepthTex);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_sceneDepthTex, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_sceneDepthTex, 0);
 
     GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
     glDrawBuffers(3, drawBuffers);
@@ -2399,6 +3584,22 @@ void Realtime::createOrResizeSceneFBO(int width, int height) {
     if (status != GL_FRAMEBUFFER_COMPLETE) {
         std::cerr << "Scene FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
     }
+
+    // Deferred lighting target: same color texture, separate depth/stencil so the
+    // light pass can sample m_sceneDepthTex without a feedback loop
+    if (m_deferredFBO == 0) glGenFramebuffers(1, &m_deferredFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_deferredFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_sceneColorTex, 0);
+    if (m_deferredDepthRBO == 0) glGenRenderbuffers(1, &m_deferredDepthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_deferredDepthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_deferredDepthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Deferred FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     m_fbWidth = width;
     m_fbHeight = height;
@@ -2409,7 +3610,11 @@ void Realtime::releaseSceneFBO() {
     if (m_sceneDepthTex) { glDeleteTextures(1, &m_sceneDepthTex); m_sceneDepthTex = 0; }
     if (m_sceneVelocityTex) { glDeleteTextures(1, &m_sceneVelocityTex); m_sceneVelocityTex = 0; }
     if (m_sceneNormalTex)  { glDeleteTextures(1, &m_sceneNormalTex);  m_sceneNormalTex = 0; }
+    if (m_sceneAlbedoTex)  { glDeleteTextures(1, &m_sceneAlbedoTex);  m_sceneAlbedoTex = 0; }
+    if (m_sceneSpecularTex) { glDeleteTextures(1, &m_sceneSpecularTex); m_sceneSpecularTex = 0; }
     if (m_sceneFBO) { glDeleteFramebuffers(1, &m_sceneFBO); m_sceneFBO = 0; }
+    if (m_deferredDepthRBO) { glDeleteRenderbuffers(1, &m_deferredDepthRBO); m_deferredDepthRBO = 0; }
+    if (m_deferredFBO) { glDeleteFramebuffers(1, &m_deferredFBO); m_deferredFBO = 0; }
 
     m_fbWidth = m_fbHeight = 0;
 }
@@ -2444,6 +3649,102 @@ void Realtime::releaseScreenQuad() {
     if (m_screenVAO) { glDeleteVertexArrays(1, &m_screenVAO); m_screenVAO = 0; }
 }
 
+bool Realtime::updatePortalViewport(const glm::mat4 &viewProj, int outW, int outH) {
+    m_portalViewport = glm::ivec2(0);
+    if (m_portalWidth <= 0 || m_portalHeight <= 0 || outW <= 0 || outH <= 0) return false;
+
+    // Screen-space bounds of the portal quad's corners
+    glm::vec2 lo(std::numeric_limits<float>::max());
+    glm::vec2 hi(std::numeric_limits<float>::lowest());
+    int behind = 0;
+    for (int i = 0; i < 4; ++i) {
+        const glm::vec4 corner((i & 1) ? m_portalHalfSize : -m_portalHalfSize,
+                               (i & 2) ? m_portalHalfSize : -m_portalHalfSize, 0.f, 1.f);
+        const glm::vec4 clip = viewProj * m_portalModel * corner;
+        if (clip.w <= 1e-4f) { ++behind; continue; }
+        const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+    if (behind == 4) return false;
+
+    float scale = 1.f; // straddling the eye plane: assume it can fill the view
+    if (behind == 0) {
+        if (hi.x < -1.f || lo.x > 1.f || hi.y < -1.f || lo.y > 1.f) return false;
+        // The whole far-side image is mapped onto the quad, so its texel density follows
+        // the quad's unclipped size. Keep the output aspect so the far camera's framing
+        // is unchanged, just coarser; 1/32 steps stop iResolution jittering every frame.
+        const glm::vec2 extent = 0.5f * (hi - lo);
+        scale = std::min(1.f, std::ceil(std::max(extent.x, extent.y) * 32.f) / 32.f);
+    }
+    m_portalViewport.x = std::clamp(int(std::ceil(outW * scale)), kPortalMinSize, m_portalWidth);
+    m_portalViewport.y = std::clamp(int(std::ceil(outH * scale)), kPortalMinSize, m_portalHeight);
+    return true;
+}
+
+void Realtime::setPortalSampling() {
+    glUniform2f(glGetUniformLocation(m_portalProg, "u_uvScale"),
+                float(m_portalViewport.x) / float(m_portalWidth),
+                float(m_portalViewport.y) / float(m_portalHeight));
+    glUniformMatrix4fv(glGetUniformLocation(m_portalProg, "u_reproject"), 1, GL_FALSE,
+                       glm::value_ptr(m_portalReproject));
+}
+
+bool Realtime::portalFarSideDue(FullscreenScene farScene, const glm::mat4 &farRotVP) {
+    // The texture can stand in for one frame if it was shown last frame, shows the same
+    // scene at the same size, and was itself freshly rendered
+    const bool reusable = settings.portalHalfRate && !m_portalReused &&
+                          m_portalShownFrame + 1 == m_paintIndex &&
+                          m_portalFarScene == farScene && m_portalRenderedSize == m_portalViewport;
+    m_portalShownFrame = m_paintIndex;
+    m_portalReused = reusable;
+    if (reusable) {
+        m_portalReproject = m_portalFarViewProj * glm::inverse(farRotVP);
+        return false;
+    }
+    m_portalFarScene = farScene;
+    m_portalRenderedSize = m_portalViewport;
+    m_portalFarViewProj = farRotVP;
+    m_portalReproject = glm::mat4(1.f);
+    return true;
+}
+
+bool Realtime::framebufferHasStencil(GLuint fbo) {
+    // Cached for the last framebuffer asked about (the widget's, which only changes on resize)
+    if (m_stencilQueryBits < 0 || m_stencilQueryFBO != fbo) {
+        GLint prevFBO = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        const GLenum attachment = (fbo == 0) ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+        GLint type = GL_NONE;
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachment,
+                                              GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+        GLint bits = 0;
+        if (type != GL_NONE) {
+            glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachment,
+                                                  GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &bits);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
+        if (bits == 0 && m_stencilQueryBits != 0) {
+            std::cerr << "Portal: framebuffer has no stencil, compositing from the portal texture" << std::endl;
+        }
+        m_stencilQueryFBO = fbo;
+        m_stencilQueryBits = bits;
+    }
+    return m_stencilQueryBits > 0;
+}
+
+void Realtime::drawPortalQuad(GLuint prog, const glm::mat4 &V, const glm::mat4 &P) {
+    glUseProgram(prog);
+    glUniformMatrix4fv(glGetUniformLocation(prog, "u_M"), 1, GL_FALSE, glm::value_ptr(m_portalModel));
+    glUniformMatrix4fv(glGetUniformLocation(prog, "u_V"), 1, GL_FALSE, glm::value_ptr(V));
+    glUniformMatrix4fv(glGetUniformLocation(prog, "u_P"), 1, GL_FALSE, glm::value_ptr(P));
+    glUniform1f(glGetUniformLocation(prog, "u_time"), m_timeSec);
+    glUniform1f(glGetUniformLocation(prog, "u_alpha"), 1.0f);
+    glBindVertexArray(m_portalVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
 void Realtime::createOrResizePortalFBO(int width, int height) {
     if (width <= 0 || height <= 0) return;
     if (m_portalFBO == 0) {
@@ -2467,6 +3768,7 @@ void Realtime::createOrResizePortalFBO(int width, int height) {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     m_portalWidth = width;
     m_portalHeight = height;
+    m_portalRenderedSize = glm::ivec2(0);
 }
 
 void Realtime::releasePortalFBO() {
@@ -2531,6 +3833,99 @@ void Realtime::createOrResizeFullscreenFBO(int width, int height) {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void Realtime::createOrResizeDynResFBO(int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    if (m_dynResFBO == 0) {
+        glGenFramebuffers(1, &m_dynResFBO);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, m_dynResFBO);
+    if (m_dynResColorTex == 0) {
+        glGenTextures(1, &m_dynResColorTex);
+    }
+    glBindTexture(GL_TEXTURE_2D, m_dynResColorTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_dynResColorTex, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Dynamic resolution FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_dynResWidth = width;
+    m_dynResHeight = height;
+}
+
+void Realtime::createOrResizeRainforestTemporal(int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    auto makeTarget = [](GLuint &fbo, GLuint &tex, int w, int h, GLint filter, const char *name) {
+        if (fbo == 0) glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        if (tex == 0) glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << name << " FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+        }
+    };
+    // Checkerboard needs (w/2, h), interleaved only (w/2, h/2)
+    makeTarget(m_iqSparseFBO, m_iqSparseTex, (width + 1) / 2, height, GL_NEAREST, "Rainforest sparse");
+    for (int i = 0; i < 2; ++i) {
+        makeTarget(m_iqHistoryFBO[i], m_iqHistoryTex[i], width, height, GL_LINEAR, "Rainforest history");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_iqHistoryValid = false;
+}
+
+void Realtime::createOrResizeRainforestCoarse(int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    if (m_iqCoarseFBO == 0) glGenFramebuffers(1, &m_iqCoarseFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_iqCoarseFBO);
+    if (m_iqCoarseTex == 0) glGenTextures(1, &m_iqCoarseTex);
+    glBindTexture(GL_TEXTURE_2D, m_iqCoarseTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, (width + kIqCoarseTile - 1) / kIqCoarseTile,
+                 (height + kIqCoarseTile - 1) / kIqCoarseTile, 0, GL_RED, GL_FLOAT, nullptr);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_iqCoarseTex, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Rainforest coarse FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Realtime::releaseRainforestCoarse() {
+    if (m_iqCoarseTex) { glDeleteTextures(1, &m_iqCoarseTex); m_iqCoarseTex = 0; }
+    if (m_iqCoarseFBO) { glDeleteFramebuffers(1, &m_iqCoarseFBO); m_iqCoarseFBO = 0; }
+}
+
+void Realtime::releaseRainforestTemporal() {
+    if (m_iqSparseTex) { glDeleteTextures(1, &m_iqSparseTex); m_iqSparseTex = 0; }
+    if (m_iqSparseFBO) { glDeleteFramebuffers(1, &m_iqSparseFBO); m_iqSparseFBO = 0; }
+    for (int i = 0; i < 2; ++i) {
+        if (m_iqHistoryTex[i]) { glDeleteTextures(1, &m_iqHistoryTex[i]); m_iqHistoryTex[i] = 0; }
+        if (m_iqHistoryFBO[i]) { glDeleteFramebuffers(1, &m_iqHistoryFBO[i]); m_iqHistoryFBO[i] = 0; }
+    }
+    m_iqHistoryValid = false;
+}
+
+void Realtime::releaseDynResFBO() {
+    if (m_dynResColorTex) { glDeleteTextures(1, &m_dynResColorTex); m_dynResColorTex = 0; }
+    if (m_dynResFBO) { glDeleteFramebuffers(1, &m_dynResFBO); m_dynResFBO = 0; }
+    m_dynResWidth = m_dynResHeight = 0;
+}
+
 void Realtime::releaseFullscreenFBO() {
     if (m_fullscreenColorTex) { glDeleteTextures(1, &m_fullscreenColorTex); m_fullscreenColorTex = 0; }
     if (m_fullscreenFBO) { glDeleteFramebuffers(1, &m_fullscreenFBO); m_fullscreenFBO = 0; }
@@ -17,6 +17,19 @@
 #include <vector>
 #include "utils/sceneparser.h"
 #include "utils/Camera.h"
+#include "utils/LightClusterer.h"
+#include "utils/ShaderCache.h"
+#include "utils/ProgramBinaryCache.h"
+#include "utils/TextureStreamer.h"
+#include "utils/RenderGraph.h"
+#include "utils/DynamicResolution.h"
+#include "utils/TerrainCache.h"
+#include "utils/CloudCache.h"
+#include "utils/QualitySelector.h"
+#include "utils/WaveCache.h"
+
+enum class QualityTier;   // settings.h
+enum class FullscreenScene; // settings.h
 
 enum class SceneRenderMode {
     FullscreenProcedural,
@@ -84,6 +97,8 @@ private:
         // Texture mapping
         bool hasTexture = false;
         GLuint texture = 0;
+        GLuint textureArray = 0;        // set once the texture is packed into a shared array
+        int textureLayer = 0;
         glm::vec2 texRepeat = glm::vec2(1.f);
         float blend = 1.f;
         // Planet scene
@@ -101,9 +116,37 @@ private:
 
         glm::vec3 planetColorA; //light band color
         glm::vec3 planetColorB; //dark band color
+
+        // Object-space bounds of the vertex range (shadow fitting)
+        glm::vec3 boundsMin = glm::vec3(0.f);
+        glm::vec3 boundsMax = glm::vec3(0.f);
     };
 
-    GLuint m_prog = 0;
+    // default.vert/.frag permutation bits; each set compiles to its own branch-free program
+    enum GeometryFeature : uint32_t {
+        GF_Planet        = 1u << 0,
+        GF_Sand          = 1u << 1,
+        GF_Moon          = 1u << 2,
+        GF_FloatingCube  = 1u << 3,
+        GF_Texture       = 1u << 4,
+        GF_Shadows       = 1u << 5,
+        GF_Deferred      = 1u << 6,
+        GF_ShadowFilterShift = 7,       // 2 bits: ShadowFilter value when GF_Shadows is set
+        GF_TextureArray  = 1u << 9      // with GF_Texture: sample a layer of a packed array
+    };
+    ShaderCache m_shaderCache;
+    ProgramBinaryCache m_programBinaryCache;
+    uint32_t drawFeatures(const DrawItem &d) const;
+    uint32_t frameGeometryFeatures() const;          // deferred/shadow bits shared by every draw
+    // 'wait' = false returns 0 while the permutation is still compiling
+    GLuint geometryProgram(uint32_t features, bool wait = true);
+    // Points the program slots at whatever has finished compiling (never blocks)
+    // and returns true once everything 'mode' cannot draw without is linked
+    bool requestPrograms(SceneRenderMode mode);
+    void renderPlaceholder();
+    GLuint m_placeholderProg = 0;       // compiled up front; drawn until the real programs are ready
+    QElapsedTimer m_shaderTimer;
+    bool m_shadersReported = false;
     GLuint m_vao = 0;
     GLuint m_vbo = 0;
     GLsizei m_vertexCount = 0;
@@ -111,8 +154,12 @@ private:
     RenderData m_render;
     Camera m_camera;
     Camera m_cameraWater;                                // Independent camera for Water scene
-    // Cache for textures by absolute file path
-    std::unordered_map<std::string, GLuint> m_textureCache;
+    // Image textures by file path, decoded off the GL thread and streamed in
+    TextureStreamer m_textureStreamer;
+    static constexpr size_t kTextureUploadBudget = 16u << 20;   // bytes per frame
+    int m_textureArrayGeneration = -1;
+    int m_loggedTextureEvictions = 0;
+    void assignTextureArrays();         // points draws at their packed array layers
     // LOD rebuild tracking
     glm::vec3 m_lastLodCamPos = glm::vec3(0.f);
     bool m_hasLastLodCamPos = false;
@@ -134,25 +181,102 @@ private:
     bool   m_hasShadowLight   = false;
     int    m_shadowLightIndex = -1;
     glm::mat4 m_lightViewProj = glm::mat4(1.0f);
+    float  m_shadowDepthRange = 79.f;   // far - near of the fitted light projection
+    // Sampler objects so the same depth texture can be read raw or with hardware compare
+    GLuint m_shadowSamplerNearest = 0;
+    GLuint m_shadowSamplerCompare = 0;
+    // EVSM moments (settings.shadowFilter == EVSM); [0] is mipmapped, [1] is the blur temp
+    GLuint m_evsmFBO          = 0;
+    GLuint m_evsmTex[2]       = {0, 0};
+    int    m_evsmRes          = 1024;
+    GLuint m_evsmMomentsProg  = 0;
+    GLuint m_evsmBlurProg     = 0;
     void makeShadowMapFBO();
     void updateShadowLightSelection();
     void updateLightViewProj();
     void renderShadowMap();
+    void drawWorldBounds(const DrawItem &d, glm::vec3 &outMin, glm::vec3 &outMax) const;
+    void makeEVSMFBO();
+    void releaseEVSMFBO();
+    void filterShadowMoments();
+
+    // Clustered forward lighting: binned on the CPU, read through texture buffers
+    LightClusterer m_lightClusterer;
+    GLuint m_lightDataBuffer    = 0;
+    GLuint m_lightDataTex       = 0;
+    GLuint m_clusterRangeBuffer = 0;
+    GLuint m_clusterRangeTex    = 0;
+    GLuint m_lightIndexBuffer   = 0;
+    GLuint m_lightIndexTex      = 0;
+    GLint  m_maxTextureBufferSize = 65536;
+    void createLightBuffers();
+    void releaseLightBuffers();
+    void uploadLightClusters(const glm::mat4 &V);
+
+    // Deferred shading (settings.deferredShading): default.frag fills albedo/specular
+    // G-buffer targets, then lights are accumulated additively into m_sceneColorTex
+    GLuint m_sceneAlbedoTex     = 0;
+    GLuint m_sceneSpecularTex   = 0;
+    GLuint m_deferredFBO        = 0;  // m_sceneColorTex + own depth/stencil (depth blitted)
+    GLuint m_deferredDepthRBO   = 0;
+    GLuint m_deferredLightProg  = 0;
+    GLuint m_deferredStencilProg = 0;
+    // Unit sphere then unit cone (apex at origin, opening down -y), pos/normal/uv
+    GLuint m_lightVolumeVAO     = 0;
+    GLuint m_lightVolumeVBO     = 0;
+    int    m_lightSphereCount   = 0;
+    int    m_lightConeFirst     = 0;
+    int    m_lightConeCount     = 0;
+    void createLightVolumes();
+    void releaseLightVolumes();
+    void runDeferredLighting(const glm::mat4 &V, const glm::mat4 &P);
 
     // Screen-quad for post-processing
-    GLuint m_postProg = 0;          // DoF
-    GLuint m_postProgMotion = 0;    // Motion blur
+    GLuint m_dofDownsampleProg = 0; // DoF: half-res colour + linear depth
+    GLuint m_dofBlurProg = 0;       // DoF: separable half-res gather
+    GLuint m_dofCompositeProg = 0;  // DoF: bilateral upsample over the sharp scene
+    static constexpr float kDofBlurTaps = 8.f;  // TAPS in dof_blur.frag
+    GLuint m_postProgMotion = 0;    // Motion blur (reconstruction filter)
+    GLuint m_motionTileMaxProg = 0;     // Motion blur: per-tile max velocity
+    GLuint m_motionNeighborMaxProg = 0; // Motion blur: 3x3 dilation of the tiles
+    static constexpr int kMotionTileSize = 20;   // pixels; also the longest streak
+    static constexpr int kMotionMaxSamples = 15; // taps for a full-tile streak
     GLuint m_postProgDepth = 0;     // Depth debug
     GLuint m_postProgIQ = 0;        // Shadertoy rainforest full-screen shader
 	GLuint m_postProgWater = 0;     // Water full-screen shader
-    GLuint m_postProgToon = 0;      // Toon shader
+    GLuint m_postProgUber = 0;      // Fused sky/toon/edges/fog/grade/vignette pass
     GLuint m_postProgDirectional = 0; // Simple screen directional blur (fullscreen IQ sprint)
 
     GLuint m_screenVAO = 0;
     GLuint m_screenVBO = 0;
 
+    // post_uber.frag permutation bits, one program per enabled effect set
+    enum PostFeature : uint32_t {
+        PF_Sky      = 1u << 0,
+        PF_Toon     = 1u << 1,
+        PF_Edges    = 1u << 2,
+        PF_Fog      = 1u << 3,
+        PF_Grade    = 1u << 4,
+        PF_Vignette = 1u << 5
+    };
+    uint32_t m_postUberFeatures = 0;
+    bool m_fogInPost = false;       // forward fog off while the uber pass applies it
+    uint32_t postUberFeatures(bool planet) const;
+    // Non-blocking; 0 while the permutation compiles
+    GLuint postUberProgram(uint32_t features);
+
+    // Post chain: uber -> DoF -> motion blur over the scene targets, built as a
+    // render graph each frame so enabled effects stack through pooled targets.
+    // 'cameraEffects' = false skips DoF, motion blur and the depth debug view (portal).
+    RenderGraph m_postGraph;
+    void runPostChain(GLuint outFBO, int outW, int outH, bool cameraEffects);
+
 	// Renders the Planet scene into the portal FBO at portal resolution
 	void renderPlanetIntoPortalFBO();
+	// Renders the Water scene into the portal FBO at m_portalViewport
+	void renderWaterIntoPortalFBO();
+	// Raymarches Water with the Water camera into the bound framebuffer
+	void drawPortalWater(const glm::ivec2 &resolution);
 
     // Portal rendering (Scene B -> texture, composited into Scene A)
     bool   m_portalEnabled = false;
@@ -160,7 +284,23 @@ private:
     GLuint m_portalColorTex = 0;
     int    m_portalWidth = 0;
     int    m_portalHeight = 0;
+    // Part of the portal FBO rendered this frame, sized to the quad's screen footprint
+    glm::ivec2 m_portalViewport = glm::ivec2(0);
+    static constexpr int kPortalMinSize = 16;
+    // Reduced-rate far side (settings.portalHalfRate)
+    int64_t   m_paintIndex = 0;               // paintGL calls so far
+    int64_t   m_portalShownFrame = -1;        // last frame the portal texture was composited
+    bool      m_portalReused = false;         // that frame reused the texture
+    FullscreenScene m_portalFarScene{};        // scene in the texture
+    glm::ivec2 m_portalRenderedSize = glm::ivec2(0);
+    glm::mat4 m_portalFarViewProj = glm::mat4(1.f); // far camera rotation when rendered
+    glm::mat4 m_portalReproject = glm::mat4(1.f);   // current far NDC -> rendered far NDC
     GLuint m_portalProg = 0;    // simple textured quad shader
+    // Stencil path: the far side is drawn in place into the default framebuffer
+    GLuint m_portalMaskProg = 0; // portal.frag with PORTAL_MASK (stencil mark)
+    GLuint m_portalRimProg = 0;  // portal.frag with PORTAL_RIM (additive edge glow)
+    GLuint m_stencilQueryFBO = 0;     // framebuffer m_stencilQueryBits was queried for
+    int    m_stencilQueryBits = -1;   // -1 until queried; reset on resize
     GLuint m_portalVAO = 0;
     GLuint m_portalVBO = 0;
 	glm::mat4 m_portalModel = glm::mat4(1.f); // world transform of the portal quad (XY plane)
@@ -176,11 +316,75 @@ private:
     // Cached framebuffer size for textures
     int m_fbWidth = 0;
     int m_fbHeight = 0;
+    // Lower-left part of the scene targets the geometry pass fills; (0, 0) means all of
+    // them. The portal shrinks it to its footprint while drawing the Planet far side.
+    glm::ivec2 m_sceneViewport = glm::ivec2(0);
+    glm::ivec2 sceneViewport() const {
+        return m_sceneViewport.x > 0 ? m_sceneViewport : glm::ivec2(m_fbWidth, m_fbHeight);
+    }
 
     // Fullscreen offscreen target for IQ when applying sprint blur
     GLuint m_fullscreenFBO = 0;
     GLuint m_fullscreenColorTex = 0;
 
+    // Dynamic resolution for the raymarched fullscreen scenes: they render into the
+    // lower-left scale() fraction of this full-size target, then get upscaled
+    DynamicResolution m_dynamicResolution;
+    GLuint m_dynResFBO = 0;
+    GLuint m_dynResColorTex = 0;
+    int m_dynResWidth = 0;
+    int m_dynResHeight = 0;
+    GLuint m_dynResUpscaleProg = 0;
+    // Water wave field baked once per frame into camera-centred cascades
+    WaveCache m_waveCache;
+    GLuint m_waveBakeProg = 0;        // water.frag with WAVE_BAKE
+    void bakeWaterWaves();
+    void setWaterWaveUniforms(GLuint prog);
+
+    // Quality tier of the fullscreen raymarchers: the selector proposes one from
+    // the same GPU timings, m_renderTier is the one whose programs are linked
+    QualitySelector m_qualitySelector{4};
+    QualityTier m_renderTier = QualityTier(1);   // Medium
+    QualityTier activeQualityTier() const;
+    // Binds the scaled target (or 'destFBO' at native scale) and returns the render size
+    glm::ivec2 beginScaledProcedural(GLuint destFBO, int outW, int outH);
+    // Upscales the scaled target into 'destFBO'; no-op at native scale
+    void resolveScaledProcedural(GLuint destFBO, int outW, int outH, const glm::ivec2 &renderSize);
+
+    // Temporal rainforest: each frame raymarches one checkerboard half (or one
+    // pixel per 2x2 block) into the compact sparse target, then iq_temporal.frag
+    // fills the rest from the reprojected history. Both are RGBA16F with the hit
+    // distance in alpha; the history ping-pongs between two full-size targets.
+    GLuint m_postProgIQTemporal = 0;  // iq_rainforest.frag with TEMPORAL
+    GLuint m_iqResolveProg = 0;       // iq_temporal.frag
+    GLuint m_iqSparseFBO = 0;
+    GLuint m_iqSparseTex = 0;
+    GLuint m_iqHistoryFBO[2] = {0, 0};
+    GLuint m_iqHistoryTex[2] = {0, 0};
+    int m_iqHistoryIndex = 0;         // target written this frame
+    bool m_iqHistoryValid = false;
+    glm::ivec2 m_iqHistorySize = glm::ivec2(0);
+    glm::vec3 m_iqPrevCamPos = glm::vec3(0.f);
+    glm::vec3 m_iqPrevCamTarget = glm::vec3(0.f, 0.f, -1.f);
+    int m_iqPhase = 0;
+    // Coarse depth prepass: R32F, one safe start distance per 8x8 pixel tile
+    // (kCoarseTile in iq_rainforest.frag), read by the COARSE_START permutations
+    static constexpr int kIqCoarseTile = 8;
+    GLuint m_iqCoarseProg = 0;        // iq_rainforest.frag with COARSE_PREPASS
+    GLuint m_iqCoarseFBO = 0;
+    GLuint m_iqCoarseTex = 0;
+    bool m_iqPrepassActive = false;   // the IQ programs in use read the coarse target
+    bool m_iqPortalCull = false;      // skip the raymarch under the portal (u_portalCull)
+    // Baked mid-field heightfield, re-centred on the camera every frame
+    TerrainCache m_terrainCache;
+    GLuint m_terrainBakeProg = 0;     // iq_rainforest.frag with TERRAIN_BAKE
+    // Cloud layer panorama, one band re-rendered per frame
+    CloudCache m_cloudCache;
+    GLuint m_cloudBakeProg = 0;       // iq_rainforest.frag with CLOUD_BAKE
+    // Draws the rainforest into the bound framebuffer at 'renderSize'
+    void drawRainforest(const glm::ivec2 &renderSize);
+    void setRainforestUniforms(GLuint prog, const glm::ivec2 &renderSize);
+
     // Sprint speed accumulation and live speed
     float m_moveSpeedBase = 5.0f;          // base units/sec
     float m_sprintAccum = 0.0f;            // 0..m_sprintAccumMax
@@ -212,9 +416,23 @@ private:
     // Portal helpers
     void createOrResizePortalFBO(int width, int height);
     void releasePortalFBO();
+    // Sizes m_portalViewport from the projected quad; false when it is off screen
+    bool updatePortalViewport(const glm::mat4 &viewProj, int outW, int outH);
+    void setPortalSampling();
+    // Reduced-rate far side: true when it must be re-rendered this frame; otherwise sets
+    // m_portalReproject so the composite reuses last frame's texture
+    bool portalFarSideDue(FullscreenScene farScene, const glm::mat4 &farRotVP);
+    bool framebufferHasStencil(GLuint fbo);
+    void drawPortalQuad(GLuint prog, const glm::mat4 &V, const glm::mat4 &P);
     void createPortalQuad();
     void releasePortalQuad();
     // Fullscreen helpers for IQ sprint blur
     void createOrResizeFullscreenFBO(int width, int height);
     void releaseFullscreenFBO();
+    void createOrResizeDynResFBO(int width, int height);
+    void releaseDynResFBO();
+    void createOrResizeRainforestTemporal(int width, int height);
+    void createOrResizeRainforestCoarse(int width, int height);
+    void releaseRainforestCoarse();
+    void releaseRainforestTemporal();
 };
@@ -11,6 +11,25 @@ enum class FullscreenScene {
     Planet = 3
 };
 
+enum class ShadowFilter {
+    PCF = 0,          // manual 3x3 taps on a nearest-filtered depth map
+    HardwarePCF = 1,  // sampler2DShadow, bilinear comparison per tap
+    EVSM = 2          // blurred + mipmapped exponential variance moments
+};
+
+enum class TemporalMode {
+    Off = 0,          // every pixel raymarched every frame
+    Checkerboard = 1, // half the pixels per frame, alternating checker phase
+    Interleaved = 2   // a quarter per frame, one pixel of each 2x2 block in turn
+};
+
+enum class QualityTier {
+    Low = 0,     // LOWQUALITY, reduced march budgets (integrated GPUs, llvmpipe)
+    Medium = 1,  // LOWQUALITY, the shaders' default budgets
+    High = 2,    // full-quality shading
+    Ultra = 3    // full-quality shading, raised march budgets
+};
+
 struct Settings {
     std::string sceneFilePath;
     int shapeParameter1 = 1;
@@ -30,6 +49,21 @@ struct Settings {
     bool extraCredit3 = false;
     bool extraCredit4 = false;
     bool fogEnabled = false;
+    bool colorGrade = false;
+    bool vignette = false;
+    bool deferredShading = false; // G-buffer + light volumes instead of clustered forward
+    ShadowFilter shadowFilter = ShadowFilter::HardwarePCF;
+    bool dynamicResolution = true; // scale the raymarched scenes to hold the frame-time budget
+    bool autoQuality = true;       // pick the tier below from measured GPU time
+    QualityTier qualityTier = QualityTier::Medium; // fullscreen shader budgets when not automatic
+    bool portalHalfRate = false;        // re-render the portal texture every other frame
+    bool portalStencil = true;          // draw the portal's far side in place under a stencil mark
+    bool waterWaveCache = true;         // water waves from per-frame baked cascades
+    bool rainforestCloudCache = true;   // clouds from a low-rate panoramic cache
+    bool rainforestTerrainCache = true; // baked heightfield for the mid-field terrain
+    bool rainforestPrepass = true; // 1/8-res cone march picks where each rainforest ray starts
+    TemporalMode rainforestTemporal = TemporalMode::Checkerboard; // sparse shading + reprojection
+    int textureBudgetMB = 512;    // GPU texture memory kept resident before LRU eviction
 
     float rainforestIntensity = 1.0f; // 0..1, Rainforest grading strength
 };
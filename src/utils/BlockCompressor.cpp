@@ -0,0 +1,174 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+uint16_t pack565(const float c[3]) {
+    const int r = std::clamp(int(std::lround(c[0] * 31.f / 255.f)), 0, 31);
+    const int g = std::clamp(int(std::lround(c[1] * 63.f / 255.f)), 0, 63);
+    const int b = std::clamp(int(std::lround(c[2] * 31.f / 255.f)), 0, 31);
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void unpack565(uint16_t v, int c[3]) {
+    const int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+}
+
+bool BlockCompressor::hasAlpha(const uint8_t *rgba, int width, int height) {
+    const size_t n = size_t(width) * size_t(height);
+    for (size_t i = 0; i < n; ++i) {
+        if (rgba[i * 4 + 3] != 255) return true;
+    }
+    return false;
+}
+
+void BlockCompressor::fetchBlock(const uint8_t *rgba, int width, int height, int bx, int by,
+                                 uint8_t block[64]) {
+    for (int y = 0; y < 4; ++y) {
+        const int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            const int sx = std::min(bx * 4 + x, width - 1);
+            const uint8_t *p = rgba + (size_t(sy) * width + sx) * 4;
+            std::copy(p, p + 4, block + (y * 4 + x) * 4);
+        }
+    }
+}
+
+void BlockCompressor::colorBlock(const uint8_t block[64], uint8_t out[8]) {
+    // Mean and covariance of the 16 colours
+    float mean[3] = {0.f, 0.f, 0.f};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) mean[c] += block[i * 4 + c];
+    }
+    for (int c = 0; c < 3; ++c) mean[c] /= 16.f;
+
+    float cov[6] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f};   // rr rg rb gg gb bb
+    for (int i = 0; i < 16; ++i) {
+        const float r = block[i * 4 + 0] - mean[0];
+        const float g = block[i * 4 + 1] - mean[1];
+        const float b = block[i * 4 + 2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // Principal axis by power iteration, starting from luminance
+    float axis[3] = {0.299f, 0.587f, 0.114f};
+    for (int it = 0; it < 8; ++it) {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (len < 1e-6f) break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    // Extremes along the axis become the endpoints
+    float minDot = 1e30f, maxDot = -1e30f;
+    int minIdx = 0, maxIdx = 0;
+    for (int i = 0; i < 16; ++i) {
+        const float d = block[i * 4 + 0] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+        if (d < minDot) { minDot = d; minIdx = i; }
+        if (d > maxDot) { maxDot = d; maxIdx = i; }
+    }
+    float hi[3], lo[3];
+    for (int c = 0; c < 3; ++c) {
+        hi[c] = block[maxIdx * 4 + c];
+        lo[c] = block[minIdx * 4 + c];
+    }
+    uint16_t c0 = pack565(hi);
+    uint16_t c1 = pack565(lo);
+
+    uint32_t indices = 0;
+    if (c0 == c1) {
+        // Flat block: every texel takes endpoint 0
+    } else {
+        // c0 > c1 selects the four-colour mode
+        if (c0 < c1) std::swap(c0, c1);
+        int e0[3], e1[3];
+        unpack565(c0, e0);
+        unpack565(c1, e1);
+        int palette[4][3];
+        for (int c = 0; c < 3; ++c) {
+            palette[0][c] = e0[c];
+            palette[1][c] = e1[c];
+            palette[2][c] = (2 * e0[c] + e1[c]) / 3;
+            palette[3][c] = (e0[c] + 2 * e1[c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestErr = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int err = 0;
+                for (int c = 0; c < 3; ++c) {
+                    const int d = int(block[i * 4 + c]) - palette[p][c];
+                    err += d * d;
+                }
+                if (err < bestErr) { bestErr = err; best = p; }
+            }
+            indices |= uint32_t(best) << (2 * i);
+        }
+    }
+
+    out[0] = uint8_t(c0 & 0xFF); out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1 & 0xFF); out[3] = uint8_t(c1 >> 8);
+    for (int b = 0; b < 4; ++b) out[4 + b] = uint8_t(indices >> (8 * b));
+}
+
+void BlockCompressor::alphaBlock(const uint8_t block[64], uint8_t out[8]) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, int(block[i * 4 + 3]));
+        a1 = std::min(a1, int(block[i * 4 + 3]));
+    }
+    out[0] = uint8_t(a0);
+    out[1] = uint8_t(a1);
+
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        // a0 > a1 selects the eight-level ramp
+        int ramp[8] = {a0, a1};
+        for (int k = 1; k < 7; ++k) ramp[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (int i = 0; i < 16; ++i) {
+            const int a = block[i * 4 + 3];
+            int best = 0, bestErr = 1 << 30;
+            for (int p = 0; p < 8; ++p) {
+                const int err = std::abs(a - ramp[p]);
+                if (err < bestErr) { bestErr = err; best = p; }
+            }
+            indices |= uint64_t(best) << (3 * i);
+        }
+    }
+    for (int b = 0; b < 6; ++b) out[2 + b] = uint8_t(indices >> (8 * b));
+}
+
+void BlockCompressor::encodeBC1(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out) {
+    const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+    uint8_t block[64];
+    uint8_t encoded[8];
+    for (int by = 0; by < bh; ++by) {
+        for (int bx = 0; bx < bw; ++bx) {
+            fetchBlock(rgba, width, height, bx, by, block);
+            colorBlock(block, encoded);
+            out.insert(out.end(), encoded, encoded + 8);
+        }
+    }
+}
+
+void BlockCompressor::encodeBC3(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out) {
+    const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+    uint8_t block[64];
+    uint8_t alpha[8], color[8];
+    for (int by = 0; by < bh; ++by) {
+        for (int bx = 0; bx < bw; ++bx) {
+            fetchBlock(rgba, width, height, bx, by, block);
+            alphaBlock(block, alpha);
+            colorBlock(block, color);
+            out.insert(out.end(), alpha, alpha + 8);
+            out.insert(out.end(), color, color + 8);
+        }
+    }
+}
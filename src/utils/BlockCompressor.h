@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU encoder for the S3TC block formats (BC1 = DXT1, BC3 = DXT5). Each 4x4
+// block gets colour endpoints along its principal axis, quantized to 565;
+// BC3 adds an 8-level alpha ramp. Edge blocks of odd-sized levels repeat the
+// last row/column. Quality is below an offline tool but fine for albedo maps.
+class BlockCompressor {
+public:
+    // Bytes needed for a w x h level
+    static size_t bc1Size(int width, int height) { return blockCount(width, height) * 8; }
+    static size_t bc3Size(int width, int height) { return blockCount(width, height) * 16; }
+
+    // 'rgba' is tightly packed RGBA8; blocks are appended to 'out'
+    static void encodeBC1(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out);
+    static void encodeBC3(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out);
+
+    // True if any texel is not fully opaque (chooses BC3 over BC1)
+    static bool hasAlpha(const uint8_t *rgba, int width, int height);
+
+private:
+    static size_t blockCount(int width, int height) {
+        return size_t((width + 3) / 4) * size_t((height + 3) / 4);
+    }
+    static void fetchBlock(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t block[64]);
+    static void colorBlock(const uint8_t block[64], uint8_t out[8]);
+    static void alphaBlock(const uint8_t block[64], uint8_t out[8]);
+};
@@ -0,0 +1,71 @@
+#include "CloudCache.h"
+
+#include <iostream>
+
+namespace {
+void makeTarget(GLuint &tex, GLint internalFormat, GLenum format) {
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, CloudCache::kTexels, CloudCache::kTexels, 0,
+                 format, GL_HALF_FLOAT, nullptr);
+}
+}
+
+void CloudCache::init() {
+    if (m_fbo != 0) return;
+    makeTarget(m_colorTex, GL_RGBA16F, GL_RGBA);
+    makeTarget(m_depthTex, GL_R16F, GL_RED);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_depthTex, 0);
+    const GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, buffers);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Cloud cache FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_valid = false;
+}
+
+void CloudCache::release() {
+    if (m_colorTex) { glDeleteTextures(1, &m_colorTex); m_colorTex = 0; }
+    if (m_depthTex) { glDeleteTextures(1, &m_depthTex); m_depthTex = 0; }
+    if (m_fbo) { glDeleteFramebuffers(1, &m_fbo); m_fbo = 0; }
+    m_valid = false;
+}
+
+void CloudCache::update(const glm::vec3 &camPos, GLuint bakeProg, GLuint screenVAO) {
+    if (m_fbo == 0 || bakeProg == 0 || camPos.y >= kMaxCameraY) return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glBindVertexArray(screenVAO);
+    glUniform1f(glGetUniformLocation(bakeProg, "u_cloudCacheSize"), float(kTexels));
+
+    if (!m_valid || glm::length(camPos - m_centre) > kRecentreDistance) {
+        m_centre = camPos;
+        glUniform3f(glGetUniformLocation(bakeProg, "u_cloudCentre"), m_centre.x, m_centre.y, m_centre.z);
+        renderBands(0, kBands);
+        m_nextBand = 0;
+        m_valid = true;
+        return;
+    }
+    glUniform3f(glGetUniformLocation(bakeProg, "u_cloudCentre"), m_centre.x, m_centre.y, m_centre.z);
+    renderBands(m_nextBand, 1);
+    m_nextBand = (m_nextBand + 1) % kBands;
+}
+
+void CloudCache::renderBands(int first, int count) {
+    constexpr int rows = kTexels / kBands;
+    glViewport(0, first * rows, kTexels, count * rows);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
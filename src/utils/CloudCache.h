@@ -0,0 +1,46 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Low-rate cache of the rainforest cloud layer. The layer is rendered as seen
+// from a fixed centre into a kTexels^2 hemi-octahedral map: RGBA16F colour plus
+// R16F front distance. Each update() re-renders one of kBands row bands, so the
+// whole map refreshes every kBands frames. Cloud cost is then a fixed
+// kTexels^2 / kBands rays per frame, whatever the screen size. The centre
+// follows the camera; moving more than kRecentreDistance away re-renders every
+// band from the new spot.
+class CloudCache {
+public:
+    static constexpr int kTexels = 256;
+    static constexpr int kBands = 8;
+    static constexpr float kRecentreDistance = 100.f;
+    // The map only holds the view from below the layer (y = 600..1200)
+    static constexpr float kMaxCameraY = 600.f;
+
+    // Creates the targets (needs a current GL context)
+    void init();
+    void release();
+    void invalidate() { m_valid = false; }
+
+    // Renders the next band with 'bakeProg' (iq_rainforest.frag with CLOUD_BAKE),
+    // or every band if 'camPos' left the current centre. The caller binds
+    // 'bakeProg' and sets its time/lighting uniforms first. Leaves the FBO and
+    // viewport changed.
+    void update(const glm::vec3 &camPos, GLuint bakeProg, GLuint screenVAO);
+
+    bool valid() const { return m_valid; }
+    GLuint colorTexture() const { return m_colorTex; }
+    GLuint depthTexture() const { return m_depthTex; }
+    const glm::vec3 &centre() const { return m_centre; }
+
+private:
+    void renderBands(int first, int count);
+
+    GLuint m_fbo = 0;
+    GLuint m_colorTex = 0;
+    GLuint m_depthTex = 0;
+    bool m_valid = false;
+    glm::vec3 m_centre = glm::vec3(0.f);
+    int m_nextBand = 0;
+};
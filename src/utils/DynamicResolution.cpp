@@ -0,0 +1,92 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Scale moves in 5% steps so the target size does not change on noise. Each step
+// is about 10% of the pixel count, small enough not to be seen as a pop
+constexpr float kScaleStep = 0.05f;
+}
+
+void DynamicResolution::init() {
+    if (m_queries[0] != 0) return;
+    glGenQueries(kQueries, m_queries);
+    std::fill(m_inFlight, m_inFlight + kQueries, false);
+    m_next = 0;
+}
+
+void DynamicResolution::release() {
+    if (m_queries[0] == 0) return;
+    if (m_measuring) glEndQuery(GL_TIME_ELAPSED);
+    glDeleteQueries(kQueries, m_queries);
+    std::fill(m_queries, m_queries + kQueries, 0u);
+    std::fill(m_inFlight, m_inFlight + kQueries, false);
+    m_measuring = false;
+}
+
+void DynamicResolution::setEnabled(bool enabled) {
+    if (enabled == m_enabled) return;
+    m_enabled = enabled;
+    m_scale = 1.f;
+    m_gpuMs = 0.f;
+    m_settleFrames = kQueries;
+}
+
+void DynamicResolution::beginFrame() {
+    // Timing runs even when disabled; the quality tier selector reads gpuMs()
+    if (m_queries[0] == 0) return;
+
+    const GLuint q = m_queries[m_next];
+    if (m_inFlight[m_next]) {
+        GLint available = 0;
+        glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+        // The GPU is a whole ring behind: skip measuring this frame rather than stall
+        if (!available) return;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+        m_inFlight[m_next] = false;
+        update(float(double(ns) * 1e-6));
+    }
+    glBeginQuery(GL_TIME_ELAPSED, q);
+    m_measuring = true;
+}
+
+void DynamicResolution::endFrame() {
+    if (!m_measuring) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    m_inFlight[m_next] = true;
+    m_next = (m_next + 1) % kQueries;
+    m_measuring = false;
+}
+
+void DynamicResolution::update(float ms) {
+    // Frames queued before the last change were measured at the old scale
+    if (m_settleFrames > 0) {
+        --m_settleFrames;
+        return;
+    }
+    m_gpuMs = (m_gpuMs <= 0.f) ? ms : m_gpuMs + 0.2f * (ms - m_gpuMs);
+    if (!m_enabled) return;
+
+    // Hysteresis: leave the scale alone while 80-100% of the budget is used. The band is
+    // wider than frame-to-frame timer noise, so a steady scene settles on one scale
+    // instead of toggling between two
+    if (m_gpuMs <= m_targetMs && m_gpuMs >= 0.8f * m_targetMs) return;
+
+    // Aim for 90% of the budget (the middle of the band) and move halfway there each
+    // step: the scale^2 cost model ignores fixed per-frame work, so a full jump tends
+    // to overshoot and oscillate
+    const float ideal = m_scale * std::sqrt(0.9f * m_targetMs / std::max(m_gpuMs, 0.01f));
+    float next = m_scale + 0.5f * (ideal - m_scale);
+    next = std::round(next / kScaleStep) * kScaleStep;
+    // Always take at least one step once outside the band
+    if (next == m_scale) next += (m_gpuMs > m_targetMs) ? -kScaleStep : kScaleStep;
+    next = std::clamp(next, kMinScale, kMaxScale);
+    if (next != m_scale) {
+        // Expected time at the new scale, so smoothing restarts close to reality
+        m_gpuMs *= (next * next) / (m_scale * m_scale);
+        m_scale = next;
+        m_settleFrames = kQueries;
+    }
+}
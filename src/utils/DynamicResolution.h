@@ -0,0 +1,50 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Picks a render scale for the fullscreen raymarched scenes from measured GPU
+// time. beginFrame()/endFrame() bracket the work with GL_TIME_ELAPSED queries
+// kept in a small ring. Results are read back a few frames later, so the CPU
+// never waits on the GPU. Shading cost is taken to be proportional to the pixel
+// count (scale^2): the scale moves toward sqrt(target / measured) whenever the
+// smoothed time leaves the band around the target.
+class DynamicResolution {
+public:
+    static constexpr float kMinScale = 0.25f;
+    static constexpr float kMaxScale = 1.0f;
+
+    // Creates the timer queries (needs a current GL context)
+    void init();
+    void release();
+
+    void beginFrame();
+    void endFrame();
+
+    // GPU milliseconds the measured work should fit in
+    void setTargetMs(float ms) { m_targetMs = ms; }
+    // Disabled: scale() is 1 and the history is dropped; timing continues
+    void setEnabled(bool enabled);
+    bool enabled() const { return m_enabled; }
+
+    float scale() const { return m_enabled ? m_scale : 1.f; }
+    // Smoothed GPU time of the measured work (0 until the first result lands)
+    float gpuMs() const { return m_gpuMs; }
+    float targetMs() const { return m_targetMs; }
+    // Measurements since the last scale or enable change have all landed
+    bool settled() const { return m_settleFrames == 0 && m_gpuMs > 0.f; }
+
+private:
+    void update(float ms);
+
+    static constexpr int kQueries = 4;
+    GLuint m_queries[kQueries] = {};
+    bool m_inFlight[kQueries] = {};
+    int m_next = 0;
+    bool m_measuring = false;
+
+    bool m_enabled = true;
+    float m_targetMs = 14.f;
+    float m_scale = 1.f;
+    float m_gpuMs = 0.f;
+    int m_settleFrames = 0;   // results still in flight from before the last change
+};
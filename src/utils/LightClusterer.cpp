@@ -0,0 +1,267 @@
+#include "LightClusterer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <glm/gtc/constants.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIGHTCLUSTER_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LIGHTCLUSTER_NEON 1
+#endif
+
+namespace {
+
+// Below this fraction of its peak a light is treated as contributing nothing
+constexpr float kLightCutoff = 1.f / 256.f;
+
+// Distance where 1 / (c + l*d + q*d^2) * intensity drops to kLightCutoff.
+// Returns a negative value for lights that never fall off (bin globally).
+float lightRange(const SceneLightData &L) {
+    float intensity = std::max(L.color.r, std::max(L.color.g, L.color.b));
+    if (intensity <= 0.f) return 0.f;
+    float c = L.function.x, l = L.function.y, q = L.function.z;
+    float target = intensity / kLightCutoff;
+    if (c >= target) return 0.f;
+    if (q > 1e-6f) {
+        float disc = l * l - 4.f * q * (c - target);
+        return (-l + std::sqrt(std::max(disc, 0.f))) / (2.f * q);
+    }
+    if (l > 1e-6f) {
+        return (target - c) / l;
+    }
+    return -1.f;
+}
+
+// Bit i is set when the sphere (c, r2 = radius^2) touches AABB i0 + i
+inline int sphereAabbMask4(const float *minX, const float *minY, const float *minZ,
+                           const float *maxX, const float *maxY, const float *maxZ,
+                           const glm::vec3 &c, float r2) {
+#if defined(LIGHTCLUSTER_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX), cx),
+                                      _mm_sub_ps(cx, _mm_loadu_ps(maxX))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY), cy),
+                                      _mm_sub_ps(cy, _mm_loadu_ps(maxY))), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minZ), cz),
+                                      _mm_sub_ps(cz, _mm_loadu_ps(maxZ))), zero);
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    return _mm_movemask_ps(_mm_cmple_ps(d2, _mm_set1_ps(r2)));
+#elif defined(LIGHTCLUSTER_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    float32x4_t cx = vdupq_n_f32(c.x), cy = vdupq_n_f32(c.y), cz = vdupq_n_f32(c.z);
+    float32x4_t dx = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(minX), cx),
+                                         vsubq_f32(cx, vld1q_f32(maxX))), zero);
+    float32x4_t dy = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(minY), cy),
+                                         vsubq_f32(cy, vld1q_f32(maxY))), zero);
+    float32x4_t dz = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(minZ), cz),
+                                         vsubq_f32(cz, vld1q_f32(maxZ))), zero);
+    float32x4_t d2 = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+    uint32x4_t le = vcleq_f32(d2, vdupq_n_f32(r2));
+    return int((vgetq_lane_u32(le, 0) & 1u) | (vgetq_lane_u32(le, 1) & 2u) |
+               (vgetq_lane_u32(le, 2) & 4u) | (vgetq_lane_u32(le, 3) & 8u));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        float dx = std::max(std::max(minX[i] - c.x, c.x - maxX[i]), 0.f);
+        float dy = std::max(std::max(minY[i] - c.y, c.y - maxY[i]), 0.f);
+        float dz = std::max(std::max(minZ[i] - c.z, c.z - maxZ[i]), 0.f);
+        if (dx * dx + dy * dy + dz * dz <= r2) mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+}
+
+void LightClusterer::setProjection(float fovYRadians, float aspect, float nearPlane, float farPlane) {
+    if (fovYRadians == m_fovY && aspect == m_aspect && nearPlane == m_near && farPlane == m_far &&
+        !m_minX.empty()) {
+        return;
+    }
+    m_fovY = fovYRadians;
+    m_aspect = aspect;
+    m_near = std::max(nearPlane, 1e-4f);
+    m_far = std::max(farPlane, m_near * 1.001f);
+
+    m_minX.assign(kNumClusters, 0.f); m_minY.assign(kNumClusters, 0.f); m_minZ.assign(kNumClusters, 0.f);
+    m_maxX.assign(kNumClusters, 0.f); m_maxY.assign(kNumClusters, 0.f); m_maxZ.assign(kNumClusters, 0.f);
+    m_clusterSpheres.assign(kNumClusters, glm::vec4(0.f));
+
+    float tanY = std::tan(0.5f * m_fovY);
+    float tanX = tanY * m_aspect;
+    float ratio = m_far / m_near;
+
+    for (int k = 0; k < kGridZ; ++k) {
+        float d0 = m_near * std::pow(ratio, float(k) / kGridZ);
+        float d1 = m_near * std::pow(ratio, float(k + 1) / kGridZ);
+        for (int j = 0; j < kGridY; ++j) {
+            float y0 = -1.f + 2.f * float(j) / kGridY;
+            float y1 = -1.f + 2.f * float(j + 1) / kGridY;
+            for (int i = 0; i < kGridX; ++i) {
+                float x0 = -1.f + 2.f * float(i) / kGridX;
+                float x1 = -1.f + 2.f * float(i + 1) / kGridX;
+
+                // Tile edges scale linearly with distance, so the corners bound the froxel
+                glm::vec3 mn(std::numeric_limits<float>::max());
+                glm::vec3 mx(-std::numeric_limits<float>::max());
+                for (float d : {d0, d1}) {
+                    for (float x : {x0, x1}) {
+                        for (float y : {y0, y1}) {
+                            glm::vec3 p(x * d * tanX, y * d * tanY, -d);
+                            mn = glm::min(mn, p);
+                            mx = glm::max(mx, p);
+                        }
+                    }
+                }
+                int idx = i + kGridX * (j + kGridY * k);
+                m_minX[idx] = mn.x; m_minY[idx] = mn.y; m_minZ[idx] = mn.z;
+                m_maxX[idx] = mx.x; m_maxY[idx] = mx.y; m_maxZ[idx] = mx.z;
+                m_clusterSpheres[idx] = glm::vec4(0.5f * (mn + mx), 0.5f * glm::length(mx - mn));
+            }
+        }
+    }
+}
+
+void LightClusterer::zSliceRange(float zMin, float zMax, int &k0, int &k1) const {
+    float scale = float(kGridZ) / std::log(m_far / m_near);
+    auto slice = [&](float d) {
+        int k = int(std::floor(std::log(std::max(d, m_near) / m_near) * scale));
+        return std::clamp(k, 0, kGridZ - 1);
+    };
+    k0 = slice(zMin);
+    k1 = slice(zMax);
+}
+
+void LightClusterer::binSphere(int lightIndex, const glm::vec3 &center, float radius) {
+    float dMin = -center.z - radius;
+    float dMax = -center.z + radius;
+    if (dMax < m_near || dMin > m_far) return;
+
+    int k0, k1;
+    zSliceRange(dMin, dMax, k0, k1);
+    float r2 = radius * radius;
+    constexpr int sliceSize = kGridX * kGridY;
+    static_assert(sliceSize % 4 == 0, "froxel slices are tested four at a time");
+
+    for (int k = k0; k <= k1; ++k) {
+        for (int i = k * sliceSize; i < (k + 1) * sliceSize; i += 4) {
+            int mask = sphereAabbMask4(&m_minX[i], &m_minY[i], &m_minZ[i],
+                                       &m_maxX[i], &m_maxY[i], &m_maxZ[i], center, r2);
+            while (mask) {
+                int bit = 0;
+                while (!(mask & (1 << bit))) ++bit;
+                mask &= ~(1 << bit);
+                m_pairCluster.push_back(uint32_t(i + bit));
+                m_pairLight.push_back(uint32_t(lightIndex));
+            }
+        }
+    }
+}
+
+void LightClusterer::binSpot(int lightIndex, const glm::vec3 &apex, const glm::vec3 &dir,
+                             float range, float angle) {
+    // Tightest sphere around the cone for the coarse SIMD pass
+    float cosA = std::cos(angle), sinA = std::sin(angle);
+    glm::vec3 center;
+    float radius;
+    if (angle > glm::quarter_pi<float>()) {
+        center = apex + dir * (range * cosA);
+        radius = range * sinA;
+    } else {
+        radius = range / (2.f * cosA * cosA);
+        center = apex + dir * radius;
+    }
+
+    size_t firstPair = m_pairCluster.size();
+    binSphere(lightIndex, center, radius);
+
+    // Refine with a cone vs froxel-sphere test, compacting survivors in place
+    size_t out = firstPair;
+    for (size_t p = firstPair; p < m_pairCluster.size(); ++p) {
+        const glm::vec4 &s = m_clusterSpheres[m_pairCluster[p]];
+        glm::vec3 v = glm::vec3(s) - apex;
+        float lenSq = glm::dot(v, v);
+        float v1Len = glm::dot(v, dir);
+        float distClosest = cosA * std::sqrt(std::max(lenSq - v1Len * v1Len, 0.f)) - v1Len * sinA;
+        bool angleCull = distClosest > s.w;
+        bool frontCull = v1Len > s.w + range;
+        bool backCull = v1Len < -s.w;
+        if (!(angleCull || frontCull || backCull)) {
+            m_pairCluster[out] = m_pairCluster[p];
+            m_pairLight[out] = m_pairLight[p];
+            ++out;
+        }
+    }
+    m_pairCluster.resize(out);
+    m_pairLight.resize(out);
+}
+
+void LightClusterer::build(const std::vector<SceneLightData> &lights, const glm::mat4 &view, int maxIndices) {
+    const int n = static_cast<int>(lights.size());
+    m_lightTexels.resize(size_t(n) * kTexelsPerLight);
+    m_pairCluster.clear();
+    m_pairLight.clear();
+
+    std::vector<uint32_t> globals;
+    for (int i = 0; i < n; ++i) {
+        const SceneLightData &L = lights[i];
+        int type = (L.type == LightType::LIGHT_DIRECTIONAL) ? 0
+                                                            : (L.type == LightType::LIGHT_POINT ? 1 : 2);
+        float range = (type == 0) ? -1.f : lightRange(L);
+        glm::vec3 dir = glm::vec3(L.dir);
+        if (glm::length(dir) > 0.f) dir = glm::normalize(dir);
+
+        glm::vec4 *t = &m_lightTexels[size_t(i) * kTexelsPerLight];
+        t[0] = glm::vec4(glm::vec3(L.pos), float(type));
+        t[1] = glm::vec4(glm::vec3(L.color), range);
+        t[2] = glm::vec4(dir, L.angle);
+        t[3] = glm::vec4(L.function, L.penumbra);
+
+        if (range < 0.f) {
+            globals.push_back(uint32_t(i));
+        } else if (range > 0.f) {
+            glm::vec3 posV = glm::vec3(view * glm::vec4(glm::vec3(L.pos), 1.f));
+            if (type == 2) {
+                glm::vec3 dirV = glm::normalize(glm::vec3(view * glm::vec4(dir, 0.f)));
+                binSpot(i, posV, dirV, range, L.angle);
+            } else {
+                binSphere(i, posV, range);
+            }
+        }
+    }
+
+    m_numGlobalLights = static_cast<int>(globals.size());
+    size_t capacity = size_t(std::max(maxIndices - m_numGlobalLights, 0));
+    if (m_pairCluster.size() > capacity) {
+        std::cerr << "Light clusters: " << m_pairCluster.size()
+                  << " light/froxel pairs exceed the index buffer, dropping "
+                  << (m_pairCluster.size() - capacity) << std::endl;
+        m_pairCluster.resize(capacity);
+        m_pairLight.resize(capacity);
+    }
+
+    // Counting sort of (cluster, light) pairs into contiguous per-froxel lists
+    m_clusterRanges.assign(size_t(kNumClusters) * 2, 0u);
+    for (uint32_t c : m_pairCluster) {
+        m_clusterRanges[size_t(c) * 2 + 1]++;
+    }
+    uint32_t offset = uint32_t(m_numGlobalLights);
+    for (int c = 0; c < kNumClusters; ++c) {
+        m_clusterRanges[size_t(c) * 2] = offset;
+        offset += m_clusterRanges[size_t(c) * 2 + 1];
+    }
+
+    m_lightIndices.resize(offset);
+    std::copy(globals.begin(), globals.end(), m_lightIndices.begin());
+    std::vector<uint32_t> cursor(kNumClusters);
+    for (int c = 0; c < kNumClusters; ++c) cursor[c] = m_clusterRanges[size_t(c) * 2];
+    for (size_t p = 0; p < m_pairCluster.size(); ++p) {
+        m_lightIndices[cursor[m_pairCluster[p]]++] = m_pairLight[p];
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "utils/scenedata.h"
+
+// Clustered forward lighting: splits the view frustum into a grid of froxels
+// (screen tiles x exponential depth slices) and bins every light into the
+// froxels its volume touches. Pure CPU; Realtime uploads the results into
+// texture buffers that default.frag walks per fragment.
+class LightClusterer {
+public:
+    static constexpr int kGridX = 16;
+    static constexpr int kGridY = 9;
+    static constexpr int kGridZ = 24;
+    static constexpr int kNumClusters = kGridX * kGridY * kGridZ;
+    static constexpr int kTexelsPerLight = 4;
+
+    // Rebuilds the view-space froxel bounds when the projection changes
+    void setProjection(float fovYRadians, float aspect, float nearPlane, float farPlane);
+
+    // Bins 'lights' (world space) for a camera with view matrix 'view'.
+    // 'maxIndices' caps the index list to what the texture buffer can hold.
+    void build(const std::vector<SceneLightData> &lights, const glm::mat4 &view, int maxIndices);
+
+    // 4 RGBA32F texels per light, in scene order:
+    //   (pos.xyz, type) (color.rgb, range) (dir.xyz, angle) (function.xyz, penumbra)
+    const std::vector<glm::vec4> &lightTexels() const { return m_lightTexels; }
+    // (offset, count) into lightIndices() per froxel, x-major then y then z
+    const std::vector<uint32_t> &clusterRanges() const { return m_clusterRanges; }
+    // Global lights (directional / unbounded) first, then the per-froxel lists
+    const std::vector<uint32_t> &lightIndices() const { return m_lightIndices; }
+    int numGlobalLights() const { return m_numGlobalLights; }
+
+    float nearPlane() const { return m_near; }
+    float farPlane() const { return m_far; }
+
+private:
+    void binSphere(int lightIndex, const glm::vec3 &center, float radius);
+    void binSpot(int lightIndex, const glm::vec3 &apex, const glm::vec3 &dir,
+                 float range, float angle);
+    void zSliceRange(float zMin, float zMax, int &k0, int &k1) const;
+
+    float m_fovY = 0.f;
+    float m_aspect = 0.f;
+    float m_near = 0.f;
+    float m_far = 0.f;
+
+    // View-space froxel AABBs, structure-of-arrays so four can be tested at once
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+    // Bounding spheres of the froxels (spot cone test)
+    std::vector<glm::vec4> m_clusterSpheres;
+
+    std::vector<glm::vec4> m_lightTexels;
+    std::vector<uint32_t> m_clusterRanges;
+    std::vector<uint32_t> m_lightIndices;
+    int m_numGlobalLights = 0;
+
+    // (cluster, light) pairs gathered during binning, counting-sorted per build
+    std::vector<uint32_t> m_pairCluster;
+    std::vector<uint32_t> m_pairLight;
+};
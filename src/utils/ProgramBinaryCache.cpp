@@ -0,0 +1,115 @@
+#include "ProgramBinaryCache.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+// File layout: magic, GLenum binary format, binary bytes
+const char kMagic[8] = {'T', '4', '2', 'P', 'B', 'I', 'N', '1'};
+
+std::string glString(GLenum name) {
+    const GLubyte *s = glGetString(name);
+    return s ? reinterpret_cast<const char *>(s) : "";
+}
+}
+
+void ProgramBinaryCache::init() {
+    m_enabled = false;
+    if (!GLEW_ARB_get_program_binary && !GLEW_VERSION_4_1) return;
+
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats <= 0) return;
+
+    m_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders";
+    if (!QDir().mkpath(m_dir)) {
+        std::cerr << "Program binary cache: cannot create " << m_dir.toStdString() << std::endl;
+        return;
+    }
+
+    // A driver update changes these, which invalidates every entry
+    m_driverId = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+    m_enabled = true;
+}
+
+std::string ProgramBinaryCache::makeKey(const std::string &vertexCode,
+                                        const std::string &fragmentCode) const {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray(m_driverId.data(), int(m_driverId.size())));
+    hash.addData(QByteArray("\0v", 2));
+    hash.addData(QByteArray(vertexCode.data(), int(vertexCode.size())));
+    hash.addData(QByteArray("\0f", 2));
+    hash.addData(QByteArray(fragmentCode.data(), int(fragmentCode.size())));
+    return hash.result().toHex().toStdString();
+}
+
+QString ProgramBinaryCache::entryPath(const std::string &key) const {
+    return m_dir + "/" + QString::fromStdString(key) + ".bin";
+}
+
+GLuint ProgramBinaryCache::load(const std::string &key) {
+    if (!m_enabled) return 0;
+
+    QFile file(entryPath(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_misses++;
+        return 0;
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    const int headerSize = int(sizeof(kMagic) + sizeof(GLenum));
+    if (data.size() <= headerSize || std::memcmp(data.constData(), kMagic, sizeof(kMagic)) != 0) {
+        QFile::remove(entryPath(key));
+        m_misses++;
+        return 0;
+    }
+    GLenum format;
+    std::memcpy(&format, data.constData() + sizeof(kMagic), sizeof(GLenum));
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, data.constData() + headerSize, data.size() - headerSize);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        // Driver rejected it (format/driver change); recompile and overwrite
+        glDeleteProgram(program);
+        QFile::remove(entryPath(key));
+        m_misses++;
+        return 0;
+    }
+    m_hits++;
+    return program;
+}
+
+void ProgramBinaryCache::store(const std::string &key, GLuint program) {
+    if (!m_enabled) return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) return;
+
+    // Write to a temp file and rename so a crash never leaves a torn entry
+    QSaveFile file(entryPath(key));
+    if (!file.open(QIODevice::WriteOnly)) return;
+    file.write(kMagic, sizeof(kMagic));
+    file.write(reinterpret_cast<const char *>(&format), sizeof(GLenum));
+    file.write(binary.data(), written);
+    if (!file.commit()) {
+        std::cerr << "Program binary cache: failed to write " << entryPath(key).toStdString() << std::endl;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <QString>
+#include <string>
+
+// Stores linked program binaries (ARB_get_program_binary) on disk so later
+// launches can skip compiling. Entries are keyed by a hash of the expanded
+// shader sources and the GL vendor/renderer/version; a binary the driver
+// rejects is deleted and the caller falls back to compiling from source.
+class ProgramBinaryCache {
+public:
+    // Needs a current GL context; disables itself if the driver exposes no binary formats
+    void init();
+    bool enabled() const { return m_enabled; }
+
+    std::string makeKey(const std::string &vertexCode, const std::string &fragmentCode) const;
+
+    // Returns a linked program, or 0 on a miss / rejected binary
+    GLuint load(const std::string &key);
+    void store(const std::string &key, GLuint program);
+
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+
+private:
+    QString entryPath(const std::string &key) const;
+
+    bool m_enabled = false;
+    QString m_dir;
+    std::string m_driverId;
+    int m_hits = 0;
+    int m_misses = 0;
+};
@@ -0,0 +1,23 @@
+#include "QualitySelector.h"
+
+void QualitySelector::reset(int tier) {
+    m_tier = tier;
+    m_holdFrames = kHoldFrames;
+}
+
+int QualitySelector::update(float gpuMs, float targetMs, bool canScaleDown, bool atNativeScale) {
+    if (gpuMs <= 0.f) return m_tier;
+    if (m_holdFrames > 0) {
+        --m_holdFrames;
+        return m_tier;
+    }
+
+    int next = m_tier;
+    if (gpuMs > kDowngradeOver * targetMs && !canScaleDown && m_tier > 0) {
+        next = m_tier - 1;
+    } else if (gpuMs < kUpgradeHeadroom * targetMs && atNativeScale && m_tier + 1 < m_tierCount) {
+        next = m_tier + 1;
+    }
+    if (next != m_tier) reset(next);
+    return m_tier;
+}
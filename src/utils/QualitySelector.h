@@ -0,0 +1,30 @@
+#pragma once
+
+// Picks a shader quality tier (0 = lowest) from measured GPU frame time.
+// Dynamic resolution reacts first. The tier only drops when the frame is over
+// budget and the render scale cannot go lower, and only rises when the frame
+// is at native scale with enough headroom for the next tier's cost. After
+// each change the selector waits kHoldFrames, which gives the new permutation
+// time to compile and new timings time to land.
+class QualitySelector {
+public:
+    static constexpr int kHoldFrames = 90;
+    // Fraction of the budget below which the next tier up is tried. Each tier
+    // costs up to ~1.6x the one below.
+    static constexpr float kUpgradeHeadroom = 0.55f;
+    static constexpr float kDowngradeOver = 1.1f;
+
+    explicit QualitySelector(int tierCount) : m_tierCount(tierCount) {}
+
+    void reset(int tier);
+    // One frame's smoothed GPU time against 'targetMs'. 'canScaleDown' /
+    // 'atNativeScale' describe the dynamic resolution state. Returns the tier.
+    int update(float gpuMs, float targetMs, bool canScaleDown, bool atNativeScale);
+
+    int tier() const { return m_tier; }
+
+private:
+    int m_tierCount;
+    int m_tier = 1;
+    int m_holdFrames = kHoldFrames;
+};
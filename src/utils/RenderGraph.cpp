@@ -0,0 +1,196 @@
+#include "RenderGraph.h"
+
+#include <iostream>
+
+RenderGraph::Resource RenderGraph::importTexture(const std::string &name, GLuint texture,
+                                                 int width, int height) {
+    ResourceNode r;
+    r.name = name;
+    r.kind = Kind::ImportedTexture;
+    r.width = width;
+    r.height = height;
+    r.texture = texture;
+    m_resources.push_back(r);
+    return Resource(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importFramebuffer(const std::string &name, GLuint framebuffer,
+                                                     int width, int height) {
+    ResourceNode r;
+    r.name = name;
+    r.kind = Kind::ImportedFramebuffer;
+    r.width = width;
+    r.height = height;
+    r.framebuffer = framebuffer;
+    m_resources.push_back(r);
+    return Resource(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createTarget(const std::string &name, int width, int height,
+                                                GLenum internalFormat) {
+    ResourceNode r;
+    r.name = name;
+    r.kind = Kind::Transient;
+    r.width = width;
+    r.height = height;
+    r.format = internalFormat;
+    m_resources.push_back(r);
+    return Resource(m_resources.size() - 1);
+}
+
+void RenderGraph::addPass(const std::string &name, std::vector<Resource> reads, Resource write,
+                          Execute execute) {
+    if (m_resources[write].kind == Kind::ImportedTexture || m_resources[write].writer >= 0) {
+        std::cerr << "RenderGraph: pass " << name << " cannot write " << m_resources[write].name << std::endl;
+        return;
+    }
+    m_resources[write].writer = int(m_passes.size());
+    m_passes.push_back({name, std::move(reads), write, std::move(execute)});
+}
+
+std::vector<int> RenderGraph::sortPasses() const {
+    // Kahn's algorithm over "reads a resource another pass writes"; picking the
+    // lowest ready index keeps declaration order wherever it is already valid
+    const int n = int(m_passes.size());
+    std::vector<int> pendingInputs(n, 0);
+    std::vector<std::vector<int>> consumers(n);
+    for (int p = 0; p < n; ++p) {
+        for (Resource r : m_passes[p].reads) {
+            const int w = m_resources[r].writer;
+            if (w >= 0) {
+                ++pendingInputs[p];
+                consumers[w].push_back(p);
+            }
+        }
+    }
+
+    std::vector<int> order;
+    std::vector<bool> done(n, false);
+    while (int(order.size()) < n) {
+        int next = -1;
+        for (int p = 0; p < n; ++p) {
+            if (!done[p] && pendingInputs[p] == 0) {
+                next = p;
+                break;
+            }
+        }
+        if (next < 0) {
+            std::cerr << "RenderGraph: dependency cycle, dropping remaining passes" << std::endl;
+            break;
+        }
+        done[next] = true;
+        order.push_back(next);
+        for (int c : consumers[next]) --pendingInputs[c];
+    }
+    return order;
+}
+
+int RenderGraph::acquire(const ResourceNode &r) {
+    for (int i = 0; i < int(m_pool.size()); ++i) {
+        PoolEntry &e = m_pool[i];
+        if (!e.inUse && e.width == r.width && e.height == r.height && e.format == r.format) {
+            e.inUse = true;
+            return i;
+        }
+    }
+
+    PoolEntry e;
+    e.width = r.width;
+    e.height = r.height;
+    e.format = r.format;
+    e.inUse = true;
+    glGenTextures(1, &e.texture);
+    glBindTexture(GL_TEXTURE_2D, e.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GLint(e.format), e.width, e.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &e.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, e.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, e.texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "RenderGraph: incomplete target " << r.name << std::endl;
+    }
+    m_pool.push_back(e);
+    return int(m_pool.size()) - 1;
+}
+
+void RenderGraph::execute() {
+    const std::vector<int> order = sortPasses();
+
+    // Cull: walk back from the passes that write imported framebuffers
+    std::vector<bool> live(m_passes.size(), false);
+    std::vector<int> stack;
+    for (int p : order) {
+        if (m_resources[m_passes[p].write].kind == Kind::ImportedFramebuffer) {
+            live[p] = true;
+            stack.push_back(p);
+        }
+    }
+    while (!stack.empty()) {
+        const int p = stack.back();
+        stack.pop_back();
+        for (Resource r : m_passes[p].reads) {
+            const int w = m_resources[r].writer;
+            if (w >= 0 && !live[w]) {
+                live[w] = true;
+                stack.push_back(w);
+            }
+        }
+    }
+
+    // Last position (in execution order) at which each resource is read
+    std::vector<int> lastRead(m_resources.size(), -1);
+    for (int i = 0; i < int(order.size()); ++i) {
+        if (!live[order[i]]) continue;
+        for (Resource r : m_passes[order[i]].reads) lastRead[r] = i;
+    }
+
+    for (auto &e : m_pool) e.inUse = false;
+    std::vector<int> poolIndex(m_resources.size(), -1);
+
+    GLint prevFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
+
+    m_passesRun = 0;
+    m_passesCulled = 0;
+    for (int i = 0; i < int(order.size()); ++i) {
+        const PassNode &pass = m_passes[order[i]];
+        if (!live[order[i]]) {
+            ++m_passesCulled;
+            continue;
+        }
+
+        ResourceNode &out = m_resources[pass.write];
+        if (out.kind == Kind::Transient) {
+            poolIndex[pass.write] = acquire(out);
+            out.texture = m_pool[poolIndex[pass.write]].texture;
+            out.framebuffer = m_pool[poolIndex[pass.write]].framebuffer;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, out.framebuffer);
+        glViewport(0, 0, out.width, out.height);
+        pass.execute(*this);
+        ++m_passesRun;
+
+        // Targets read for the last time go back to the pool for later passes
+        for (Resource r : pass.reads) {
+            if (lastRead[r] == i && poolIndex[r] >= 0) m_pool[poolIndex[r]].inUse = false;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFBO));
+    m_passes.clear();
+    m_resources.clear();
+}
+
+void RenderGraph::releaseTargets() {
+    for (auto &e : m_pool) {
+        glDeleteFramebuffers(1, &e.framebuffer);
+        glDeleteTextures(1, &e.texture);
+    }
+    m_pool.clear();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal frame graph for fullscreen passes. Each frame the caller imports the
+// textures it already owns (scene colour, depth, ...) and the framebuffer to
+// present into, declares transient targets, and adds passes with the
+// resources they read and the one they write. execute() then
+//   - orders passes by their dependencies (declaration order breaks ties),
+//   - culls passes whose result never reaches an imported framebuffer,
+//   - gives each transient target a pooled texture for just the span between
+//     its writer and last reader, so targets whose lifetimes do not overlap
+//     alias the same memory (a linear chain ping-pongs between two),
+//   - and runs the surviving passes with their output bound and sized.
+// Pooled textures persist across frames; releaseTargets() frees them.
+class RenderGraph {
+public:
+    using Resource = int;
+
+    // Called with the output framebuffer bound and the viewport set
+    using Execute = std::function<void(const RenderGraph &graph)>;
+
+    Resource importTexture(const std::string &name, GLuint texture, int width, int height);
+    Resource importFramebuffer(const std::string &name, GLuint framebuffer, int width, int height);
+    Resource createTarget(const std::string &name, int width, int height, GLenum internalFormat);
+
+    void addPass(const std::string &name, std::vector<Resource> reads, Resource write, Execute execute);
+
+    // Compiles and runs everything added since the last execute(), then clears the graph
+    void execute();
+
+    // Texture backing 'resource' while its pass runs (imported or pooled)
+    GLuint texture(Resource resource) const { return m_resources[resource].texture; }
+
+    // Deletes the pooled targets (needs the GL context)
+    void releaseTargets();
+
+    // From the last execute()
+    int passesRun() const { return m_passesRun; }
+    int passesCulled() const { return m_passesCulled; }
+    size_t pooledTargets() const { return m_pool.size(); }
+
+private:
+    enum class Kind { ImportedTexture, ImportedFramebuffer, Transient };
+    struct ResourceNode {
+        std::string name;
+        Kind kind = Kind::Transient;
+        int width = 0;
+        int height = 0;
+        GLenum format = GL_RGBA8;
+        GLuint texture = 0;         // imported, or assigned from the pool
+        GLuint framebuffer = 0;     // imported, or the pool entry's
+        int writer = -1;            // pass index
+    };
+    struct PassNode {
+        std::string name;
+        std::vector<Resource> reads;
+        Resource write = -1;
+        Execute execute;
+    };
+    struct PoolEntry {
+        int width = 0;
+        int height = 0;
+        GLenum format = GL_RGBA8;
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+        bool inUse = false;
+    };
+
+    std::vector<int> sortPasses() const;
+    int acquire(const ResourceNode &r);
+
+    std::vector<ResourceNode> m_resources;
+    std::vector<PassNode> m_passes;
+    std::vector<PoolEntry> m_pool;
+
+    int m_passesRun = 0;
+    int m_passesCulled = 0;
+};
@@ -0,0 +1,89 @@
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <iostream>
+
+std::string ShaderCache::makeKey(const char *vertexPath, const char *fragmentPath,
+                                 const ShaderDefines &defines) {
+    // Define order does not change the permutation
+    ShaderDefines sorted = defines;
+    std::sort(sorted.begin(), sorted.end());
+    std::string key = std::string(vertexPath) + '|' + fragmentPath;
+    for (const auto &d : sorted) {
+        key += '|';
+        key += d;
+    }
+    return key;
+}
+
+ShaderCache::Entry &ShaderCache::start(const std::string &key, const char *vertexPath,
+                                       const char *fragmentPath, const ShaderDefines &defines) {
+    auto it = m_programs.find(key);
+    if (it != m_programs.end()) return it->second;
+
+    Entry &entry = m_programs[key];
+    try {
+        entry.pending = ShaderLoader::beginShaderProgram(vertexPath, fragmentPath, defines);
+    } catch (const std::exception &e) {
+        std::cerr << "Shader error (" << key << "): " << e.what() << std::endl;
+        entry.done = true;
+    }
+    return entry;
+}
+
+void ShaderCache::finish(const std::string &key, Entry &entry) {
+    try {
+        entry.program = ShaderLoader::finishShaderProgram(entry.pending);
+    } catch (const std::exception &e) {
+        std::cerr << "Shader error (" << key << "): " << e.what() << std::endl;
+        entry.program = 0;
+    }
+    entry.pending = {};
+    entry.done = true;
+}
+
+GLuint ShaderCache::program(const char *vertexPath, const char *fragmentPath,
+                            const ShaderDefines &defines) {
+    const std::string key = makeKey(vertexPath, fragmentPath, defines);
+    Entry &entry = start(key, vertexPath, fragmentPath, defines);
+    if (!entry.done) finish(key, entry);
+    return entry.program;
+}
+
+bool ShaderCache::prefetch(const char *vertexPath, const char *fragmentPath,
+                           const ShaderDefines &defines) {
+    const std::string key = makeKey(vertexPath, fragmentPath, defines);
+    if (m_programs.count(key)) return false;
+    start(key, vertexPath, fragmentPath, defines);
+    return true;
+}
+
+GLuint ShaderCache::tryProgram(const char *vertexPath, const char *fragmentPath,
+                               const ShaderDefines &defines) {
+    const std::string key = makeKey(vertexPath, fragmentPath, defines);
+    Entry &entry = start(key, vertexPath, fragmentPath, defines);
+    if (!entry.done && ShaderLoader::isShaderProgramReady(entry.pending)) finish(key, entry);
+    return entry.program;
+}
+
+size_t ShaderCache::pending() const {
+    size_t n = 0;
+    for (const auto &kv : m_programs) {
+        if (!kv.second.done) ++n;
+    }
+    return n;
+}
+
+void ShaderCache::clear() {
+    for (auto &kv : m_programs) {
+        Entry &e = kv.second;
+        if (!e.done) {
+            glDeleteShader(e.pending.vertexShader);
+            glDeleteShader(e.pending.fragmentShader);
+            glDeleteProgram(e.pending.program);
+        } else if (e.program) {
+            glDeleteProgram(e.program);
+        }
+    }
+    m_programs.clear();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <unordered_map>
+#include "utils/shaderloader.h"
+
+// Linked programs keyed by (vertex file, fragment file, define set), so each
+// shader permutation is compiled once and then shared by every draw that needs it.
+// Programs can also be requested without blocking: prefetch() starts the compile
+// and tryProgram() hands the program out once the driver reports it linked.
+class ShaderCache {
+public:
+    // Returns the program for this permutation, compiling it on first request
+    // (or waiting for a prefetched compile). Errors are logged once and cached as 0.
+    GLuint program(const char *vertexPath, const char *fragmentPath,
+                   const ShaderDefines &defines = {});
+
+    // Starts compiling this permutation if it is not cached yet; true when it did
+    bool prefetch(const char *vertexPath, const char *fragmentPath,
+                  const ShaderDefines &defines = {});
+
+    // Non-blocking: prefetches on first call and returns 0 until the program is
+    // linked and checked. Failed permutations also stay 0.
+    GLuint tryProgram(const char *vertexPath, const char *fragmentPath,
+                      const ShaderDefines &defines = {});
+
+    // Deletes every cached program (needs the GL context current)
+    void clear();
+
+    size_t size() const { return m_programs.size(); }
+    // Programs still compiling on driver threads
+    size_t pending() const;
+
+private:
+    struct Entry {
+        GLuint program = 0;
+        bool done = false;
+        ShaderLoader::PendingProgram pending;
+    };
+
+    static std::string makeKey(const char *vertexPath, const char *fragmentPath,
+                               const ShaderDefines &defines);
+    Entry &start(const std::string &key, const char *vertexPath, const char *fragmentPath,
+                 const ShaderDefines &defines);
+    void finish(const std::string &key, Entry &entry);
+
+    std::unordered_map<std::string, Entry> m_programs;
+};
@@ -0,0 +1,129 @@
+#include "TerrainCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+constexpr float kTileWorld = TerrainCache::kTileTexels * TerrainCache::kSpacing;
+
+int wrapTile(int i) {
+    return ((i % TerrainCache::kTiles) + TerrainCache::kTiles) % TerrainCache::kTiles;
+}
+
+int slotIndex(const glm::ivec2 &tile) {
+    return wrapTile(tile.y) * TerrainCache::kTiles + wrapTile(tile.x);
+}
+}
+
+void TerrainCache::init() {
+    if (m_tex != 0) return;
+    glGenTextures(1, &m_tex);
+    glBindTexture(GL_TEXTURE_2D, m_tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Toroidal addressing
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, kTexels, kTexels, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_tex, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Terrain cache FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    invalidate();
+}
+
+void TerrainCache::release() {
+    if (m_tex) { glDeleteTextures(1, &m_tex); m_tex = 0; }
+    if (m_fbo) { glDeleteFramebuffers(1, &m_fbo); m_fbo = 0; }
+    invalidate();
+}
+
+void TerrainCache::invalidate() {
+    std::fill(m_slotBaked, m_slotBaked + kTiles * kTiles, false);
+    m_tileMask = 0;
+}
+
+void TerrainCache::update(const glm::vec2 &camXZ, GLuint bakeProg, GLuint screenVAO) {
+    m_tilesBaked = 0;
+    if (m_fbo == 0 || bakeProg == 0) return;
+
+    // Window of kTiles^2 tiles whose centre is the tile corner nearest the camera
+    const glm::ivec2 origin(int(std::lround(camXZ.x / kTileWorld)) - kTiles / 2,
+                            int(std::lround(camXZ.y / kTileWorld)) - kTiles / 2);
+    const uint64_t allTiles = ~uint64_t(0);
+    if (origin == m_originTile && m_tileMask == allTiles) return;
+    m_originTile = origin;
+
+    // Tiles of the window whose slot still holds another tile (or nothing)
+    std::vector<glm::ivec2> missing;
+    for (int tz = origin.y; tz < origin.y + kTiles; ++tz) {
+        for (int tx = origin.x; tx < origin.x + kTiles; ++tx) {
+            const glm::ivec2 tile(tx, tz);
+            const int slot = slotIndex(tile);
+            if (!m_slotBaked[slot] || m_slotTile[slot] != tile) missing.push_back(tile);
+        }
+    }
+    // Nearest the camera first: that is where the fog hides the analytic fallback least
+    const glm::vec2 camTile = camXZ / kTileWorld - 0.5f;
+    std::sort(missing.begin(), missing.end(), [&](const glm::ivec2 &a, const glm::ivec2 &b) {
+        const glm::vec2 da = glm::vec2(a) - camTile, db = glm::vec2(b) - camTile;
+        return glm::dot(da, da) < glm::dot(db, db);
+    });
+
+    if (!missing.empty()) {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glUseProgram(bakeProg);
+        glBindVertexArray(screenVAO);
+        glUniform1f(glGetUniformLocation(bakeProg, "u_bakeSpacing"), kSpacing);
+        const int count = std::min(int(missing.size()), kMaxTilesPerFrame);
+        for (int i = 0; i < count; ++i) {
+            bakeTile(missing[i], bakeProg);
+            const int slot = slotIndex(missing[i]);
+            m_slotTile[slot] = missing[i];
+            m_slotBaked[slot] = true;
+        }
+    }
+
+    m_tileMask = 0;
+    for (int lz = 0; lz < kTiles; ++lz) {
+        for (int lx = 0; lx < kTiles; ++lx) {
+            const glm::ivec2 tile = origin + glm::ivec2(lx, lz);
+            const int slot = slotIndex(tile);
+            if (m_slotBaked[slot] && m_slotTile[slot] == tile) {
+                m_tileMask |= uint64_t(1) << (lz * kTiles + lx);
+            }
+        }
+    }
+}
+
+void TerrainCache::bakeTile(const glm::ivec2 &tile, GLuint bakeProg) {
+    const glm::ivec2 slotPx(wrapTile(tile.x) * kTileTexels, wrapTile(tile.y) * kTileTexels);
+    glViewport(slotPx.x, slotPx.y, kTileTexels, kTileTexels);
+    // world = origin + gl_FragCoord * spacing lands on texel centres of this tile
+    const glm::vec2 origin = glm::vec2(tile) * kTileWorld - glm::vec2(slotPx) * kSpacing;
+    glUniform2f(glGetUniformLocation(bakeProg, "u_bakeOrigin"), origin.x, origin.y);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    ++m_tilesBaked;
+}
+
+glm::vec4 TerrainCache::window() const {
+    // One texel in from the edge so bilinear lookups never mix in a stale slot
+    const glm::vec2 lo = glm::vec2(m_originTile) * kTileWorld + kSpacing;
+    const glm::vec2 hi = glm::vec2(m_originTile + kTiles) * kTileWorld - kSpacing;
+    return glm::vec4(lo.x, lo.y, hi.x, hi.y);
+}
+
+glm::vec4 TerrainCache::tileGrid() const {
+    const glm::vec2 lo = glm::vec2(m_originTile) * kTileWorld;
+    return glm::vec4(lo.x, lo.y, 1.f / kTileWorld, kSpacing / kTileWorld);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Baked rainforest heightfield around the camera. A kTexels^2 RGBA32F texture
+// holds (height, normal.x, normal.z, steep flag) every kSpacing world units. It
+// wraps toroidally: texel i always stores world texel index i mod kTexels, so
+// the shader samples it with GL_REPEAT at world / (kTexels * kSpacing). When
+// the camera crosses a tile boundary, only the tiles that entered the window
+// are baked, nearest the camera first and at most kMaxTilesPerFrame a frame, so
+// a first bake or a teleport is spread over several frames instead of spiking
+// one. tileMask() tells the shader which tiles of the window are in their slot;
+// it keeps the analytic terrain for the others.
+class TerrainCache {
+public:
+    static constexpr int kTileTexels = 128;
+    static constexpr int kTiles = 8;                       // per axis
+    static constexpr int kTexels = kTileTexels * kTiles;
+    static constexpr float kSpacing = 4.f;                 // world units per texel
+    static constexpr int kMaxTilesPerFrame = 4;
+
+    // Creates the texture and its FBO (needs a current GL context)
+    void init();
+    void release();
+    // Forces a full (rate-limited) bake starting with the next update()
+    void invalidate();
+
+    // Recentres the window on 'camXZ' and bakes up to kMaxTilesPerFrame of the
+    // tiles not yet in their slot with 'bakeProg' (iq_rainforest.frag with
+    // TERRAIN_BAKE). Leaves the FBO and viewport changed when it bakes.
+    void update(const glm::vec2 &camXZ, GLuint bakeProg, GLuint screenVAO);
+
+    // At least one tile of the window is baked
+    bool valid() const { return m_tileMask != 0; }
+    GLuint texture() const { return m_tex; }
+    // World-space (minX, minZ, maxX, maxZ) that bilinear lookups can use
+    glm::vec4 window() const;
+    // (window min corner x, z, 1 / tile size, texel size / tile size) for tile lookups
+    glm::vec4 tileGrid() const;
+    // Baked tiles of the window, bit row * kTiles + column (u_terrainTileMask)
+    uint64_t tileMask() const { return m_tileMask; }
+    // Tiles baked by the last update()
+    int tilesBaked() const { return m_tilesBaked; }
+
+private:
+    void bakeTile(const glm::ivec2 &tile, GLuint bakeProg);
+
+    GLuint m_fbo = 0;
+    GLuint m_tex = 0;
+    glm::ivec2 m_originTile = glm::ivec2(0);  // global tile index of the window's min corner
+    // Global tile each slot holds; only meaningful where m_slotBaked is set
+    glm::ivec2 m_slotTile[kTiles * kTiles] = {};
+    bool m_slotBaked[kTiles * kTiles] = {};
+    uint64_t m_tileMask = 0;
+    int m_tilesBaked = 0;
+};
@@ -0,0 +1,498 @@
+#include "TextureStreamer.h"
+#include "BlockCompressor.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+namespace {
+// Baked file layout: magic, GL format, level count, then per level
+// (width, height, byte size) and finally the level data back to back
+const char kMagic[8] = {'T', '4', '2', 'T', 'E', 'X', '0', '1'};
+}
+
+void TextureStreamer::init() {
+    if (m_pbo[0] == 0) glGenBuffers(2, m_pbo);
+
+    m_compress = GLEW_EXT_texture_compression_s3tc;
+    if (m_compress) {
+        m_bakeDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/textures";
+        if (!QDir().mkpath(m_bakeDir)) {
+            // Still compress, just without keeping the result
+            std::cerr << "Texture cache: cannot create " << m_bakeDir.toStdString() << std::endl;
+            m_bakeDir.clear();
+        }
+    }
+    // Leave a core for the UI thread
+    m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+}
+
+void TextureStreamer::setPlaceholder(GLuint texture, int levels) {
+    const uint8_t white[4] = {255, 255, 255, 255};
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    // MAX_LEVEL only stops sampling; the smaller levels keep their storage until redefined empty
+    for (int l = 1; l < levels; ++l) {
+        glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint TextureStreamer::request(const std::string &path, GLenum wrap, bool packable) {
+    auto it = m_textures.find(path);
+    if (it != m_textures.end()) return it->second;
+
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    setPlaceholder(tex);
+
+    m_textures.emplace(path, tex);
+    Record &r = m_records[tex];
+    r.path = path;
+    r.wrap = wrap;
+    r.packable = packable;
+    r.lastUsed = m_frame;
+    load(tex);
+    return tex;
+}
+
+void TextureStreamer::load(GLuint texture) {
+    Record &r = m_records[texture];
+    r.loading = true;
+    ++m_pending;
+    ++m_stats.misses;
+
+    auto job = std::make_shared<Decoded>();
+    job->texture = texture;
+    job->path = r.path;
+    job->wrap = r.wrap;
+    job->packable = r.packable;
+    m_pool.start([this, job]() {
+        decode(*job);
+        QMutexLocker lock(&m_readyMutex);
+        m_ready.push_back(job);
+    });
+}
+
+void TextureStreamer::touch(GLuint texture) {
+    auto it = m_records.find(texture);
+    if (it == m_records.end()) return;
+    Record &r = it->second;
+    r.lastUsed = m_frame;
+
+    auto slot = m_slots.find(texture);
+    if (slot != m_slots.end()) m_arrays[slot->second.texture].lastUsed = m_frame;
+
+    if (r.resident) {
+        ++m_stats.hits;
+    } else if (!r.loading && !r.failed) {
+        // Evicted earlier; the placeholder shows until it streams back in
+        load(texture);
+    }
+}
+
+void TextureStreamer::decode(Decoded &d) const {
+    QFile file(QString::fromStdString(d.path));
+    if (!file.open(QIODevice::ReadOnly)) {
+        d.failed = true;
+        return;
+    }
+    const QByteArray bytes = file.readAll();
+
+    // Same source bytes -> same baked chain, whatever the path
+    QString bakedPath;
+    if (m_compress && !m_bakeDir.isEmpty()) {
+        bakedPath = m_bakeDir + "/" +
+                    QString::fromLatin1(QCryptographicHash::hash(bytes, QCryptographicHash::Sha1).toHex()) + ".tex";
+        if (readBaked(bakedPath, d)) return;
+    }
+
+    QImage img = QImage::fromData(bytes);
+    if (img.isNull()) {
+        d.failed = true;
+        return;
+    }
+    QImage rgba = img.convertToFormat(QImage::Format_RGBA8888);
+
+    // QImage rows may be padded
+    std::vector<uint8_t> base(size_t(rgba.width()) * rgba.height() * 4);
+    for (int y = 0; y < rgba.height(); ++y) {
+        std::memcpy(&base[size_t(y) * rgba.width() * 4], rgba.constScanLine(y), size_t(rgba.width()) * 4);
+    }
+    buildMips(base.data(), rgba.width(), rgba.height(), d);
+
+    if (m_compress) {
+        compress(d);
+        if (!bakedPath.isEmpty()) writeBaked(bakedPath, d);
+    }
+}
+
+void TextureStreamer::buildMips(const uint8_t *rgba, int width, int height, Decoded &d) {
+    // Size the whole chain first so the levels can be written in place
+    int w = width, h = height;
+    size_t total = 0;
+    while (true) {
+        const size_t bytes = size_t(w) * size_t(h) * 4;
+        d.mips.push_back({w, h, total, bytes});
+        total += bytes;
+        if (w == 1 && h == 1) break;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    d.pixels.resize(total);
+    std::memcpy(d.pixels.data(), rgba, d.mips[0].bytes);
+
+    // 2x2 box filter; odd edges reuse the last row/column
+    for (size_t l = 1; l < d.mips.size(); ++l) {
+        const MipLevel &src = d.mips[l - 1];
+        const MipLevel &dst = d.mips[l];
+        const uint8_t *s = &d.pixels[src.offset];
+        uint8_t *o = &d.pixels[dst.offset];
+        for (int y = 0; y < dst.height; ++y) {
+            const int y0 = std::min(2 * y, src.height - 1);
+            const int y1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; ++x) {
+                const int x0 = std::min(2 * x, src.width - 1);
+                const int x1 = std::min(2 * x + 1, src.width - 1);
+                for (int c = 0; c < 4; ++c) {
+                    const int sum = s[(size_t(y0) * src.width + x0) * 4 + c] +
+                                    s[(size_t(y0) * src.width + x1) * 4 + c] +
+                                    s[(size_t(y1) * src.width + x0) * 4 + c] +
+                                    s[(size_t(y1) * src.width + x1) * 4 + c];
+                    o[(size_t(y) * dst.width + x) * 4 + c] = uint8_t((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+void TextureStreamer::compress(Decoded &d) {
+    const MipLevel &base = d.mips[0];
+    const bool alpha = BlockCompressor::hasAlpha(&d.pixels[base.offset], base.width, base.height);
+    d.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    std::vector<uint8_t> blocks;
+    for (MipLevel &m : d.mips) {
+        const size_t offset = blocks.size();
+        const uint8_t *level = &d.pixels[m.offset];
+        if (alpha) {
+            BlockCompressor::encodeBC3(level, m.width, m.height, blocks);
+        } else {
+            BlockCompressor::encodeBC1(level, m.width, m.height, blocks);
+        }
+        m.offset = offset;
+        m.bytes = blocks.size() - offset;
+    }
+    d.pixels.swap(blocks);
+}
+
+bool TextureStreamer::readBaked(const QString &path, Decoded &d) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    const QByteArray data = file.readAll();
+
+    const char *p = data.constData();
+    const char *end = p + data.size();
+    auto read32 = [&](uint32_t &v) {
+        if (end - p < 4) return false;
+        std::memcpy(&v, p, 4);
+        p += 4;
+        return true;
+    };
+
+    if (data.size() < int(sizeof(kMagic)) || std::memcmp(p, kMagic, sizeof(kMagic)) != 0) return false;
+    p += sizeof(kMagic);
+    uint32_t format = 0, levels = 0;
+    if (!read32(format) || !read32(levels) || levels == 0 || levels > 32) return false;
+
+    std::vector<MipLevel> mips(levels);
+    size_t total = 0;
+    for (MipLevel &m : mips) {
+        uint32_t w = 0, h = 0, bytes = 0;
+        if (!read32(w) || !read32(h) || !read32(bytes)) return false;
+        m.width = int(w);
+        m.height = int(h);
+        m.offset = total;
+        m.bytes = bytes;
+        total += bytes;
+    }
+    if (size_t(end - p) != total) return false;
+
+    d.format = GLenum(format);
+    d.mips.swap(mips);
+    d.pixels.assign(reinterpret_cast<const uint8_t *>(p), reinterpret_cast<const uint8_t *>(end));
+    return true;
+}
+
+void TextureStreamer::writeBaked(const QString &path, const Decoded &d) {
+    QByteArray data(kMagic, int(sizeof(kMagic)));
+    auto write32 = [&](uint32_t v) { data.append(reinterpret_cast<const char *>(&v), 4); };
+    write32(uint32_t(d.format));
+    write32(uint32_t(d.mips.size()));
+    for (const MipLevel &m : d.mips) {
+        write32(uint32_t(m.width));
+        write32(uint32_t(m.height));
+        write32(uint32_t(m.bytes));
+    }
+    data.append(reinterpret_cast<const char *>(d.pixels.data()), int(d.pixels.size()));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        std::cerr << "Texture cache: failed to write " << path.toStdString() << std::endl;
+    }
+}
+
+bool TextureStreamer::upload(const Decoded &d) {
+    // Orphan the buffer, copy every level in, then source the texture from it
+    const GLuint pbo = m_pbo[m_nextPbo];
+    m_nextPbo = (m_nextPbo + 1) % 2;
+    const GLsizeiptr bytes = GLsizeiptr(d.pixels.size());
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        std::cerr << "Failed to map texture upload buffer: " << d.path << std::endl;
+        return false;
+    }
+    std::memcpy(dst, d.pixels.data(), d.pixels.size());
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, d.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t l = 0; l < d.mips.size(); ++l) {
+        const MipLevel &m = d.mips[l];
+        const void *src = reinterpret_cast<const void *>(m.offset);
+        if (d.format == GL_RGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, GLint(l), GL_RGBA8, m.width, m.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+        } else {
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(l), d.format, m.width, m.height, 0,
+                                   GLsizei(m.bytes), src);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(d.mips.size()) - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // Other uploads in the renderer pass client pointers
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+void TextureStreamer::pump(size_t byteBudget) {
+    ++m_frame;
+
+    std::vector<std::shared_ptr<Decoded>> batch;
+    {
+        QMutexLocker lock(&m_readyMutex);
+        batch.swap(m_ready);
+    }
+
+    size_t spent = 0;
+    size_t i = 0;
+    for (; i < batch.size(); ++i) {
+        const Decoded &d = *batch[i];
+        if (i > 0 && spent + d.pixels.size() > byteBudget) break;
+        --m_pending;
+        Record &r = m_records[d.texture];
+        r.loading = false;
+        if (d.failed) {
+            r.failed = true;
+            std::cerr << "Failed to load texture: " << d.path << std::endl;
+            continue;
+        }
+        if (!upload(d)) {
+            // Nothing landed: stay non-resident and uncounted, and retry on the next touch()
+            continue;
+        }
+        r.resident = true;
+        r.bytes = d.pixels.size();
+        r.levels = int(d.mips.size());
+        r.lastUsed = m_frame;
+        m_stats.residentBytes += r.bytes;
+        spent += d.pixels.size();
+        if (d.packable) m_unpacked.push_back(batch[i]);
+    }
+
+    // Over budget: hand the rest back for the next frame
+    if (i < batch.size()) {
+        QMutexLocker lock(&m_readyMutex);
+        m_ready.insert(m_ready.begin(), batch.begin() + i, batch.end());
+    }
+
+    // Pack once a scene's textures have all landed rather than rebuilding per arrival
+    if (m_pending == 0 && !m_unpacked.empty()) packArrays();
+
+    if (m_residentBudget > 0 && m_stats.residentBytes > m_residentBudget) evict();
+}
+
+void TextureStreamer::evict() {
+    // Anything drawn last frame is still in view; never evict that
+    const uint64_t protectFrom = m_frame > 0 ? m_frame - 1 : 0;
+    while (m_stats.residentBytes > m_residentBudget) {
+        // Oldest plain texture or array, whichever was drawn longest ago
+        GLuint victim = 0;
+        bool victimIsArray = false;
+        uint64_t oldest = protectFrom;
+        for (const auto &kv : m_records) {
+            const Record &r = kv.second;
+            if (r.resident && r.bytes > 0 && r.lastUsed < oldest) {
+                oldest = r.lastUsed;
+                victim = kv.first;
+                victimIsArray = false;
+            }
+        }
+        for (const auto &kv : m_arrays) {
+            if (kv.second.lastUsed < oldest) {
+                oldest = kv.second.lastUsed;
+                victim = kv.first;
+                victimIsArray = true;
+            }
+        }
+        if (victim == 0) break;   // everything left is in use
+
+        if (victimIsArray) {
+            const ArrayRecord &a = m_arrays[victim];
+            for (GLuint member : a.members) {
+                m_records[member].resident = false;
+                m_slots.erase(member);
+            }
+            m_stats.residentBytes -= a.bytes;
+            glDeleteTextures(1, &victim);
+            m_arrays.erase(victim);
+            // Draws sampling the array must fall back to their 2D placeholders
+            ++m_arrayGeneration;
+        } else {
+            Record &r = m_records[victim];
+            setPlaceholder(victim, r.levels);
+            m_stats.residentBytes -= r.bytes;
+            r.bytes = 0;
+            r.levels = 0;
+            r.resident = false;
+        }
+        ++m_stats.evictions;
+    }
+}
+
+void TextureStreamer::packArrays() {
+    // Group by everything a layer has to share with its array
+    // Latest upload per texture only; anything evicted since is left out
+    std::map<GLuint, std::shared_ptr<Decoded>> latest;
+    for (auto &d : m_unpacked) latest[d->texture] = d;
+    m_unpacked.clear();
+
+    std::map<std::tuple<GLenum, int, int, size_t, GLenum>, std::vector<std::shared_ptr<Decoded>>> groups;
+    for (auto &kv : latest) {
+        const Decoded &d = *kv.second;
+        const Record &r = m_records[d.texture];
+        if (!r.resident || r.bytes == 0) continue;
+        groups[{d.format, d.mips[0].width, d.mips[0].height, d.mips.size(), d.wrap}].push_back(kv.second);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto &kv : groups) {
+        const auto &members = kv.second;
+        // A lone texture gains nothing from an array
+        if (members.size() < 2) continue;
+
+        const Decoded &first = *members[0];
+        const GLsizei layers = GLsizei(members.size());
+        GLuint array = 0;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, first.wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, first.wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, GLint(first.mips.size()) - 1);
+
+        for (size_t l = 0; l < first.mips.size(); ++l) {
+            const MipLevel &m = first.mips[l];
+            if (first.format == GL_RGBA8) {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(l), GL_RGBA8, m.width, m.height, layers, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            } else {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(l), first.format, m.width, m.height, layers,
+                                       0, GLsizei(m.bytes * layers), nullptr);
+            }
+            for (GLsizei layer = 0; layer < layers; ++layer) {
+                const Decoded &d = *members[layer];
+                const uint8_t *src = &d.pixels[d.mips[l].offset];
+                if (first.format == GL_RGBA8) {
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(l), 0, 0, layer, m.width, m.height, 1,
+                                    GL_RGBA, GL_UNSIGNED_BYTE, src);
+                } else {
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(l), 0, 0, layer, m.width, m.height, 1,
+                                              first.format, GLsizei(d.mips[l].bytes), src);
+                }
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // The 2D copies are no longer sampled; shrink them back to a single texel, every
+        // level included, so the array's bytes are the only copy counted or allocated
+        ArrayRecord &a = m_arrays[array];
+        a.lastUsed = m_frame;
+        for (GLsizei layer = 0; layer < layers; ++layer) {
+            const GLuint tex = members[layer]->texture;
+            Record &r = m_records[tex];
+            m_slots[tex] = {array, int(layer)};
+            a.members.push_back(tex);
+            a.bytes += r.bytes;
+            r.bytes = 0;
+            setPlaceholder(tex, r.levels);
+            r.levels = 0;
+        }
+    }
+    ++m_arrayGeneration;
+}
+
+TextureStreamer::ArraySlot TextureStreamer::arraySlot(GLuint texture) const {
+    auto it = m_slots.find(texture);
+    return it != m_slots.end() ? it->second : ArraySlot{};
+}
+
+bool TextureStreamer::isResident(GLuint texture) const {
+    auto it = m_records.find(texture);
+    return it != m_records.end() && it->second.resident;
+}
+
+void TextureStreamer::clear() {
+    m_pool.clear();
+    m_pool.waitForDone();
+    {
+        QMutexLocker lock(&m_readyMutex);
+        m_ready.clear();
+    }
+    for (auto &kv : m_textures) glDeleteTextures(1, &kv.second);
+    m_textures.clear();
+    m_records.clear();
+    m_pending = 0;
+    for (auto &kv : m_arrays) glDeleteTextures(1, &kv.first);
+    m_arrays.clear();
+    m_slots.clear();
+    m_unpacked.clear();
+    m_stats.residentBytes = 0;
+    ++m_arrayGeneration;
+    if (m_pbo[0]) {
+        glDeleteBuffers(2, m_pbo);
+        m_pbo[0] = m_pbo[1] = 0;
+    }
+}
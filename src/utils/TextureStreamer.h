@@ -0,0 +1,154 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Loads image textures without stalling the GL thread. request() hands out a
+// texture name right away, holding a 1x1 white placeholder; a worker thread
+// decodes the file to RGBA8 and builds the mip chain on the CPU, and pump()
+// later streams the finished levels into that same texture through a
+// pixel-unpack buffer. Draws never need to rebind anything when it lands.
+//
+// With S3TC available the chain is block-compressed (BC1, or BC3 when the
+// image has alpha) and baked to a cache file keyed by the source bytes, so
+// later loads skip both the image decode and the encode.
+//
+// Textures requested as packable are additionally copied into shared
+// GL_TEXTURE_2D_ARRAYs once everything in flight has landed: images with the
+// same size, format, mip count and wrap mode become layers of one array, so
+// draws select a layer instead of rebinding.
+//
+// GPU bytes (all mips) are tracked per texture and per array. Callers touch()
+// what they draw; when the total exceeds the resident budget, the least
+// recently drawn textures drop back to the placeholder and are streamed in
+// again the next time they are touched.
+class TextureStreamer {
+public:
+    struct Stats {
+        size_t residentBytes = 0;
+        int hits = 0;           // touches of resident textures
+        int misses = 0;         // loads started (first request or reload after eviction)
+        int evictions = 0;
+    };
+
+    // Where a packable texture ended up; texture is 0 while it is still a plain 2D texture
+    struct ArraySlot {
+        GLuint texture = 0;
+        int layer = 0;
+    };
+
+    // Needs the GL context current; creates the upload buffers and picks
+    // compressed or RGBA8 storage from the driver's extensions
+    void init();
+
+    // Returns the texture for 'path' (shared between callers), queueing the
+    // decode on first request. 'wrap' applies to both S and T.
+    GLuint request(const std::string &path, GLenum wrap, bool packable = false);
+
+    // GL thread, once per frame: uploads decoded textures until 'byteBudget'
+    // is spent (always at least one, so large images still make progress),
+    // then evicts down to the resident budget
+    void pump(size_t byteBudget);
+
+    // Marks a texture from request() as drawn this frame, reloading it if it was evicted
+    void touch(GLuint texture);
+    // Total GPU bytes to keep resident; 0 disables eviction
+    void setResidentBudget(size_t bytes) { m_residentBudget = bytes; }
+    const Stats &stats() const { return m_stats; }
+
+    // True once the real image has replaced the placeholder
+    bool isResident(GLuint texture) const;
+    // Textures still decoding or waiting for upload
+    int pending() const { return m_pending; }
+
+    // Array layer holding the 2D texture returned by request(), if it has been packed
+    ArraySlot arraySlot(GLuint texture) const;
+    // Bumped whenever pump() packs new arrays, so callers know to refetch their slots
+    int arrayGeneration() const { return m_arrayGeneration; }
+
+    // Waits for the workers, then deletes every texture and buffer (needs the GL context)
+    void clear();
+
+private:
+    struct MipLevel {
+        int width = 0;
+        int height = 0;
+        size_t offset = 0;      // into Decoded::pixels
+        size_t bytes = 0;
+    };
+    struct Decoded {
+        GLuint texture = 0;
+        std::string path;
+        bool failed = false;
+        GLenum format = GL_RGBA8;      // or a compressed S3TC format
+        GLenum wrap = GL_REPEAT;
+        bool packable = false;
+        std::vector<MipLevel> mips;
+        std::vector<uint8_t> pixels;   // every level back to back, tightly packed
+    };
+
+    // Worker thread: reads only state that init() fixed before any request
+    void decode(Decoded &d) const;
+    static void buildMips(const uint8_t *rgba, int width, int height, Decoded &d);
+    static void compress(Decoded &d);
+    static bool readBaked(const QString &path, Decoded &d);
+    static void writeBaked(const QString &path, const Decoded &d);
+    // Per texture name handed out by request()
+    struct Record {
+        std::string path;
+        GLenum wrap = GL_REPEAT;
+        bool packable = false;
+        bool resident = false;      // real image in the 2D texture or its array layer
+        bool loading = false;
+        bool failed = false;
+        size_t bytes = 0;           // bytes of the 2D chain (0 while packed or evicted)
+        int levels = 0;             // mip levels uploaded into the 2D texture
+        uint64_t lastUsed = 0;      // frame of the last touch()
+    };
+    struct ArrayRecord {
+        std::vector<GLuint> members;    // 2D names, in layer order
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    void load(GLuint texture);
+    bool upload(const Decoded &d);  // false if the unpack buffer could not be mapped
+    void packArrays();
+    void evict();
+    // Back to one white texel; levels 1..levels-1 of an uploaded chain are released too
+    static void setPlaceholder(GLuint texture, int levels = 1);
+
+    bool m_compress = false;
+    QString m_bakeDir;
+
+    std::unordered_map<std::string, GLuint> m_textures;
+    std::unordered_map<GLuint, Record> m_records;
+    int m_pending = 0;
+
+    // Uploaded packable textures whose pixels are kept until the next packArrays()
+    std::vector<std::shared_ptr<Decoded>> m_unpacked;
+    std::unordered_map<GLuint, ArraySlot> m_slots;
+    std::unordered_map<GLuint, ArrayRecord> m_arrays;
+    int m_arrayGeneration = 0;
+
+    uint64_t m_frame = 0;
+    size_t m_residentBudget = 0;
+    Stats m_stats;
+
+    // Two upload buffers used in turn so a new upload does not wait on the last one
+    GLuint m_pbo[2] = {0, 0};
+    int m_nextPbo = 0;
+
+    QMutex m_readyMutex;
+    std::vector<std::shared_ptr<Decoded>> m_ready;   // filled by workers, drained by pump()
+
+    // Declared last: destroyed first, so no worker outlives the state above
+    QThreadPool m_pool;
+};
@@ -0,0 +1,69 @@
+#include "WaveCache.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace {
+// Octaves of water.frag's getwaves() a grid of this spacing holds at 3+ texels per
+// wavelength. Octave i has frequency 1.18^i, so wavelength 2*PI / 1.18^i.
+int resolvableOctaves(float spacing) {
+    return int(std::floor(std::log(6.2831853f / (3.f * spacing)) / std::log(1.18f))) + 1;
+}
+}
+
+void WaveCache::init() {
+    if (m_tex != 0) return;
+    glGenTextures(1, &m_tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, kTexels, kTexels, kCascades, 0,
+                 GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_tex, 0, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Wave cache FBO incomplete: 0x" << std::hex << status << std::dec << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_valid = false;
+}
+
+void WaveCache::release() {
+    if (m_tex) { glDeleteTextures(1, &m_tex); m_tex = 0; }
+    if (m_fbo) { glDeleteFramebuffers(1, &m_fbo); m_fbo = 0; }
+    m_valid = false;
+}
+
+void WaveCache::update(const glm::vec2 &camXZ, GLuint bakeProg, GLuint screenVAO) {
+    if (m_fbo == 0 || bakeProg == 0) return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, kTexels, kTexels);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glBindVertexArray(screenVAO);
+    const GLint locOrigin = glGetUniformLocation(bakeProg, "u_bakeOrigin");
+    const GLint locSpacing = glGetUniformLocation(bakeProg, "u_bakeSpacing");
+    const GLint locOctaves = glGetUniformLocation(bakeProg, "u_bakeOctaves");
+
+    float extent = kFinestExtent;
+    for (int i = 0; i < kCascades; ++i, extent *= kCascadeRatio) {
+        const float spacing = extent / float(kTexels);
+        const glm::vec2 origin = glm::floor((camXZ - 0.5f * extent) / spacing) * spacing;
+        m_cascades[i] = glm::vec3(origin, 1.f / extent);
+        m_octaves[i] = resolvableOctaves(spacing);
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_tex, 0, i);
+        glUniform2f(locOrigin, origin.x, origin.y);
+        glUniform1f(locSpacing, spacing);
+        glUniform1i(locOctaves, m_octaves[i]);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    m_valid = true;
+}
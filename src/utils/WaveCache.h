@@ -0,0 +1,48 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Per-frame bake of the water wave field. kCascades square grids of kTexels^2
+// are centred on the camera, each kCascadeRatio times wider than the last, in
+// one RGBA32F texture array. Each cascade is band-limited to the octaves its
+// spacing resolves (3+ texels per wavelength, octaves()). A texel holds the
+// marching height when the cascade resolves all of its octaves, and the partial
+// wave sum with its drag-shifted position after the resolved normal octaves. The
+// water shader resumes the sum from there and evaluates only the finer octaves
+// the cascade cannot hold. Each cascade's origin snaps to its own texel grid so
+// the bake does not swim as the camera moves.
+//
+// With these sizes the cascades resolve 36, 28, 19 and 11 octaves: cascade 0
+// (3 units) holds Low's and Medium's normals outright, and the 8-24 marching
+// octaves of every tier are fully baked in the inner two or three cascades.
+class WaveCache {
+public:
+    static constexpr int kCascades = 4;          // WAVE_CASCADES in water.frag
+    static constexpr int kTexels = 512;
+    static constexpr float kFinestExtent = 3.f;  // world units across cascade 0
+    static constexpr float kCascadeRatio = 4.f;
+
+    // Creates the texture array and its FBO (needs a current GL context)
+    void init();
+    void release();
+
+    // Bakes every cascade around 'camXZ' with 'bakeProg' (water.frag with
+    // WAVE_BAKE). The caller binds 'bakeProg' and sets iTime first. Leaves the
+    // FBO and viewport changed.
+    void update(const glm::vec2 &camXZ, GLuint bakeProg, GLuint screenVAO);
+
+    bool valid() const { return m_valid; }
+    GLuint texture() const { return m_tex; }
+    // (origin.x, origin.z, 1 / extent) of cascade 'i', as water.frag expects
+    glm::vec3 cascade(int i) const { return m_cascades[i]; }
+    // Wave octaves cascade 'i' resolves (u_waveCascadeOctaves in water.frag)
+    int octaves(int i) const { return m_octaves[i]; }
+
+private:
+    GLuint m_fbo = 0;
+    GLuint m_tex = 0;
+    bool m_valid = false;
+    glm::vec3 m_cascades[kCascades] = {};
+    int m_octaves[kCascades] = {};
+};
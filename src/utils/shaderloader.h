@@ -6,64 +6,237 @@
 #endif
 #include <GL/glew.h>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "utils/ProgramBinaryCache.h"
+
+// Preprocessor macros for one shader permutation, each "NAME" or "NAME VALUE"
+using ShaderDefines = std::vector<std::string>;
 
 class ShaderLoader{
 public:
-    static GLuint createShaderProgram(const char * vertex_file_path, const char * fragment_file_path){
+    // A program whose compile/link may still be running on driver threads
+    // (GL_KHR_parallel_shader_compile). Create with beginShaderProgram, poll with
+    // isShaderProgramReady, and turn into a program with finishShaderProgram.
+    struct PendingProgram {
+        GLuint program = 0;
+        GLuint vertexShader = 0;
+        GLuint fragmentShader = 0;
+        bool fromBinary = false;
+        std::string binaryKey;
+        std::vector<std::string> vertexSources, fragmentSources;
+    };
+
+    static GLuint createShaderProgram(const char * vertex_file_path, const char * fragment_file_path,
+                                      const ShaderDefines &defines = {}){
+        PendingProgram pending = beginShaderProgram(vertex_file_path, fragment_file_path, defines);
+        return finishShaderProgram(pending);
+    }
+
+    // Issues the compile and link without querying any status, so the driver
+    // may do the work in the background. Throws only if a file cannot be read.
+    static PendingProgram beginShaderProgram(const char * vertex_file_path, const char * fragment_file_path,
+                                             const ShaderDefines &defines = {}){
+        PendingProgram p;
+
+        // Expand both stages; the expanded text (defines + includes) is the binary cache key
+        std::string vertexCode = preprocess(vertex_file_path, defines, &p.vertexSources);
+        std::string fragmentCode = preprocess(fragment_file_path, defines, &p.fragmentSources);
+
+        if (ProgramBinaryCache *cache = binaryCache()) {
+            p.binaryKey = cache->makeKey(vertexCode, fragmentCode);
+            if (GLuint cached = cache->load(p.binaryKey)) {
+                p.program = cached;
+                p.fromBinary = true;
+                return p;
+            }
+        }
+
         // Create and compile the shaders.
-        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
-        GLuint fragmentShaderID = createShader(GL_FRAGMENT_SHADER, fragment_file_path);
+        p.vertexShader = compileShader(GL_VERTEX_SHADER, vertexCode);
+        p.fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentCode);
 
         // Link the shader program.
-        GLuint programID = glCreateProgram();
-        glAttachShader(programID, vertexShaderID);
-        glAttachShader(programID, fragmentShaderID);
-        glLinkProgram(programID);
+        p.program = glCreateProgram();
+        if (!p.binaryKey.empty()) glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(p.program, p.vertexShader);
+        glAttachShader(p.program, p.fragmentShader);
+        glLinkProgram(p.program);
+        return p;
+    }
+
+    // True once finishShaderProgram would not block. Without the extension the
+    // driver compiles synchronously anyway, so this always reports ready.
+    static bool isShaderProgramReady(const PendingProgram &p){
+        if (p.fromBinary || !GLEW_KHR_parallel_shader_compile) return true;
+        GLint done = GL_TRUE;
+        glGetProgramiv(p.program, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    // Checks compile/link results (waiting if still in flight) and returns the
+    // linked program. On failure everything is released and the log is thrown.
+    static GLuint finishShaderProgram(PendingProgram &p){
+        if (p.fromBinary) return p.program;
+
+        auto release = [&]() {
+            glDeleteProgram(p.program);
+            glDeleteShader(p.vertexShader);
+            glDeleteShader(p.fragmentShader);
+            p.program = p.vertexShader = p.fragmentShader = 0;
+        };
+        try {
+            checkShader(p.vertexShader, p.vertexSources);
+            checkShader(p.fragmentShader, p.fragmentSources);
+        } catch (...) {
+            release();
+            throw;
+        }
 
         // Print the info log if error
         GLint status;
-        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+        glGetProgramiv(p.program, GL_LINK_STATUS, &status);
 
         if (status == GL_FALSE) {
             GLint length;
-            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+            glGetProgramiv(p.program, GL_INFO_LOG_LENGTH, &length);
 
             std::string log(length, '\0');
-            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+            glGetProgramInfoLog(p.program, length, nullptr, &log[0]);
 
-            glDeleteProgram(programID);
+            release();
             throw std::runtime_error(log);
         }
 
         // Shaders no longer necessary, stored in program
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
+        glDeleteShader(p.vertexShader);
+        glDeleteShader(p.fragmentShader);
+        p.vertexShader = p.fragmentShader = 0;
+
+        if (!p.binaryKey.empty() && binaryCache()) binaryCache()->store(p.binaryKey, p.program);
 
-        return programID;
+        return p.program;
+    }
+
+    // On-disk program binaries used by createShaderProgram (nullptr = always compile)
+    static void setBinaryCache(ProgramBinaryCache *cache){ binaryCache() = cache; }
+
+    // Reads a shader and expands it into a single source string: 'defines' are
+    // inserted right after #version, and each #include "file" (resolved relative
+    // to the including file) is pasted in once. #line directives keep compiler
+    // messages pointing at the original file/line; 'sources' receives the file for
+    // each source-string number used in them (0 = the shader itself).
+    static std::string preprocess(const char *filepath, const ShaderDefines &defines,
+                                  std::vector<std::string> *sources = nullptr){
+        std::vector<std::string> files;
+        std::string out;
+        expandFile(QString(filepath), defines, true, files, out);
+        if (sources) *sources = files;
+        return out;
     }
 
 private:
-    static GLuint createShader(GLenum shaderType, const char *filepath){
-        GLuint shaderID = glCreateShader(shaderType);
+    static ProgramBinaryCache *&binaryCache(){
+        static ProgramBinaryCache *cache = nullptr;
+        return cache;
+    }
 
-        // Read shader file.
-        std::string code;
-        QString filepathStr = QString(filepath);
-        QFile file(filepathStr);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream stream(&file);
-            code = stream.readAll().toStdString();
-        }else{
-            throw std::runtime_error(std::string("Failed to open shader: ")+filepath);
+    static std::string readFile(const QString &path){
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            throw std::runtime_error("Failed to open shader: " + path.toStdString());
         }
+        QTextStream stream(&file);
+        return stream.readAll().toStdString();
+    }
+
+    static void expandFile(const QString &path, const ShaderDefines &defines, bool isRoot,
+                           std::vector<std::string> &files, std::string &out){
+        const int sourceId = static_cast<int>(files.size());
+        files.push_back(path.toStdString());
+        const std::string code = readFile(path);
+        const QString dir = QFileInfo(path).path();
+
+        bool definesPending = isRoot;
+        bool inComment = false;
+        int lineNo = 0;
+        size_t pos = 0;
+        while (pos < code.size()) {
+            size_t end = code.find('\n', pos);
+            if (end == std::string::npos) end = code.size();
+            const std::string line = code.substr(pos, end - pos);
+            pos = end + 1;
+            ++lineNo;
+
+            size_t first = line.find_first_not_of(" \t");
+            const bool isVersion = first != std::string::npos && line.compare(first, 8, "#version") == 0;
+            const bool isInclude = first != std::string::npos && line.compare(first, 8, "#include") == 0;
+
+            // Only comments and blank lines may precede #version
+            const bool opensComment = first != std::string::npos && line.compare(first, 2, "/*") == 0;
+            const bool skippable = inComment || opensComment || first == std::string::npos ||
+                                   line.compare(first, 2, "//") == 0;
+            if (inComment || opensComment) {
+                inComment = line.find("*/", opensComment ? first + 2 : 0) == std::string::npos;
+            }
+
+            if (definesPending && !isVersion && !skippable) {
+                // No #version: defines go ahead of the first line of code
+                emitDefines(defines, out);
+                out += "#line " + std::to_string(lineNo) + " " + std::to_string(sourceId) + "\n";
+                definesPending = false;
+            }
+
+            if (isInclude) {
+                size_t q0 = line.find('"', first);
+                size_t q1 = (q0 == std::string::npos) ? q0 : line.find('"', q0 + 1);
+                if (q1 == std::string::npos) {
+                    throw std::runtime_error("Malformed #include in " + path.toStdString() +
+                                             ":" + std::to_string(lineNo));
+                }
+                QString includePath = dir + "/" + QString::fromStdString(line.substr(q0 + 1, q1 - q0 - 1));
+                bool seen = false;
+                for (const auto &f : files) seen = seen || (f == includePath.toStdString());
+                if (!seen) {
+                    out += "#line 1 " + std::to_string(files.size()) + "\n";
+                    expandFile(includePath, {}, false, files, out);
+                }
+                out += "#line " + std::to_string(lineNo + 1) + " " + std::to_string(sourceId) + "\n";
+                continue;
+            }
+
+            out += line;
+            out += '\n';
+
+            if (definesPending && isVersion) {
+                emitDefines(defines, out);
+                out += "#line " + std::to_string(lineNo + 1) + " " + std::to_string(sourceId) + "\n";
+                definesPending = false;
+            }
+        }
+    }
+
+    static void emitDefines(const ShaderDefines &defines, std::string &out){
+        for (const auto &d : defines) {
+            out += "#define " + d + "\n";
+        }
+    }
+
+    static GLuint compileShader(GLenum shaderType, const std::string &code){
+        GLuint shaderID = glCreateShader(shaderType);
 
         // Compile shader code.
         const char *codePtr = code.c_str();
         glShaderSource(shaderID, 1, &codePtr, nullptr); // Assumes code is null terminated
         glCompileShader(shaderID);
+        return shaderID;
+    }
 
+    static void checkShader(GLuint shaderID, const std::vector<std::string> &sources){
         // Print info log if shader fails to compile.
         GLint status;
         glGetShaderiv(shaderID, GL_COMPILE_STATUS, &status);
@@ -75,10 +248,13 @@ private:
             std::string log(length, '\0');
             glGetShaderInfoLog(shaderID, length, nullptr, &log[0]);
 
-            glDeleteShader(shaderID);
+            // Name the source strings the #line directives refer to
+            log += "Sources:";
+            for (size_t i = 0; i < sources.size(); ++i) {
+                log += " " + std::to_string(i) + "=" + sources[i];
+            }
+            log += "\n";
             throw std::runtime_error(log);
         }
-
-        return shaderID;
     }
 };